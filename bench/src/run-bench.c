@@ -0,0 +1,504 @@
+#include <stdio.h>
+
+#include <bump/bump.h>
+#include <bump/report.h>
+#include <bump/version.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_MEGABYTES 8
+#define DEFAULT_REPETITIONS 5
+#define DEFAULT_WARMUP 1
+#define TINY_FILE_COUNT 2000
+#define TINY_FILE_SIZE 256
+#define MINIFIED_LINE_LENGTH (1024 * 1024)
+#define SEED 0x2545F4914F6CDD1Du
+
+extern char **environ;
+
+/*
+ * CORPORA
+ * =======
+ *
+ * Every corpus is generated from a fixed seed, so runs on different
+ * machines and at different times measure exactly the same input.
+ */
+
+typedef struct corpus_struct {
+  const char *name;
+  char *data;
+  size_t size;
+  size_t capacity;
+  size_t lines;
+  size_t matches;
+  // Corpora of many small files are written to a directory instead of a single file.
+  size_t file_count;
+} Corpus;
+
+typedef struct random_struct {
+  uint64_t state;
+} Random;
+
+static uint64_t next_random(Random *random) {
+  random->state ^= random->state << 13;
+  random->state ^= random->state >> 7;
+  random->state ^= random->state << 17;
+  return random->state;
+}
+
+static size_t random_below(Random *random, size_t bound) {
+  return (size_t) (next_random(random) % bound);
+}
+
+static void append(Corpus *corpus, const char *text, size_t length) {
+  if (corpus->size + length > corpus->capacity) {
+    size_t capacity = corpus->capacity ? corpus->capacity * 2 : 1024 * 1024;
+    while (capacity < corpus->size + length) {
+      capacity *= 2;
+    }
+    corpus->data = realloc(corpus->data, capacity);
+    if (!corpus->data) {
+      fprintf(stderr, "Could not allocate memory for the corpus.\n");
+      exit(EXIT_FAILURE);
+    }
+    corpus->capacity = capacity;
+  }
+  memcpy(corpus->data + corpus->size, text, length);
+  corpus->size += length;
+}
+
+static void append_string(Corpus *corpus, const char *text) {
+  append(corpus, text, strlen(text));
+}
+
+static void append_version(Corpus *corpus, Random *random) {
+  char version[64];
+  int length = snprintf(version, sizeof(version), "%zu.%zu.%zu",
+                        random_below(random, 20), random_below(random, 100), random_below(random, 1000));
+  append(corpus, version, (size_t) length);
+}
+
+static const char *words[] = {
+        "the", "release", "of", "a", "build", "with", "notes", "for", "every", "module",
+        "and", "its", "tests", "are", "kept", "in", "sync", "across", "all", "branches",
+};
+
+static void append_word(Corpus *corpus, Random *random) {
+  append_string(corpus, words[random_below(random, sizeof(words) / sizeof(words[0]))]);
+}
+
+// Short lines of code, with a version in about one line out of fifty.
+static void generate_source(Corpus *corpus, Random *random, size_t size) {
+  while (corpus->size < size) {
+    append_string(corpus, "    ");
+    size_t count = 2 + random_below(random, 6);
+    for (size_t index = 0; index < count; index++) {
+      append_word(corpus, random);
+      append_string(corpus, index + 1 < count ? " " : "");
+    }
+    if (random_below(random, 50) == 0) {
+      append_string(corpus, " = \"");
+      append_version(corpus, random);
+      append_string(corpus, "\"");
+    } else if (random_below(random, 4) == 0) {
+      append_string(corpus, "(1.5, 2)");
+    }
+    append_string(corpus, ";\n");
+  }
+}
+
+// Very long lines, as in minified scripts, with a version every couple of kilobytes.
+static void generate_minified(Corpus *corpus, Random *random, size_t size) {
+  while (corpus->size < size) {
+    size_t line_end = corpus->size + MINIFIED_LINE_LENGTH;
+    while (corpus->size < line_end && corpus->size < size) {
+      append_string(corpus, "function(a,b){return a.");
+      append_word(corpus, random);
+      append_string(corpus, "(b,0.5)};");
+      if (random_below(random, 40) == 0) {
+        append_string(corpus, "var v=\"");
+        append_version(corpus, random);
+        append_string(corpus, "\";");
+      }
+    }
+    append_string(corpus, "\n");
+  }
+}
+
+// Lock files, where almost every line holds a version.
+static void generate_lockfile(Corpus *corpus, Random *random, size_t size) {
+  while (corpus->size < size) {
+    append_string(corpus, "    \"");
+    append_word(corpus, random);
+    append_string(corpus, "-");
+    append_word(corpus, random);
+    append_string(corpus, "\": \"^");
+    append_version(corpus, random);
+    append_string(corpus, "\",\n");
+  }
+}
+
+// Plain text without a single version, but with numbers that look close.
+static void generate_prose(Corpus *corpus, Random *random, size_t size) {
+  while (corpus->size < size) {
+    size_t count = 8 + random_below(random, 12);
+    for (size_t index = 0; index < count; index++) {
+      append_word(corpus, random);
+      append_string(corpus, " ");
+    }
+    if (random_below(random, 3) == 0) {
+      append_string(corpus, "in 2.5 weeks or 10.0.0.1 at most");
+    }
+    append_string(corpus, ".\n");
+  }
+}
+
+// Many tiny files, each with a version. They are stored one after another.
+static void generate_tiny(Corpus *corpus, Random *random, size_t size) {
+  (void) size;
+  for (size_t file = 0; file < TINY_FILE_COUNT; file++) {
+    size_t start = corpus->size;
+    append_string(corpus, "# Package\n\nversion = ");
+    append_version(corpus, random);
+    append_string(corpus, "\n");
+    while (corpus->size - start < TINY_FILE_SIZE - 8) {
+      append_word(corpus, random);
+      append_string(corpus, " ");
+    }
+    append_string(corpus, "\n");
+  }
+  corpus->file_count = TINY_FILE_COUNT;
+}
+
+static void count_corpus(Corpus *corpus) {
+  for (size_t index = 0; index < corpus->size; index++) {
+    corpus->lines += corpus->data[index] == '\n';
+  }
+  FileScan scan;
+  if (scan_buffer(corpus->data, corpus->size, &scan)) {
+    fprintf(stderr, "Could not scan the %s corpus.\n", corpus->name);
+    exit(EXIT_FAILURE);
+  }
+  corpus->matches = scan.count;
+  free_file_scan(&scan);
+}
+
+/*
+ * FILE HELPERS
+ * ============
+ *
+ * The file benchmarks read the corpora from a temporary directory, which
+ * is removed again once the benchmarks are done.
+ */
+
+static void write_file(const char *path, const char *data, size_t size) {
+  FILE *file = fopen(path, "wb");
+  if (!file || fwrite(data, 1, size, file) != size || fclose(file)) {
+    fprintf(stderr, "Could not write \"%s\".\n", path);
+    exit(EXIT_FAILURE);
+  }
+}
+
+static void corpus_path(char *path, size_t size, const char *directory, const Corpus *corpus) {
+  snprintf(path, size, "%s/%s%s", directory, corpus->name, corpus->file_count ? "" : ".txt");
+}
+
+static void write_corpus(const char *directory, const Corpus *corpus) {
+  char path[512];
+  corpus_path(path, sizeof(path), directory, corpus);
+  if (!corpus->file_count) {
+    write_file(path, corpus->data, corpus->size);
+    return;
+  }
+  if (mkdir(path, 0777)) {
+    fprintf(stderr, "Could not create \"%s\".\n", path);
+    exit(EXIT_FAILURE);
+  }
+  size_t file_size = corpus->size / corpus->file_count;
+  for (size_t file = 0; file < corpus->file_count; file++) {
+    char file_path[600];
+    snprintf(file_path, sizeof(file_path), "%s/%04zu.toml", path, file);
+    size_t start = file * file_size;
+    size_t end = file + 1 == corpus->file_count ? corpus->size : start + file_size;
+    write_file(file_path, corpus->data + start, end - start);
+  }
+}
+
+static void remove_corpus(const char *directory, const Corpus *corpus) {
+  char path[512];
+  corpus_path(path, sizeof(path), directory, corpus);
+  if (corpus->file_count) {
+    for (size_t file = 0; file < corpus->file_count; file++) {
+      char file_path[600];
+      snprintf(file_path, sizeof(file_path), "%s/%04zu.toml", path, file);
+      remove(file_path);
+    }
+    rmdir(path);
+  } else {
+    remove(path);
+  }
+}
+
+/*
+ * BENCHMARKS
+ * ==========
+ *
+ * Every benchmark runs a number of warmup rounds that are not measured,
+ * then the measured repetitions. The median time is reported, since it
+ * is the least disturbed by other work on the machine.
+ */
+
+typedef struct bench_options_struct {
+  size_t megabytes;
+  size_t repetitions;
+  size_t warmup;
+  bool json;
+  const char *directory;
+} BenchOptions;
+
+typedef char *(*BenchFunction)(const BenchOptions *options, const Corpus *corpus);
+
+static double now(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+static int compare_times(const void *left, const void *right) {
+  double first = *(const double *) left;
+  double second = *(const double *) right;
+  return (first > second) - (first < second);
+}
+
+static char *bench_process_line(const BenchOptions *options, const Corpus *corpus) {
+  (void) options;
+  size_t longest = 0;
+  for (size_t start = 0; start < corpus->size;) {
+    const char *end = memchr(corpus->data + start, '\n', corpus->size - start);
+    size_t length = end ? (size_t) (end - corpus->data) - start : corpus->size - start;
+    longest = length > longest ? length : longest;
+    start += length + 1;
+  }
+  char *output = malloc(longest + longest / 5 + 2);
+  if (!output) {
+    return "Could not allocate memory for the output line";
+  }
+
+  char *error = NULL;
+  for (size_t start = 0; start < corpus->size && !error;) {
+    const char *end = memchr(corpus->data + start, '\n', corpus->size - start);
+    size_t length = end ? (size_t) (end - corpus->data) - start : corpus->size - start;
+    LineState state;
+    error = initialize_line_state(&state, corpus->data + start, output, length);
+    if (!error) {
+      error = process_line(&state, "patch");
+    }
+    start += length + 1;
+  }
+  free(output);
+  return error;
+}
+
+static char *bench_process_file(const BenchOptions *options, const Corpus *corpus) {
+  char path[512];
+  char output_path[512];
+  corpus_path(path, sizeof(path), options->directory, corpus);
+  snprintf(output_path, sizeof(output_path), "%s/output.txt", options->directory);
+  if (!corpus->file_count) {
+    return process_path(path, output_path, "patch", BUMP_BLOCK_SIZE, NULL);
+  }
+  char *error = NULL;
+  for (size_t file = 0; file < corpus->file_count && !error; file++) {
+    char file_path[600];
+    snprintf(file_path, sizeof(file_path), "%s/%04zu.toml", path, file);
+    error = process_path(file_path, output_path, "patch", BUMP_BLOCK_SIZE, NULL);
+  }
+  return error;
+}
+
+/*
+ * Runs the main executable as a user would. Single files are bumped into
+ * a separate output, and directories of small files are bumped in place.
+ */
+static char *bench_cli(const BenchOptions *options, const Corpus *corpus) {
+  char path[512];
+  char output_path[512];
+  corpus_path(path, sizeof(path), options->directory, corpus);
+  snprintf(output_path, sizeof(output_path), "%s/output.txt", options->directory);
+  char *single_file[] = {BUMP_EXECUTABLE, "-i", path, "-o", output_path, "-l", "patch", NULL};
+  char *directory[] = {BUMP_EXECUTABLE, "-r", path, "-l", "patch", NULL};
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+  pid_t child;
+  int result = posix_spawn(&child, BUMP_EXECUTABLE, &actions, NULL,
+                           corpus->file_count ? directory : single_file, environ);
+  posix_spawn_file_actions_destroy(&actions);
+  if (result) {
+    return "Could not start the bump executable";
+  }
+  int status;
+  while (waitpid(child, &status, 0) == -1) {
+    if (errno != EINTR) {
+      return "Could not wait for the bump executable";
+    }
+  }
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+    return "The bump executable failed";
+  }
+  return NULL;
+}
+
+static bool run_benchmark(const BenchOptions *options, const char *name, BenchFunction function, const Corpus *corpus) {
+  double *times = malloc(options->repetitions * sizeof(double));
+  if (!times) {
+    fprintf(stderr, "Could not allocate memory for the timings.\n");
+    return false;
+  }
+  char *error = NULL;
+  for (size_t round = 0; round < options->warmup && !error; round++) {
+    error = function(options, corpus);
+  }
+  for (size_t round = 0; round < options->repetitions && !error; round++) {
+    double start = now();
+    error = function(options, corpus);
+    times[round] = now() - start;
+  }
+  if (error) {
+    fprintf(stderr, "Benchmark %s on %s failed: %s\n", name, corpus->name, error);
+    free(times);
+    return false;
+  }
+
+  qsort(times, options->repetitions, sizeof(double), compare_times);
+  double median = times[options->repetitions / 2];
+  double best = times[0];
+  free(times);
+  double seconds = median > 0 ? median : 1e-9;
+  double megabytes = (double) corpus->size / (1024.0 * 1024.0);
+  if (options->json) {
+    printf("{\"benchmark\":\"%s\",\"corpus\":\"%s\",\"bytes\":%zu,\"lines\":%zu,\"matches\":%zu,"
+           "\"files\":%zu,\"repetitions\":%zu,\"median_seconds\":%.9f,\"best_seconds\":%.9f,"
+           "\"mb_per_second\":%.3f,\"lines_per_second\":%.1f,\"matches_per_second\":%.1f}\n",
+           name, corpus->name, corpus->size, corpus->lines, corpus->matches,
+           corpus->file_count ? corpus->file_count : 1, options->repetitions, median, best,
+           megabytes / seconds, (double) corpus->lines / seconds, (double) corpus->matches / seconds);
+  } else {
+    printf("%-14s %-10s %10.2f MB/s %14.0f lines/s %14.0f matches/s %10.6f s\n",
+           name, corpus->name, megabytes / seconds, (double) corpus->lines / seconds,
+           (double) corpus->matches / seconds, median);
+  }
+  fflush(stdout);
+  return true;
+}
+
+/*
+ * COMMAND LINE
+ * ============
+ */
+
+static void print_usage(void) {
+  printf("Benchmarks for bump " BUMP_VERSION "\n"
+         "Usage: bench [--json] [--size MB] [--repetitions N] [--warmup N]\n"
+         "  --json          Print one JSON object per benchmark, for tracking over time.\n"
+         "  --size MB       Size of every generated corpus (default: %d).\n"
+         "  --repetitions N Number of measured runs of every benchmark (default: %d).\n"
+         "  --warmup N      Number of unmeasured runs before those (default: %d).\n",
+         DEFAULT_MEGABYTES, DEFAULT_REPETITIONS, DEFAULT_WARMUP);
+}
+
+static bool parse_count(const char *value, size_t *count, bool allow_zero) {
+  char *end;
+  errno = 0;
+  unsigned long long parsed = strtoull(value, &end, 10);
+  if (errno || end == value || *end != '\0' || value[0] == '-' || (!allow_zero && parsed == 0)) {
+    return false;
+  }
+  *count = (size_t) parsed;
+  return true;
+}
+
+int main(int argc, char **argv) {
+  BenchOptions options = {DEFAULT_MEGABYTES, DEFAULT_REPETITIONS, DEFAULT_WARMUP, false, NULL};
+  for (int index = 1; index < argc; index++) {
+    const char *argument = argv[index];
+    bool valid = true;
+    if (strcmp(argument, "--json") == 0) {
+      options.json = true;
+    } else if (strcmp(argument, "--help") == 0 || strcmp(argument, "-h") == 0) {
+      print_usage();
+      return EXIT_SUCCESS;
+    } else if (index + 1 == argc) {
+      valid = false;
+    } else if (strcmp(argument, "--size") == 0) {
+      valid = parse_count(argv[++index], &options.megabytes, false);
+    } else if (strcmp(argument, "--repetitions") == 0) {
+      valid = parse_count(argv[++index], &options.repetitions, false);
+    } else if (strcmp(argument, "--warmup") == 0) {
+      valid = parse_count(argv[++index], &options.warmup, true);
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      print_usage();
+      return EXIT_FAILURE;
+    }
+  }
+
+  char directory[] = "/tmp/bump-bench-XXXXXX";
+  if (!mkdtemp(directory)) {
+    fprintf(stderr, "Could not create a temporary directory.\n");
+    return EXIT_FAILURE;
+  }
+  options.directory = directory;
+
+  struct {
+    const char *name;
+    void (*generate)(Corpus *corpus, Random *random, size_t size);
+  } generators[] = {
+          {"source", generate_source},
+          {"minified", generate_minified},
+          {"lockfile", generate_lockfile},
+          {"prose", generate_prose},
+          {"tiny", generate_tiny},
+  };
+  struct {
+    const char *name;
+    BenchFunction function;
+  } benchmarks[] = {
+          {"process_line", bench_process_line},
+          {"process_file", bench_process_file},
+          {"cli", bench_cli},
+  };
+
+  bool success = true;
+  for (size_t index = 0; index < sizeof(generators) / sizeof(generators[0]); index++) {
+    Corpus corpus = {0};
+    corpus.name = generators[index].name;
+    Random random = {SEED ^ index};
+    generators[index].generate(&corpus, &random, options.megabytes * 1024 * 1024);
+    count_corpus(&corpus);
+    write_corpus(directory, &corpus);
+    for (size_t bench = 0; bench < sizeof(benchmarks) / sizeof(benchmarks[0]); bench++) {
+      success = run_benchmark(&options, benchmarks[bench].name, benchmarks[bench].function, &corpus) && success;
+    }
+    remove_corpus(directory, &corpus);
+    free(corpus.data);
+  }
+
+  char output_path[64];
+  snprintf(output_path, sizeof(output_path), "%s/output.txt", directory);
+  remove(output_path);
+  rmdir(directory);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,55 @@
+#ifndef BUMP_BATCH_H
+#define BUMP_BATCH_H
+
+#include <bump/report.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct batch_result_struct {
+  const char *path;
+  char *error;
+  bool changed;
+  // Skipped because it looks binary.
+  bool binary;
+  FileScan scan;
+} BatchResult;
+
+typedef struct batch_state_struct {
+  const char **input_paths;
+  const char *output_path;
+  const char *bump_level;
+  BatchResult *results;
+  size_t count;
+  size_t jobs;
+  size_t block_size;
+  // Files are only scanned, and the versions found kept in the results.
+  bool dry_run;
+  // Remembers which files hold versions between runs, when set.
+  struct scan_cache_struct *cache;
+  // Small files are read through io_uring where the system supports it.
+  bool io_uring;
+  // Takes the highest version of every file scanned in a dry run, when set.
+  struct highest_version_struct *highest;
+  atomic_size_t next;
+  // Counts the workers as they start, to share the files in flight among them.
+  atomic_size_t workers;
+} BatchState;
+
+size_t count_online_processors(void);
+
+char *initialize_batch_state(BatchState *state,
+                             const char **input_paths,
+                             size_t count,
+                             const char *output_path,
+                             const char *bump_level,
+                             size_t jobs,
+                             size_t block_size);
+
+char *process_batch(BatchState *state);
+
+size_t count_batch_failures(const BatchState *state);
+
+void free_batch_state(BatchState *state);
+
+#endif//BUMP_BATCH_H
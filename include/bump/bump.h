@@ -1,8 +1,21 @@
 #ifndef BUMP_H
 #define BUMP_H
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/types.h>
+
+#define INTERMEDIATE_SUFFIX ".bump.temp"
+
+// Files are scanned in blocks of this size, regardless of their line lengths.
+#define BUMP_BLOCK_SIZE 65536
+
+// Files at least this large are split and bumped in parallel, unless configured otherwise.
+#define BUMP_SPLIT_THRESHOLD (64 * 1024 * 1024)
+
+// The level that replaces every version with the configured target.
+#define BUMP_TARGET_LEVEL "target"
 
 typedef struct version_struct {
   size_t major;
@@ -10,30 +23,60 @@ typedef struct version_struct {
   size_t patch;
 } Version;
 
+typedef enum bump_level_enum {
+  BUMP_MAJOR,
+  BUMP_MINOR,
+  BUMP_PATCH,
+  BUMP_TARGET,
+} BumpLevel;
+
 typedef struct line_state_struct {
   const char *input;
   char *output;
   size_t input_index;
   size_t output_index;
   size_t limit;
+  size_t versions;
 } LineState;
 
+// Offsets of the digits of each component of a version.
+typedef struct version_span_struct {
+  size_t starts[3];
+  size_t ends[3];
+} VersionSpan;
+
 typedef struct file_state_struct {
   FILE *input;
   FILE *output;
-  size_t limit;
+  size_t block_size;
   const char *bump_level;
+  size_t versions;
+  // What the output replaces once the file is processed, when it was opened by path.
+  struct replacement_file_struct *replacement;
 } FileState;
 
 char *initialize_version(Version *version, size_t major, size_t minor, size_t patch);
 
 char *initialize_line_state(LineState *state, const char *input, char *output, size_t limit);
 
+/*
+ * Opens the input and output of a file state by path. The output is
+ * written next to the output path, and only takes its place once
+ * process_file() succeeds, so a failed bump leaves an existing output,
+ * or an input bumped onto itself, as it was.
+ */
 char *initialize_file_state(FileState *state,
                             const char *input_path,
                             const char *output_path,
                             const char *bump_level,
-                            size_t limit);
+                            size_t block_size);
+
+char *initialize_file_state_at(FileState *state,
+                               int directory,
+                               const char *input_path,
+                               const char *output_path,
+                               const char *bump_level,
+                               size_t block_size);
 
 char *bump_major(Version *version);
 
@@ -43,8 +86,167 @@ char *bump_patch(Version *version);
 
 char *convert_to_string(Version *version, char *output_buffer, size_t *length);
 
+/*
+ * Finds the first version between the two offsets. Numbers that are not
+ * part of a version, such as "1.2" or "1.2.3.4", are passed over.
+ */
+bool find_version(const char *input, size_t from, size_t limit, VersionSpan *span);
+
+// Like find_version(), but only finds the source version once one is configured.
+bool find_next_version(const char *input, size_t from, size_t limit, VersionSpan *span);
+
+bool contains_version(const char *input, size_t length);
+
+/*
+ * Writes the bumped form of a version found in the input and returns its
+ * length, which is at most bumped_length_limit() of that of the original.
+ */
+size_t format_bumped_version(const char *input, const VersionSpan *span, BumpLevel level, char *output);
+
+// At most one more than the length of a version, unless the target is longer.
+size_t bumped_length_limit(size_t length);
+
+char *parse_bump_level(const char *name, BumpLevel *level);
+
+/*
+ * Bumps the first version from the current position on. The rest of the
+ * line is copied after it, and the input index is left just past the
+ * version, so that the next call continues with the rest of the line.
+ */
 char *process_line(LineState *state, const char *bump_level);
 
+/*
+ * Bumps every version from the current position up to the limit in a
+ * single pass. The output is not terminated; its length is the output
+ * index. It needs room for the input plus one character per five, or
+ * more when versions are replaced by a longer target.
+ */
+char *process_versions(LineState *state, const char *bump_level);
+
+/*
+ * Lets mapped files of at least the given size be split into chunks that
+ * are bumped by up to the given number of helper threads, shared by all
+ * files, while the calling thread writes the chunks out in order. A zero
+ * threshold or a single job turns this off, which is the default.
+ */
+void configure_split(size_t threshold, size_t jobs);
+
+/*
+ * Makes every file be read, bumped and written by three threads at once,
+ * linked by queues of recycled buffers, instead of being mapped. This helps
+ * on slow disks and network filesystems. It is off by default.
+ */
+void configure_pipeline(bool enabled);
+
+/*
+ * Returned in place of an error for a file that looks binary and was left
+ * alone, which callers tell apart by its address. Skipping is on unless
+ * binary detection is turned off.
+ */
+extern char binary_file_skipped[];
+
+void configure_binary_detection(bool enabled);
+
+// Tells whether a file that starts with the data is to be skipped as binary.
+bool is_skipped_binary(const char *data, size_t size);
+
+// Like is_skipped_binary(), for a file already known to look binary or not.
+bool skips_binary_file(bool binary);
+
+/*
+ * Sets the version that every version becomes with the target level, as
+ * for a lockstep bump. It must be set before any file is processed.
+ */
+char *configure_target(const char *version);
+
+/*
+ * Limits bumping to exact copies of the given version, leaving every other
+ * version as it is, or bumps every version again when it is NULL. It must
+ * be set before any file is processed.
+ */
+char *configure_source(const char *version);
+
 char *process_file(FileState *state);
 
+/*
+ * Bumps the versions of one file. Giving the same input and output path
+ * rewrites the file in place, unless it has no version at all, in which
+ * case it is not touched. The changed flag, which may be NULL, reports
+ * whether any version was bumped.
+ */
+char *process_path_at(int directory,
+                      const char *input_path,
+                      const char *output_path,
+                      const char *bump_level,
+                      size_t block_size,
+                      bool *changed);
+
+char *process_path(const char *input_path,
+                   const char *output_path,
+                   const char *bump_level,
+                   size_t block_size,
+                   bool *changed);
+
+// Declared in report.h and uring.h, which cannot be included here.
+struct file_scan_struct;
+struct patch_list_struct;
+
+/*
+ * Bumps a file in place whose contents were already read, such as by the
+ * io_uring loader, without reading it again. When the versions keep their
+ * lengths, the changed bytes are added to the patches, for the loader to
+ * write through the descriptor it read the file from. Without patches, as
+ * when the file could not be opened for writing, or when a version changes
+ * length, the file is rewritten from the contents.
+ */
+char *bump_loaded_file(int directory,
+                       const char *path,
+                       const char *data,
+                       size_t size,
+                       struct patch_list_struct *patches,
+                       const char *bump_level,
+                       size_t block_size,
+                       bool *changed);
+
+/*
+ * Opens a file that is bumped in place, for writing as well when that is
+ * allowed, which the writable flag reports.
+ */
+FILE *open_in_place(int directory, const char *path, bool *writable);
+
+/*
+ * Bumps a file in place that was opened with open_in_place() and whose
+ * contents are already mapped, such as by the scan cache, without opening
+ * or reading it again. The scan, when given, holds every version of the
+ * contents, so that they are not looked for again. The input is closed.
+ */
+char *bump_mapped_file(int directory,
+                       const char *path,
+                       FILE *input,
+                       bool writable,
+                       const char *data,
+                       size_t size,
+                       const struct file_scan_struct *scan,
+                       const char *bump_level,
+                       size_t block_size,
+                       bool *changed);
+
+/*
+ * Bumps everything read from one open stream into another, such as a
+ * filter from standard input to standard output. Nothing is written to
+ * disk besides the output. Both streams are closed once done.
+ */
+char *process_streams(FILE *input, FILE *output, const char *bump_level, size_t block_size, bool *changed);
+
+/*
+ * Bumps an open stream into a file, which only replaces an existing one
+ * once everything has been bumped. The input is closed once done.
+ */
+char *process_stream_to_path(FILE *input,
+                             int directory,
+                             const char *output_path,
+                             const char *bump_level,
+                             size_t block_size,
+                             bool *changed);
+
 #endif//BUMP_H
@@ -0,0 +1,81 @@
+#ifndef BUMP_CACHE_H
+#define BUMP_CACHE_H
+
+#include <bump/report.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// The directory that holds the cache. Directory walks never enter it.
+#define BUMP_CACHE_DIRECTORY ".bump-cache"
+#define BUMP_CACHE_INDEX "index"
+#define BUMP_CACHE_LOCK "lock"
+// Caches written in any other format are ignored and rebuilt.
+#define BUMP_CACHE_FORMAT 2
+
+typedef struct file_identity_struct {
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  int64_t modified_seconds;
+  int64_t modified_nanoseconds;
+} FileIdentity;
+
+/*
+ * What a scan found in one file, together with what the file looked like
+ * at the time. A racy entry was recorded so soon after the file changed
+ * that a later change could have kept the same timestamp, so its content
+ * hash has to be checked before it is trusted. Files that look binary are
+ * only recorded when they were scanned anyway, and marked so that runs
+ * which skip them still do.
+ */
+typedef struct cache_entry_struct {
+  char *path;
+  FileIdentity identity;
+  uint64_t hash;
+  bool racy;
+  bool binary;
+  bool removed;
+  FileScan scan;
+} CacheEntry;
+
+/*
+ * Entries loaded when the cache was opened are only read while files are
+ * processed, so lookups need no locking. New entries are collected under
+ * a lock and merged into the index on disk when the cache is saved.
+ */
+typedef struct scan_cache_struct {
+  char *directory;
+  CacheEntry *entries;
+  size_t count;
+  CacheEntry *updates;
+  size_t update_count;
+  size_t update_capacity;
+  pthread_mutex_t lock;
+} ScanCache;
+
+uint64_t hash_bytes(const char *data, size_t size);
+
+char *open_scan_cache(ScanCache *cache, const char *directory);
+
+/*
+ * Bumps a file in place, unless the cache shows that it has no version,
+ * in which case it is not even opened. The key names the file in the cache.
+ */
+char *bump_with_cache(ScanCache *cache,
+                      int directory,
+                      const char *path,
+                      const char *key,
+                      const char *bump_level,
+                      size_t block_size,
+                      bool *changed);
+
+// Scans a file, or takes the result of an earlier scan from the cache.
+char *scan_with_cache(ScanCache *cache, int directory, const char *path, const char *key, FileScan *scan);
+
+char *save_scan_cache(ScanCache *cache);
+
+void free_scan_cache(ScanCache *cache);
+
+#endif//BUMP_CACHE_H
@@ -3,8 +3,85 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <sys/stat.h>
 
-bool file_is_valid(const char *input_path, const char *mode);
+typedef struct mapped_file_struct {
+  const char *data;
+  size_t size;
+} MappedFile;
+
+/*
+ * Paths read from a list, such as a build manifest or the output of
+ * "find -print0". They all point into the data, which holds the list.
+ */
+typedef struct file_list_struct {
+  char *data;
+  const char **paths;
+  size_t count;
+} FileList;
+
+/*
+ * A new version of a file, written next to it and moved over it in one
+ * step once complete. Readers see either the old or the new contents,
+ * and concurrent runs never share a temporary file. A symbolic link is
+ * followed, and the file it ends at is replaced instead, in its own
+ * directory, so that the link stays a link.
+ */
+typedef struct replacement_file_struct {
+  int directory;
+  const char *path;
+  // Owned copy of the path a link ends at, which the path then points to.
+  char *resolved_path;
+  const char *suffix;
+  char *temporary_path;
+  int descriptor;
+  // Set when the descriptor writes to the path itself, which cannot be undone.
+  bool direct;
+} ReplacementFile;
+
+/*
+ * Tells whether a path can be read, or written, by checking permissions
+ * only. Nothing is opened, so an existing output is not truncated.
+ */
+bool file_is_valid(const char *path, bool for_input);
+
+FILE *open_file_at(int directory, const char *path, const char *mode);
+
+// Queries an open file, which must be regular to be mapped.
+char *inspect_file(int descriptor, struct stat *status);
+
+// Maps a file checked by inspect_file(). An empty file gives an empty mapping.
+char *map_inspected_file(int descriptor, const struct stat *status, MappedFile *mapping);
+
+char *map_file(int descriptor, MappedFile *mapping);
+
+void unmap_file(MappedFile *mapping);
+
+char *open_replacement_file(int directory, const char *path, const char *suffix, ReplacementFile *replacement);
+
+/*
+ * Opens a replacement for an output file, which takes the place of what
+ * is at the path only when committed, so a failed bump leaves an existing
+ * output as it was. A new output gets the usual permissions of a new file.
+ * Links are followed like for any replacement, and only outputs such as
+ * devices and pipes are opened and written directly.
+ */
+char *open_output_file(int directory, const char *path, const char *suffix, ReplacementFile *output);
+
+char *commit_replacement_file(ReplacementFile *replacement);
+
+void discard_replacement_file(ReplacementFile *replacement);
+
+// Reads a stream to its end into a buffer that the caller frees.
+char *read_stream(FILE *input, char **data, size_t *size);
+
+/*
+ * Reads every path from a stream, given one per line or separated by the
+ * NUL character. Empty entries are skipped.
+ */
+char *read_file_list(FILE *input, char separator, FileList *list);
+
+void free_file_list(FileList *list);
 
 char *read_line(FILE *input, char *buffer, size_t *length, size_t limit);
 
@@ -0,0 +1,63 @@
+#ifndef BUMP_LOCKSTEP_H
+#define BUMP_LOCKSTEP_H
+
+#include <bump/bump.h>
+#include <bump/report.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A version packed so that two of them are ordered by two integer
+ * comparisons. The major component fills the high word, while the minor
+ * and patch components share the low one, 32 bits each.
+ */
+typedef struct version_key_struct {
+  uint64_t high;
+  uint64_t low;
+} VersionKey;
+
+/*
+ * The highest version found so far by any of the workers scanning the
+ * files of a lockstep bump. Each worker reduces a file on its own and only
+ * takes the lock to merge the result. The key orders it unless one of its
+ * components does not fit, and the digits, kept without leading zeros,
+ * order it then.
+ */
+typedef struct highest_version_struct {
+  pthread_mutex_t lock;
+  VersionKey key;
+  bool packed;
+  char *text;
+  size_t capacity;
+  VersionSpan span;
+  bool found;
+} HighestVersion;
+
+// Reads the components of a version found in the input.
+char *parse_version(const char *input, const VersionSpan *span, Version *version);
+
+char *pack_version_key(const Version *version, VersionKey *key);
+
+void unpack_version_key(VersionKey key, Version *version);
+
+bool version_key_less(VersionKey left, VersionKey right);
+
+char *initialize_highest_version(HighestVersion *highest);
+
+// Orders two versions by their digits, so that no component is too large.
+int compare_version_digits(const char *left, const VersionSpan *left_span, const char *right, const VersionSpan *right_span);
+
+// Reduces the versions of a scan to the highest one and merges it in.
+char *merge_highest_version(HighestVersion *highest, const FileScan *scan);
+
+/*
+ * Writes the highest version bumped at the level into the target, which
+ * holds capacity characters with the terminator. The found flag is cleared
+ * when no version has been merged.
+ */
+char *bump_highest_version(HighestVersion *highest, BumpLevel level, char *target, size_t capacity, bool *found);
+
+void free_highest_version(HighestVersion *highest);
+
+#endif//BUMP_LOCKSTEP_H
@@ -0,0 +1,83 @@
+#ifndef BUMP_MATCHER_H
+#define BUMP_MATCHER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define PATTERN_NEGATED 1u
+#define PATTERN_DIRECTORY_ONLY 2u
+#define PATTERN_ANCHORED 4u
+
+typedef enum pattern_kind_enum {
+  PATTERN_LITERAL,
+  PATTERN_SUFFIX,
+  PATTERN_GLOB,
+} PatternKind;
+
+typedef enum pattern_match_enum {
+  PATTERN_UNMATCHED,
+  PATTERN_MATCHED,
+  PATTERN_REINCLUDED,
+} PatternMatch;
+
+typedef struct pattern_struct {
+  char *text;
+  size_t length;
+  unsigned flags;
+  PatternKind kind;
+  bool hashed;
+} Pattern;
+
+/*
+ * Patterns in the syntax of .gitignore files. Once compiled, plain names
+ * such as "node_modules" are looked up in a hash table and only the
+ * remaining patterns are matched one by one. As in git, the last pattern
+ * that matches decides the outcome.
+ */
+typedef struct pattern_set_struct {
+  Pattern *patterns;
+  size_t count;
+  size_t capacity;
+  size_t *literal_table;
+  size_t literal_capacity;
+} PatternSet;
+
+/*
+ * The patterns loaded from the ignore files of one directory. Scopes are
+ * shared by all subdirectories below it, and the innermost scope that
+ * matches a path takes precedence.
+ */
+typedef struct ignore_scope_struct {
+  PatternSet patterns;
+  size_t base_length;
+  struct ignore_scope_struct *parent;
+  atomic_size_t references;
+} IgnoreScope;
+
+char *initialize_pattern_set(PatternSet *set);
+
+char *add_pattern(PatternSet *set, const char *pattern, size_t length);
+
+char *load_pattern_file(PatternSet *set, int directory, const char *name);
+
+char *compile_pattern_set(PatternSet *set);
+
+PatternMatch match_pattern_set(const PatternSet *set,
+                               const char *relative_path,
+                               const char *name,
+                               bool is_directory);
+
+void free_pattern_set(PatternSet *set);
+
+bool glob_matches(const char *pattern, size_t pattern_length, const char *text, size_t text_length);
+
+IgnoreScope *create_ignore_scope(IgnoreScope *parent, size_t base_length);
+
+IgnoreScope *acquire_ignore_scope(IgnoreScope *scope);
+
+void release_ignore_scope(IgnoreScope *scope);
+
+bool ignore_scope_excludes(const IgnoreScope *scope, const char *relative_path, const char *name, bool is_directory);
+
+#endif//BUMP_MATCHER_H
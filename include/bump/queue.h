@@ -0,0 +1,36 @@
+#ifndef BUMP_QUEUE_H
+#define BUMP_QUEUE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/*
+ * A bounded queue between exactly one producing and one consuming thread.
+ * Items are passed without locks. A consumer that finds the queue empty
+ * for a while parks on a condition variable instead of spinning, so that a
+ * stage waiting on a slow disk does not burn a processor.
+ */
+typedef struct spsc_queue_struct {
+  void **items;
+  size_t mask;
+  // The consumer owns the head and the producer the tail, each on a cache line of its own.
+  _Alignas(64) atomic_size_t head;
+  _Alignas(64) atomic_size_t tail;
+  _Alignas(64) atomic_int waiting;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} SpscQueue;
+
+char *initialize_queue(SpscQueue *queue, size_t capacity);
+
+// Returns false when the queue is full.
+bool push_queue(SpscQueue *queue, void *item);
+
+// Waits until an item is available.
+void *pop_queue(SpscQueue *queue);
+
+void free_queue(SpscQueue *queue);
+
+#endif//BUMP_QUEUE_H
@@ -0,0 +1,64 @@
+#ifndef BUMP_REPORT_H
+#define BUMP_REPORT_H
+
+#include <bump/bump.h>
+#include <stdio.h>
+
+typedef enum report_format_enum {
+  REPORT_TEXT,
+  REPORT_JSON,
+} ReportFormat;
+
+/*
+ * A version found by a scan. Lines and columns count from one, columns in
+ * bytes. The span refers to the text of the scan, not to the file.
+ */
+typedef struct version_match_struct {
+  size_t offset;
+  size_t line;
+  size_t column;
+  VersionSpan span;
+} VersionMatch;
+
+typedef struct file_scan_struct {
+  VersionMatch *matches;
+  size_t count;
+  size_t capacity;
+  char *text;
+  size_t text_length;
+  size_t text_capacity;
+} FileScan;
+
+char *parse_report_format(const char *name, ReportFormat *format);
+
+char *scan_buffer(const char *data, size_t size, FileScan *scan);
+
+/*
+ * Scans the whole contents of a file, unless they look binary, in which
+ * case binary_file_skipped is returned with an empty scan.
+ */
+char *scan_file_contents(const char *data, size_t size, FileScan *scan);
+
+char *scan_path_at(int directory, const char *path, FileScan *scan);
+
+char *scan_path(const char *path, FileScan *scan);
+
+/*
+ * Writes what a bump would do to one file. The text format has a line per
+ * version for the given level. The JSON format has a line per file, with
+ * the outcome of every level, or with the error if the scan failed.
+ */
+char *write_scan_report(FILE *output,
+                        ReportFormat format,
+                        const char *path,
+                        const char *error,
+                        const FileScan *scan,
+                        BumpLevel level);
+
+void write_json_string(FILE *output, const char *text);
+
+char *copy_file_scan(FileScan *destination, const FileScan *source);
+
+void free_file_scan(FileScan *scan);
+
+#endif//BUMP_REPORT_H
@@ -0,0 +1,41 @@
+#ifndef BUMP_SCAN_H
+#define BUMP_SCAN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Only the start of a file is looked at to tell whether it is binary.
+#define BINARY_SNIFF_SIZE 8192
+
+typedef enum scan_kernel_enum {
+  SCAN_KERNEL_SCALAR,
+  SCAN_KERNEL_SSE2,
+  SCAN_KERNEL_AVX2,
+  SCAN_KERNEL_AVX512,
+} ScanKernel;
+
+/*
+ * Returns the first position in [begin, end) that holds a digit directly
+ * followed by a period, or end if there is none. Every version starts with
+ * a number that ends this way, so anything before it can be copied as is.
+ */
+const char *find_version_candidate(const char *begin, const char *end);
+
+/*
+ * Tells whether the start of a file looks binary rather than like text.
+ * It does when it holds a NUL byte, or when more than one byte in ten is
+ * a control character other than whitespace and escape, or is not part of
+ * valid UTF-8. Only the first BINARY_SNIFF_SIZE bytes are examined.
+ */
+bool looks_binary(const char *data, size_t size);
+
+// Returns the first occurrence of the needle in [begin, end), or end if there is none.
+const char *find_substring(const char *begin, const char *end, const char *needle, size_t length);
+
+ScanKernel detect_scan_kernel(void);
+
+bool select_scan_kernel(ScanKernel kernel);
+
+const char *scan_kernel_name(ScanKernel kernel);
+
+#endif//BUMP_SCAN_H
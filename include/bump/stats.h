@@ -0,0 +1,72 @@
+#ifndef BUMP_STATS_H
+#define BUMP_STATS_H
+
+#include <bump/report.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Scanning and writing are interleaved within every block, so their CPU
+ * time is only measured together, as the process phase. Wall time spent
+ * inside writes is measured separately and taken out of the scan phase.
+ */
+typedef enum stats_phase_enum {
+  PHASE_OPEN,
+  PHASE_SCAN,
+  PHASE_WRITE,
+  PHASE_FINALIZE,
+  PHASE_COUNT,
+} StatsPhase;
+
+typedef struct bump_stats_struct {
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  uint64_t lines;
+  // Digit runs followed by a period, which are the only places a version can start.
+  uint64_t candidates;
+  uint64_t versions;
+  uint64_t files;
+  uint64_t files_unchanged;
+  // Left alone because they look binary.
+  uint64_t files_binary;
+  // Issued directly by the engine, plus one for every block read from a stream.
+  uint64_t system_calls;
+  uint64_t wall_nanoseconds[PHASE_COUNT];
+  uint64_t cpu_nanoseconds[PHASE_COUNT];
+} BumpStats;
+
+typedef struct stats_timer_struct {
+  uint64_t wall;
+  uint64_t cpu;
+  uint64_t written;
+} StatsTimer;
+
+/*
+ * Every thread counts into its own copy, which is folded into the totals
+ * once the thread is done. Counting is always on. Lines and times cost
+ * more to gather, so they are only measured once statistics are enabled.
+ */
+extern _Thread_local BumpStats thread_stats;
+
+extern bool stats_enabled;
+
+void enable_stats(void);
+
+uint64_t read_stats_clock(void);
+
+void add_write_time(uint64_t start);
+
+void start_phase(StatsTimer *timer);
+
+void end_phase(StatsTimer *timer, StatsPhase phase);
+
+size_t count_lines(const char *data, size_t size);
+
+void flush_thread_stats(void);
+
+void collect_stats(BumpStats *total);
+
+char *write_stats(FILE *output, ReportFormat format, const BumpStats *stats, double wall_seconds);
+
+#endif//BUMP_STATS_H
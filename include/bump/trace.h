@@ -0,0 +1,51 @@
+#ifndef BUMP_TRACE_H
+#define BUMP_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Events recorded by a single thread beyond this are dropped and counted.
+#define TRACE_THREAD_CAPACITY 65536
+// Paths are stored inline, keeping their end when they are too long.
+#define TRACE_NAME_LENGTH 48
+
+typedef enum trace_kind_enum {
+  TRACE_FILE,
+  TRACE_OPEN,
+  TRACE_SCAN,
+  TRACE_WRITE,
+  TRACE_COMMIT,
+} TraceKind;
+
+typedef struct trace_event_struct {
+  uint64_t start;
+  uint64_t end;
+  TraceKind kind;
+  char name[TRACE_NAME_LENGTH];
+} TraceEvent;
+
+/*
+ * Every thread records into a buffer of its own, so recording takes no
+ * locks. Buffers are linked into a list when a thread records its first
+ * event, and are only read once every worker has finished.
+ */
+typedef struct trace_buffer_struct {
+  TraceEvent *events;
+  size_t count;
+  size_t dropped;
+  size_t thread;
+  struct trace_buffer_struct *next;
+} TraceBuffer;
+
+extern bool tracing_enabled;
+
+void enable_tracing(void);
+
+void trace_span(TraceKind kind, const char *name, uint64_t start, uint64_t end);
+
+char *write_trace(FILE *output);
+
+void free_trace(void);
+
+#endif//BUMP_TRACE_H
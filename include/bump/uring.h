@@ -0,0 +1,76 @@
+#ifndef BUMP_URING_H
+#define BUMP_URING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Files up to this size are read whole through the ring; larger ones are mapped as usual.
+#define URING_FILE_LIMIT (1024 * 1024)
+// Files open at once across all workers, which bounds the descriptors held by the rings.
+#define URING_IN_FLIGHT 64
+
+/*
+ * Runs of bytes to write over a file that was loaded for writing. The
+ * handler adds them, and the ring writes them once the handler returns,
+ * before it closes the file. The bytes of every patch follow each other.
+ */
+typedef struct file_patch_struct {
+  uint64_t offset;
+  size_t length;
+} FilePatch;
+
+typedef struct patch_list_struct {
+  FilePatch *patches;
+  size_t count;
+  size_t capacity;
+  char *bytes;
+  size_t used;
+  size_t byte_capacity;
+} PatchList;
+
+char *add_file_patch(PatchList *list, uint64_t offset, const char *bytes, size_t length);
+
+/*
+ * A file read through the ring. The data is NULL when the file has to be
+ * handled without the ring, which is the case for files that could not be
+ * opened, that are not regular, that are too large, or that changed size
+ * while they were read. The data is only valid during the handler.
+ */
+typedef struct loaded_file_struct {
+  const char *path;
+  const char *data;
+  size_t size;
+  // When the file was submitted, so that its whole life can be traced.
+  uint64_t started;
+  // Where the handler puts its writes, when the file could be opened for writing.
+  PatchList *patches;
+} LoadedFile;
+
+// Hands out the next file to load, or returns false when there are none left.
+typedef bool (*NextLoadPath)(void *context, size_t *index, const char **path);
+
+typedef void (*HandleLoadedFile)(void *context, size_t index, const LoadedFile *file);
+
+// Reports how the writes of a file went, once they are all done and the file is closed.
+typedef void (*FinishPatchedFile)(void *context, size_t index, char *error);
+
+/*
+ * Opens, inspects, reads and closes files through an io_uring of the
+ * calling thread, keeping up to the given number of files in flight and
+ * submitting the requests for all of them with a single system call. Each
+ * file is handed to the handler as soon as it has been read, while the
+ * others are still in flight. When files are loaded for writing, they are
+ * opened for reading and writing where allowed, and the patches the
+ * handler adds are written through the ring too, after which the finisher
+ * is called. An error is only returned when no ring could be set up,
+ * before any file has been taken.
+ */
+char *load_files(size_t in_flight,
+                 bool writable,
+                 NextLoadPath next,
+                 HandleLoadedFile handle,
+                 FinishPatchedFile finish,
+                 void *context);
+
+#endif//BUMP_URING_H
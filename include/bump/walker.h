@@ -0,0 +1,53 @@
+#ifndef BUMP_WALKER_H
+#define BUMP_WALKER_H
+
+#include <bump/matcher.h>
+#include <bump/report.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct walk_result_struct {
+  char *path;
+  char *error;
+  FileScan scan;
+} WalkResult;
+
+typedef struct walk_state_struct {
+  const char **roots;
+  const char *bump_level;
+  WalkResult *results;
+  struct walk_worker_struct *workers;
+  PatternSet includes;
+  PatternSet excludes;
+  size_t root_count;
+  size_t result_count;
+  size_t file_count;
+  size_t jobs;
+  size_t block_size;
+  // Files are only scanned, and those with versions are added to the results.
+  bool dry_run;
+  // Remembers which files hold versions between runs, when set.
+  struct scan_cache_struct *cache;
+  // Takes the highest version of every file scanned in a dry run, when set.
+  struct highest_version_struct *highest;
+  atomic_size_t pending;
+  // Idle workers sleep until a directory is queued or the walk is over, which bumps the epoch.
+  atomic_size_t epoch;
+  atomic_size_t sleepers;
+  pthread_mutex_t idle_lock;
+  pthread_cond_t work_changed;
+} WalkState;
+
+char *initialize_walk_state(WalkState *state,
+                            const char **roots,
+                            size_t root_count,
+                            const char *bump_level,
+                            size_t jobs,
+                            size_t block_size);
+
+char *process_walk(WalkState *state);
+
+void free_walk_state(WalkState *state);
+
+#endif//BUMP_WALKER_H
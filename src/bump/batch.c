@@ -0,0 +1,231 @@
+#include <bump/batch.h>
+#include <bump/bump.h>
+#include <bump/cache.h>
+#include <bump/lockstep.h>
+#include <bump/stats.h>
+#include <bump/trace.h>
+#include <bump/uring.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+size_t count_online_processors(void) {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count < 1 ? 1 : (size_t) count;
+}
+
+char *initialize_batch_state(BatchState *state,
+                             const char **input_paths,
+                             const size_t count,
+                             const char *output_path,
+                             const char *bump_level,
+                             const size_t jobs,
+                             const size_t block_size) {
+  if (!state) {
+    return "Null pointer received for BatchState";
+  }
+  if (!input_paths || count == 0) {
+    return "No input files provided";
+  }
+  if (output_path && count > 1) {
+    return "An output file can only be used with a single input file";
+  }
+  if (!bump_level) {
+    return "Invalid value received for bump level";
+  }
+  state->results = calloc(count, sizeof(BatchResult));
+  if (!state->results) {
+    return "Could not allocate memory for the batch results";
+  }
+  state->input_paths = input_paths;
+  state->output_path = output_path;
+  state->bump_level = bump_level;
+  state->count = count;
+  state->block_size = block_size;
+  state->dry_run = false;
+  state->cache = NULL;
+  state->io_uring = false;
+  state->highest = NULL;
+
+  // A job count of zero selects one worker per online processor.
+  // There is never any use for more workers than there are files.
+  size_t workers = jobs == 0 ? count_online_processors() : jobs;
+  state->jobs = workers > count ? count : workers;
+  atomic_init(&state->next, 0);
+  atomic_init(&state->workers, 0);
+  return NULL;
+}
+
+/*
+ * Merges a scanned file into the highest version of a lockstep bump,
+ * which needs nothing else from the scan.
+ */
+static char *reduce_scan(BatchState *state, BatchResult *result, char *error) {
+  if (!state->highest) {
+    return error;
+  }
+  if (!error) {
+    error = merge_highest_version(state->highest, &result->scan);
+  }
+  free_file_scan(&result->scan);
+  return error;
+}
+
+static char *process_batch_file(BatchState *state, size_t index) {
+  const char *input_path = state->input_paths[index];
+  const char *output_path = state->output_path ? state->output_path : input_path;
+  BatchResult *result = &state->results[index];
+  result->path = input_path;
+  if (state->dry_run) {
+    char *error = state->cache ? scan_with_cache(state->cache, AT_FDCWD, input_path, input_path, &result->scan)
+                               : scan_path(input_path, &result->scan);
+    return reduce_scan(state, result, error);
+  }
+  // Only in-place bumps are cached, since a separate output is always written.
+  if (state->cache && !state->output_path) {
+    return bump_with_cache(state->cache,
+                           AT_FDCWD,
+                           input_path,
+                           input_path,
+                           state->bump_level,
+                           state->block_size,
+                           &result->changed);
+  }
+  return process_path(input_path, output_path, state->bump_level, state->block_size, &result->changed);
+}
+
+// A file that looks binary is left alone on purpose, which is no failure.
+static void settle_binary(BatchResult *result) {
+  if (result->error == binary_file_skipped) {
+    result->error = NULL;
+    result->binary = true;
+  }
+}
+
+static bool next_batch_path(void *context, size_t *index, const char **path) {
+  BatchState *state = context;
+  *index = atomic_fetch_add(&state->next, 1);
+  if (*index >= state->count) {
+    return false;
+  }
+  *path = state->input_paths[*index];
+  return true;
+}
+
+static void process_loaded_file(void *context, size_t index, const LoadedFile *file) {
+  BatchState *state = context;
+  BatchResult *result = &state->results[index];
+  result->path = file->path;
+  if (!file->data) {
+    result->error = process_batch_file(state, index);
+  } else if (state->dry_run) {
+    thread_stats.files++;
+    result->error = reduce_scan(state, result, scan_file_contents(file->data, file->size, &result->scan));
+  } else {
+    result->error = bump_loaded_file(AT_FDCWD,
+                                     file->path,
+                                     file->data,
+                                     file->size,
+                                     file->patches,
+                                     state->bump_level,
+                                     state->block_size,
+                                     &result->changed);
+  }
+  settle_binary(result);
+  trace_span(TRACE_FILE, file->path, file->started, read_stats_clock());
+}
+
+// The patches of a bumped file were written through the ring.
+static void finish_patched_file(void *context, size_t index, char *error) {
+  BatchState *state = context;
+  BatchResult *result = &state->results[index];
+  if (error && !result->error) {
+    result->error = error;
+    result->changed = false;
+  }
+}
+
+static void *run_batch_worker(void *argument) {
+  BatchState *state = argument;
+  /*
+   * The workers split the in-flight budget, the first ones taking what is
+   * left over, so that it is never exceeded. Workers left without a share,
+   * or without a ring, read their files as usual.
+   */
+  size_t worker = atomic_fetch_add(&state->workers, 1);
+  size_t in_flight = URING_IN_FLIGHT / state->jobs + (worker < URING_IN_FLIGHT % state->jobs);
+  if (state->io_uring && !state->output_path && !state->cache && in_flight > 0) {
+    if (load_files(in_flight, !state->dry_run, next_batch_path, process_loaded_file, finish_patched_file, state) ==
+        NULL) {
+      flush_thread_stats();
+      return NULL;
+    }
+  }
+  while (true) {
+    // Files are handed out one at a time so that a few large files
+    // cannot leave the remaining workers idle.
+    size_t index = atomic_fetch_add(&state->next, 1);
+    if (index >= state->count) {
+      break;
+    }
+    uint64_t started = read_stats_clock();
+    state->results[index].error = process_batch_file(state, index);
+    settle_binary(&state->results[index]);
+    trace_span(TRACE_FILE, state->input_paths[index], started, read_stats_clock());
+  }
+  flush_thread_stats();
+  return NULL;
+}
+
+char *process_batch(BatchState *state) {
+  if (!state || !state->results) {
+    return "Batch state is not initialized";
+  }
+
+  // The calling thread acts as one of the workers.
+  size_t extra_workers = state->jobs - 1;
+  pthread_t *threads = NULL;
+  if (extra_workers > 0) {
+    threads = malloc(extra_workers * sizeof(pthread_t));
+    if (!threads) {
+      extra_workers = 0;
+    }
+  }
+  size_t started = 0;
+  for (; started < extra_workers; started++) {
+    if (pthread_create(&threads[started], NULL, run_batch_worker, state)) {
+      // Carry on with the workers we have; the queue still drains.
+      break;
+    }
+  }
+
+  run_batch_worker(state);
+
+  for (size_t index = 0; index < started; index++) {
+    pthread_join(threads[index], NULL);
+  }
+  free(threads);
+  return NULL;
+}
+
+size_t count_batch_failures(const BatchState *state) {
+  size_t failures = 0;
+  for (size_t index = 0; index < state->count; index++) {
+    if (state->results[index].error) {
+      failures++;
+    }
+  }
+  return failures;
+}
+
+void free_batch_state(BatchState *state) {
+  if (!state) {
+    return;
+  }
+  for (size_t index = 0; state->results && index < state->count; index++) {
+    free_file_scan(&state->results[index].scan);
+  }
+  free(state->results);
+  state->results = NULL;
+}
@@ -1,12 +1,50 @@
 #include <bump/bump.h>
 #include <bump/fileutil.h>
-#include <ctype.h>
+#include <bump/queue.h>
+#include <bump/report.h>
+#include <bump/scan.h>
+#include <bump/stats.h>
+#include <bump/uring.h>
 #include <errno.h>
-#include <inttypes.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Room for a typical unsettled "x.y.z" at the end of a block; longer ones grow the buffer.
+#define CARRY_CAPACITY 64
+#define MINIMUM_BLOCK_SIZE (4 * CARRY_CAPACITY)
+// Large files are split into chunks of about this size, cut where no version can straddle.
+#define SPLIT_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Only set before any file is processed, which makes them visible to every worker.
+static size_t split_threshold = 0;
+static size_t split_jobs = 1;
+// Helper threads busy with chunks across all files, so that parallel files do not multiply them.
+static atomic_size_t split_helpers;
+// Buffers circulating between the stages of a pipelined file; two would be plain double buffering.
+#define PIPELINE_DEPTH 4
+
+static bool pipeline_enabled = false;
+
+// Long enough for three components of twenty digits each.
+#define TARGET_CAPACITY 64
+
+static char target_version[TARGET_CAPACITY];
+static size_t target_length = 0;
+// When set, only exact copies of this version are bumped.
+static char source_version[TARGET_CAPACITY];
+static size_t source_length = 0;
+
+static bool binary_detection = true;
+
+char binary_file_skipped[] = "The file looks binary and was skipped.";
 
 char *initialize_version(Version *version, const size_t major, const size_t minor, const size_t patch) {
   if (!version) {
@@ -63,6 +101,23 @@ char *bump_patch(Version *version) {
   version->patch++;
   return NULL;
 }
+/*
+ * Writes the decimal digits of a value and returns how many were written.
+ * The output is not terminated.
+ */
+static size_t format_decimal(size_t value, char *output) {
+  char digits[3 * sizeof(size_t)];
+  size_t count = 0;
+  do {
+    digits[count++] = (char) ('0' + value % 10);
+    value /= 10;
+  } while (value);
+  for (size_t index = 0; index < count; index++) {
+    output[index] = digits[count - index - 1];
+  }
+  return count;
+}
+
 char *convert_to_string(Version *version, char *output_buffer, size_t *length) {
   if (!version) {
     return "Empty version pointer value.";
@@ -70,16 +125,31 @@ char *convert_to_string(Version *version, char *output_buffer, size_t *length) {
   if (!output_buffer) {
     return "Empty output buffer pointer.";
   }
-  *length = 0;
-  int count = sprintf(output_buffer,
-                      "%" PRIuMAX ".%" PRIuMAX ".%" PRIuMAX "",
-                      version->major,
-                      version->minor,
-                      version->patch);
-  if (count < 0) {
-    return "Error occurred while trying to write to string buffer.";
+  size_t count = format_decimal(version->major, output_buffer);
+  output_buffer[count++] = '.';
+  count += format_decimal(version->minor, output_buffer + count);
+  output_buffer[count++] = '.';
+  count += format_decimal(version->patch, output_buffer + count);
+  output_buffer[count] = '\0';
+  *length = count;
+  return NULL;
+}
+
+char *parse_bump_level(const char *name, BumpLevel *level) {
+  if (!name) {
+    return "Empty bump level received.";
+  }
+  if (strcmp(name, "major") == 0) {
+    *level = BUMP_MAJOR;
+  } else if (strcmp(name, "minor") == 0) {
+    *level = BUMP_MINOR;
+  } else if (strcmp(name, "patch") == 0) {
+    *level = BUMP_PATCH;
+  } else if (strcmp(name, BUMP_TARGET_LEVEL) == 0 && target_length > 0) {
+    *level = BUMP_TARGET;
+  } else {
+    return "Invalid bump level";
   }
-  *length = (size_t) count;
   return NULL;
 }
 
@@ -97,183 +167,257 @@ char *initialize_line_state(LineState *state, const char *input, char *output, c
   state->output = output;
   state->input_index = 0;
   state->output_index = 0;
+  state->versions = 0;
   // The minimum length needed for a version string is 5.
   // If we have a string length limit smaller than that, we clamp the limit to 0.
   state->limit = limit < 5 ? 0 : limit;
   return NULL;
 }
 
-static void keep_going(LineState *state) {
-  if (state->input_index == state->limit) {
-    return;
-  }
-  state->output[state->output_index] = state->input[state->input_index];
-  state->input_index++;
-  state->output_index++;
+static bool is_digit(char c) {
+  return c >= '0' && c <= '9';
 }
 
-static ssize_t extract_decimal_number(LineState *state) {
-  char *end;
-  ssize_t value = (size_t) strtoul(state->input + state->input_index, &end, 10);
-  if (errno == ERANGE) {
-    // The number exceeded the supported range. Print it out verbatim
-    while (state->input + state->input_index != end) {
-      keep_going(state);
+bool find_version(const char *input, size_t from, size_t limit, VersionSpan *span) {
+  size_t index = from;
+  while (index < limit) {
+    // Only a number followed by a period can start a version, so everything before one is skipped in bulk.
+    const char *candidate = find_version_candidate(input + index, input + limit);
+    if (candidate == input + limit) {
+      return false;
+    }
+    thread_stats.candidates++;
+    // The kernel stops at the last digit, so back up to the start of the number.
+    size_t position = (size_t) (candidate - input);
+    while (position > index && is_digit(input[position - 1])) {
+      position--;
     }
-    // Reset the error number because we have handled it
-    errno = 0;
-    return -1;
-  } else {
-    state->input_index = end - state->input;
-  }
-  return value;
-}
 
-char *process_line(LineState *state, const char *bump_level) {
-  if (!state) {
-    return "Null value received for state";
-  }
-  if (state->limit == 0 || state->input_index == state->limit) {
-    return NULL;
-  }
-  char *error;
-  while (state->input_index < state->limit) {
-    char c = state->input[state->input_index];
-    ssize_t result;
-    if (isdigit(c)) {
-      errno = 0;
-      // Start a greedy search for the pattern of "x.y.z" where x, y, and z are decimal numbers
-      result = extract_decimal_number(state);
-      if (result == -1) {
-        continue;
+    // Start a greedy search for the pattern of "x.y.z" where x, y, and z are decimal numbers
+    size_t count = 0;
+    while (count < 3) {
+      span->starts[count] = position;
+      while (position < limit && is_digit(input[position])) {
+        position++;
       }
-      size_t major = (size_t) result;
-      c = state->input[state->input_index];
-
-      if (c != '.') {
-        // We have a normal number. Dump it to the output and proceed normally.
-        int chars_printed = sprintf(state->output + state->output_index, "%" PRIuMAX "", major);
-        if (chars_printed < 1) {
-          return "Error occurred while trying to write to output buffer";
-        }
-        state->output_index += chars_printed;
-        keep_going(state);
-        continue;
+      span->ends[count] = position;
+      count++;
+      if (count == 3 || position == limit || input[position] != '.') {
+        break;
       }
-      state->input_index++;
-      if (state->input_index == state->limit) {
-        return NULL;
+      position++;
+      if (position == limit || !is_digit(input[position])) {
+        break;
       }
-      c = state->input[state->input_index];
+    }
 
-      if (!isdigit(c)) {
-        // We have a x. followed by a non-digit
-        int chars_printed = sprintf(state->output + state->output_index, "%" PRIuMAX ".", major);
-        if (chars_printed < 1) {
-          return "Error occurred while trying to write to output buffer";
-        }
-        state->output_index += chars_printed;
-        keep_going(state);
-        continue;
+    if (count == 3) {
+      if (position == limit || input[position] != '.') {
+        return true;
       }
+      // We have x.y.z. which is invalid. Scanning resumes after the period.
+      position++;
+    }
+    index = position;
+  }
+  return false;
+}
 
-      result = extract_decimal_number(state);
-      if (result == -1) {
-        continue;
-      }
-      size_t minor = (size_t) result;
-      if (state->input_index == state->limit) {
-        return NULL;
-      }
-      c = state->input[state->input_index];
+bool contains_version(const char *input, size_t length) {
+  VersionSpan span;
+  return find_version(input, 0, length, &span);
+}
 
+static bool is_version_character(char c) {
+  return is_digit(c) || c == '.';
+}
 
-      if (c != '.') {
-        // We have an input of the form x.y only. No period follows the y
-        int chars_printed = sprintf(state->output + state->output_index, "%" PRIuMAX ".%" PRIuMAX "", major, minor);
-        if (chars_printed < 1) {
-          return "Error occurred while trying to write to output buffer";
-        }
-        state->output_index += chars_printed;
-        keep_going(state);
-        continue;
-      }
-      state->input_index++;
-      c = state->input[state->input_index];
-
-      if (!isdigit(c)) {
-        // We have a x.y. followed by a non-digit
-        int chars_printed = sprintf(state->output + state->output_index, "%" PRIuMAX ".%" PRIuMAX ".", major, minor);
-        if (chars_printed < 1) {
-          return "Error occurred while trying to write to output buffer";
-        }
-        state->output_index += chars_printed;
-        keep_going(state);
-        continue;
+/*
+ * Finds the next exact copy of the source version. Each occurrence of its
+ * text is only a candidate: the run of digits and periods around it is
+ * scanned the way the whole file would be, so that the "1.4.2" inside
+ * "11.4.2" or "1.4.2.0" is not taken for a version of its own.
+ */
+static bool find_source_version(const char *input, size_t from, size_t limit, VersionSpan *span) {
+  size_t position = from;
+  while (position < limit) {
+    size_t hit = (size_t) (find_substring(input + position, input + limit, source_version, source_length) - input);
+    if (hit == limit) {
+      return false;
+    }
+    size_t run_start = hit;
+    while (run_start > position && is_version_character(input[run_start - 1])) {
+      run_start--;
+    }
+    size_t run_end = hit + source_length;
+    while (run_end < limit && is_version_character(input[run_end])) {
+      run_end++;
+    }
+    // The run is followed by a character that cannot continue a version, so it can be scanned on its own.
+    VersionSpan found;
+    for (size_t next = run_start; find_version(input, next, run_end, &found); next = found.ends[2]) {
+      if (found.ends[2] - found.starts[0] == source_length &&
+          memcmp(input + found.starts[0], source_version, source_length) == 0) {
+        *span = found;
+        return true;
       }
+    }
+    position = run_end;
+  }
+  return false;
+}
 
-      result = extract_decimal_number(state);
-      if (result == -1) {
-        continue;
-      }
-      size_t patch = (size_t) result;
-      c = state->input[state->input_index];
-
-      if (c == '.') {
-        // We have x.y.z. which is invalid.
-        int chars_printed = sprintf(state->output + state->output_index, "%" PRIuMAX ".%" PRIuMAX ".%" PRIuMAX "", major, minor, patch);
-        if (chars_printed < 1) {
-          return "Error occurred while trying to write to output buffer";
-        }
-        state->output_index += chars_printed;
-        keep_going(state);
-        continue;
-      }
+bool find_next_version(const char *input, size_t from, size_t limit, VersionSpan *span) {
+  return source_length > 0 ? find_source_version(input, from, limit, span) : find_version(input, from, limit, span);
+}
 
-      // We now have all three numbers.
+/*
+ * Writes the decimal text plus one, carrying through trailing nines, and
+ * returns the length written. Numbers of any length are supported, and
+ * leading zeros are kept.
+ */
+static size_t increment_decimal(const char *digits, size_t length, char *output) {
+  size_t nines = 0;
+  while (nines < length && digits[length - nines - 1] == '9') {
+    nines++;
+  }
+  if (nines == length) {
+    output[0] = '1';
+    memset(output + 1, '0', length);
+    return length + 1;
+  }
+  size_t kept = length - nines - 1;
+  memcpy(output, digits, kept);
+  output[kept] = (char) (digits[kept] + 1);
+  memset(output + kept + 1, '0', nines);
+  return length;
+}
 
-      Version version = {0};
-      error = initialize_version(&version, major, minor, patch);
-      if (error) {
-        return error;
-      }
+size_t format_bumped_version(const char *input, const VersionSpan *span, BumpLevel level, char *output) {
+  if (level == BUMP_TARGET) {
+    memcpy(output, target_version, target_length);
+    return target_length;
+  }
+  size_t component = level == BUMP_MAJOR ? 0 : level == BUMP_MINOR ? 1 : 2;
+  size_t length = span->starts[component] - span->starts[0];
+  memcpy(output, input + span->starts[0], length);
+  length += increment_decimal(input + span->starts[component],
+                              span->ends[component] - span->starts[component],
+                              output + length);
+  // Everything below the bumped component becomes zero.
+  memcpy(output + length, ".0.0", 2 * (2 - component));
+  return length + 2 * (2 - component);
+}
 
-      if (strcmp(bump_level, "major") == 0) {
-        bump_major(&version);
-      } else if (strcmp(bump_level, "minor") == 0) {
-        bump_minor(&version);
-      } else if (strcmp(bump_level, "patch") == 0) {
-        bump_patch(&version);
-      } else {
-        return "Invalid bump level";
-      }
+size_t bumped_length_limit(size_t length) {
+  return length + 1 > target_length ? length + 1 : target_length;
+}
 
-      size_t version_len;
-      error = convert_to_string(&version, state->output + state->output_index, &version_len);
-      state->output_index += version_len;
+/*
+ * Bounds the output for a piece of input. A version takes at least five
+ * characters, and a bump grows it by at most one or up to the target.
+ */
+static size_t bumped_capacity(size_t length) {
+  size_t growth = target_length > 6 ? target_length - 5 : 1;
+  return length + (length / 5 + 1) * growth + 1;
+}
 
-      if (error) {
-        return error;
-      }
+/*
+ * Copies the input up to the next version and writes the bumped version in
+ * its place, leaving the input index just past it. Chains of numbers that
+ * are not versions, such as "1.2" or "1.2.3.", are copied as they are. The
+ * found flag is cleared when the limit is reached without a version.
+ */
+static void bump_next_version(LineState *state, BumpLevel level, bool *found) {
+  VersionSpan span;
+  *found = find_next_version(state->input, state->input_index, state->limit, &span);
+  size_t end = *found ? span.starts[0] : state->limit;
+  memcpy(state->output + state->output_index, state->input + state->input_index, end - state->input_index);
+  state->output_index += end - state->input_index;
+  state->input_index = end;
+  if (*found) {
+    state->output_index += format_bumped_version(state->input, &span, level, state->output + state->output_index);
+    state->input_index = span.ends[2];
+    state->versions++;
+  }
+}
 
-      if (state->input_index < state->limit) {
-        strcpy(state->output + state->output_index, state->input + state->input_index);
-      }
+char *process_line(LineState *state, const char *bump_level) {
+  if (!state) {
+    return "Null value received for state";
+  }
+  if (state->limit == 0 || state->input_index == state->limit) {
+    return NULL;
+  }
+  BumpLevel level;
+  char *error = parse_bump_level(bump_level, &level);
+  if (error) {
+    return error;
+  }
+  bool found;
+  bump_next_version(state, level, &found);
+  if (found) {
+    // The input may not be terminated, so the copy is bounded by the limit.
+    size_t remaining = state->limit - state->input_index;
+    size_t tail = strnlen(state->input + state->input_index, remaining);
+    memcpy(state->output + state->output_index, state->input + state->input_index, tail);
+    state->output[state->output_index + tail] = '\0';
+  }
+  return NULL;
+}
 
-      // We are done so we exit early
-      return NULL;
-    } else {
-      keep_going(state);
+char *process_versions(LineState *state, const char *bump_level) {
+  if (!state) {
+    return "Null value received for state";
+  }
+  BumpLevel level;
+  char *error = parse_bump_level(bump_level, &level);
+  if (error) {
+    return error;
+  }
+  bool found = true;
+  while (found) {
+    bump_next_version(state, level, &found);
+  }
+  return NULL;
+}
+
+// Opens a stream over a replacement file, on a descriptor of its own that stays open until it is committed.
+static FILE *open_replacement_stream(const ReplacementFile *replacement) {
+  int descriptor = dup(replacement->descriptor);
+  thread_stats.system_calls++;
+  FILE *output = descriptor == -1 ? NULL : fdopen(descriptor, "w");
+  if (!output && descriptor != -1) {
+    close(descriptor);
+  }
+  return output;
+}
+
+/*
+ * Completes a file state whose input is already open. Both streams are
+ * closed if the state cannot be used.
+ */
+static char *attach_output(FileState *state, FILE *output, const char *bump_level, size_t block_size) {
+  if (block_size < MINIMUM_BLOCK_SIZE) {
+    if (state->input) {
+      fclose(state->input);
     }
+    fclose(output);
+    return "The block size is too small";
   }
+  state->output = output;
+  state->bump_level = bump_level;
+  state->block_size = block_size;
+  state->versions = 0;
   return NULL;
 }
 
-char *initialize_file_state(FileState *state,
-                            const char *input_path,
-                            const char *output_path,
-                            const char *bump_level,
-                            const size_t limit) {
+char *initialize_file_state_at(FileState *state,
+                               int directory,
+                               const char *input_path,
+                               const char *output_path,
+                               const char *bump_level,
+                               const size_t block_size) {
   if (!state) {
     return "Null pointer received for FileState";
   }
@@ -286,98 +430,1421 @@ char *initialize_file_state(FileState *state,
   if (!bump_level) {
     return "Invalid value received for bump level";
   }
-  if (!file_is_valid(input_path, "r")) {
-    return "Cannot open input file for reading";
-  }
-  if (!file_is_valid(output_path, "w")) {
-    return "Cannot open output file for writing";
-  }
-  state->input = fopen(input_path, "r");
+  StatsTimer timer;
+  start_phase(&timer);
+  state->replacement = NULL;
+  state->input = open_file_at(directory, input_path, "r");
   if (!state->input) {
     return "Could open input stream";
   }
-  state->output = fopen(output_path, "w");
-  if (!state->output) {
-    return "Could open output stream";
+  // The output is not truncated up front, but replaced once everything has been bumped.
+  ReplacementFile *replacement = malloc(sizeof(ReplacementFile));
+  char *error = replacement ? open_output_file(directory, output_path, INTERMEDIATE_SUFFIX, replacement)
+                            : "Could not allocate memory for the output file.";
+  FILE *output = error ? NULL : open_replacement_stream(replacement);
+  end_phase(&timer, PHASE_OPEN);
+  if (!output) {
+    if (!error) {
+      discard_replacement_file(replacement);
+    }
+    free(replacement);
+    fclose(state->input);
+    return error ? error : "Could open output stream";
   }
-  state->bump_level = bump_level;
-  state->limit = limit;
+  error = attach_output(state, output, bump_level, block_size);
+  if (error) {
+    discard_replacement_file(replacement);
+    free(replacement);
+    return error;
+  }
+  state->replacement = replacement;
   return NULL;
 }
 
+char *initialize_file_state(FileState *state,
+                            const char *input_path,
+                            const char *output_path,
+                            const char *bump_level,
+                            const size_t block_size) {
+  return initialize_file_state_at(state, AT_FDCWD, input_path, output_path, bump_level, block_size);
+}
+
+// The input is missing when its contents were read by other means, such as through the ring.
 static char *close_streams(FileState *state) {
-  int error_code = fclose(state->input);
-  if (error_code) {
+  int input_code = state->input ? fclose(state->input) : 0;
+  int output_code = fclose(state->output);
+  thread_stats.system_calls += 1 + (state->input != NULL);
+  if (input_code) {
     return "Could not close input stream successfully. fclose failed.";
   }
-  error_code = fclose(state->output);
-  if (error_code) {
+  if (output_code) {
     return "Could not close output stream successfully. fclose failed.";
   }
   return NULL;
 }
 
-char *process_file(FileState *state) {
-  if (!state) {
-    return "File state is null";
+static char *write_bytes(FILE *output, const char *bytes, size_t length) {
+  if (length == 0) {
+    return NULL;
   }
+  uint64_t start = read_stats_clock();
+  size_t written = fwrite(bytes, 1, length, output);
+  add_write_time(start);
+  thread_stats.bytes_written += written;
+  if (written != length) {
+    return "An I/O error occurred while trying to write to the output file.";
+  }
+  return NULL;
+}
 
-  char input_buffer[state->limit + 1];
-  char output_buffer[state->limit + 1];
-  size_t len;
-  bool keep_going = true;
+static bool may_contain_version(const char *line, size_t length) {
+  // The shortest version is "x.y.z", and every version starts with a digit and a period.
+  return length >= 5 && find_version_candidate(line, line + length) != line + length;
+}
 
-  while (1) {
-    char *error;
+/*
+ * Carried along from one block of a file to the next. The output buffer is
+ * reused for every block, so memory use does not depend on the line lengths.
+ */
+typedef struct block_state_struct {
+  char *output;
+  size_t capacity;
+} BlockState;
 
-    error = read_line(state->input, input_buffer, &len, state->limit);
-    if (error) {
-      keep_going = false;
+// Bump every version in a piece of a line and write the result.
+static char *write_processed_line(FileState *state,
+                                  BlockState *block,
+                                  const char *line,
+                                  size_t length) {
+  if (!may_contain_version(line, length)) {
+    return write_bytes(state->output, line, length);
+  }
+
+  size_t needed = bumped_capacity(length);
+  if (needed > block->capacity) {
+    char *resized = realloc(block->output, needed);
+    if (!resized) {
+      return "Could not allocate memory for the output buffer.";
     }
+    block->output = resized;
+    block->capacity = needed;
+  }
 
-    memset(output_buffer, 0, state->limit);
-    LineState line_state = {0};
-    error = initialize_line_state(&line_state, input_buffer, output_buffer, state->limit);
-    if (error) {
+  LineState line_state = {0};
+  char *error = initialize_line_state(&line_state, line, block->output, length);
+  if (error) {
+    return error;
+  }
+  error = process_versions(&line_state, state->bump_level);
+  if (error) {
+    return error;
+  }
+  state->versions += line_state.versions;
+  return write_bytes(state->output, block->output, line_state.output_index);
+}
+
+/*
+ * Scan a region that starts and ends where no version can be cut in two.
+ * Lines that cannot hold a version are never copied; they are written out
+ * straight from the input in runs that span as many lines as possible.
+ */
+static char *process_region(FileState *state, BlockState *block, const char *data, size_t size) {
+  size_t pending = 0;
+  size_t start = 0;
+  char *error = NULL;
+  if (stats_enabled) {
+    thread_stats.lines += count_lines(data, size);
+  }
+
+  while (start < size && !error) {
+    // Jump straight to the next possible version; the lines in between are written as they are.
+    // A source version is looked for directly, and only lines that hold its text are examined.
+    const char *candidate = source_length > 0 ? find_substring(data + start, data + size, source_version, source_length)
+                                              : find_version_candidate(data + start, data + size);
+    if (candidate == data + size) {
+      break;
+    }
+    size_t line_start = (size_t) (candidate - data);
+    while (line_start > start && data[line_start - 1] != '\n') {
+      line_start--;
+    }
+    const char *newline = memchr(candidate, '\n', size - (size_t) (candidate - data));
+    size_t end = newline ? (size_t) (newline - data) : size;
+    error = write_bytes(state->output, data + pending, line_start - pending);
+    if (!error) {
+      error = write_processed_line(state, block, data + line_start, end - line_start);
+    }
+    pending = end;
+    start = end + 1;
+  }
+  if (!error) {
+    error = write_bytes(state->output, data + pending, size - pending);
+  }
+  return error;
+}
+
+/*
+ * Follows process_line() over a run of digits and periods that reaches the
+ * end of a block, and returns the offset of the last point where the scanner
+ * starts afresh. Everything before it is settled; everything after it could
+ * still become a version once more input arrives. That part holds at most
+ * three components, although each of them may be arbitrarily long.
+ */
+static size_t find_restart_point(const char *run, size_t length) {
+  size_t index = 0;
+  while (index < length) {
+    if (run[index] == '.') {
+      index++;
+      continue;
+    }
+    size_t start = index;
+    size_t components = 0;
+    while (true) {
+      while (index < length && is_digit(run[index])) {
+        index++;
+      }
+      if (index == length) {
+        return start;
+      }
+      // The number is followed by a period, since the run has nothing else.
+      components++;
+      index++;
+      if (components == 3) {
+        // x.y.z. is not a version; the scanner restarts after the period.
+        break;
+      }
+      if (index == length) {
+        return start;
+      }
+      if (!is_digit(run[index])) {
+        // A period follows a period; the scanner restarts after both.
+        index++;
+        break;
+      }
+    }
+  }
+  return length;
+}
+
+/*
+ * Scan one block of input and report how much of it was consumed. Unless
+ * this is the final block, a trailing run of digits and periods that could
+ * still become a version is left unconsumed, and must be presented again at
+ * the start of the next block.
+ */
+static char *process_block(FileState *state,
+                           BlockState *block,
+                           const char *data,
+                           size_t length,
+                           bool final,
+                           size_t *consumed) {
+  size_t end = length;
+  if (!final) {
+    size_t run = length;
+    while (run > 0 && is_version_character(data[run - 1])) {
+      run--;
+    }
+    end = run + find_restart_point(data + run, length - run);
+  }
+  *consumed = end;
+  return process_region(state, block, data, end);
+}
+
+void configure_split(size_t threshold, size_t jobs) {
+  split_threshold = threshold;
+  split_jobs = jobs == 0 ? 1 : jobs;
+}
+
+/*
+ * A bumped chunk waiting to be written. Every chunk goes to the slot of its
+ * index modulo the slot count, which bounds the memory held by finished
+ * chunks that are not written yet.
+ */
+typedef struct chunk_slot_struct {
+  char *output;
+  size_t capacity;
+  size_t length;
+  size_t versions;
+  char *error;
+  bool done;
+} ChunkSlot;
+
+typedef struct chunk_pipeline_struct {
+  const FileState *state;
+  const MappedFile *mapping;
+  size_t chunk_count;
+  ChunkSlot *slots;
+  size_t slot_count;
+  // Chunks handed out to helpers, and chunks written in order by the calling thread.
+  size_t next;
+  size_t written;
+  bool stopped;
+  pthread_mutex_t lock;
+  pthread_cond_t chunk_done;
+  pthread_cond_t slot_free;
+} ChunkPipeline;
+
+/*
+ * Chunks start just before a character that is not a digit or a period. No
+ * version runs across such a point, and the scanner starts afresh at it, so
+ * every chunk bumps exactly as it would within the whole file.
+ */
+static size_t find_split_point(const MappedFile *mapping, size_t chunk) {
+  if (chunk == 0) {
+    return 0;
+  }
+  size_t position = chunk * SPLIT_CHUNK_SIZE;
+  while (position < mapping->size && is_version_character(mapping->data[position])) {
+    position++;
+  }
+  return position < mapping->size ? position : mapping->size;
+}
+
+/*
+ * Opens a stream over a buffer with room for the bumped form of the given
+ * number of input bytes, growing the buffer when it is too small.
+ */
+static FILE *open_bumped_buffer(char **buffer, size_t *capacity, size_t length) {
+  size_t needed = bumped_capacity(length);
+  if (needed > *capacity) {
+    char *resized = realloc(*buffer, needed);
+    if (!resized) {
+      return NULL;
+    }
+    *buffer = resized;
+    *capacity = needed;
+  }
+  return fmemopen(*buffer, *capacity, "w");
+}
+
+static char *bump_chunk(const ChunkPipeline *pipeline, BlockState *block, size_t chunk, ChunkSlot *slot) {
+  size_t start = find_split_point(pipeline->mapping, chunk);
+  size_t end = find_split_point(pipeline->mapping, chunk + 1);
+  slot->length = 0;
+  slot->versions = 0;
+  if (end <= start) {
+    return NULL;
+  }
+  FILE *memory = open_bumped_buffer(&slot->output, &slot->capacity, end - start);
+  if (!memory) {
+    return "Could not allocate memory for a chunk of the output.";
+  }
+  FileState chunk_state = *pipeline->state;
+  chunk_state.output = memory;
+  chunk_state.versions = 0;
+  char *error = process_region(&chunk_state, block, pipeline->mapping->data + start, end - start);
+  long length = ftell(memory);
+  fclose(memory);
+  if (!error && length < 0) {
+    error = "Could not bump a chunk of the file.";
+  }
+  slot->length = error ? 0 : (size_t) length;
+  slot->versions = chunk_state.versions;
+  return error;
+}
+
+static void *run_chunk_helper(void *argument) {
+  ChunkPipeline *pipeline = argument;
+  BlockState block = {0};
+  pthread_mutex_lock(&pipeline->lock);
+  while (!pipeline->stopped && pipeline->next < pipeline->chunk_count) {
+    size_t chunk = pipeline->next;
+    if (chunk >= pipeline->written + pipeline->slot_count) {
+      // The slot still holds a chunk that has not been written.
+      pthread_cond_wait(&pipeline->slot_free, &pipeline->lock);
+      continue;
+    }
+    pipeline->next++;
+    pthread_mutex_unlock(&pipeline->lock);
+
+    ChunkSlot *slot = &pipeline->slots[chunk % pipeline->slot_count];
+    slot->error = bump_chunk(pipeline, &block, chunk, slot);
+
+    pthread_mutex_lock(&pipeline->lock);
+    slot->done = true;
+    pthread_cond_broadcast(&pipeline->chunk_done);
+  }
+  pthread_mutex_unlock(&pipeline->lock);
+  free(block.output);
+  flush_thread_stats();
+  return NULL;
+}
+
+// Takes up to the wanted number of helper threads out of the shared budget.
+static size_t reserve_split_helpers(size_t wanted) {
+  size_t busy = atomic_load(&split_helpers);
+  while (true) {
+    size_t available = busy < split_jobs ? split_jobs - busy : 0;
+    size_t taken = wanted < available ? wanted : available;
+    if (taken == 0 || atomic_compare_exchange_weak(&split_helpers, &busy, busy + taken)) {
+      return taken;
+    }
+  }
+}
+
+/*
+ * Bumps the chunks of a large mapped file on helper threads, while the
+ * calling thread writes the finished chunks out in their original order.
+ * Nothing is done when fewer than two helpers are free, which is reported
+ * through the split flag.
+ */
+static char *process_split_mapping(FileState *state, const MappedFile *mapping, bool *split) {
+  *split = false;
+  size_t chunk_count = (mapping->size + SPLIT_CHUNK_SIZE - 1) / SPLIT_CHUNK_SIZE;
+  size_t helpers = reserve_split_helpers(chunk_count < split_jobs ? chunk_count : split_jobs);
+  pthread_t *threads = NULL;
+  ChunkPipeline pipeline = {0};
+  if (helpers >= 2) {
+    threads = malloc(helpers * sizeof(pthread_t));
+    pipeline.slot_count = 2 * helpers;
+    pipeline.slots = calloc(pipeline.slot_count, sizeof(ChunkSlot));
+  }
+  if (!threads || !pipeline.slots) {
+    free(threads);
+    free(pipeline.slots);
+    atomic_fetch_sub(&split_helpers, helpers);
+    return NULL;
+  }
+  pipeline.state = state;
+  pipeline.mapping = mapping;
+  pipeline.chunk_count = chunk_count;
+  pthread_mutex_init(&pipeline.lock, NULL);
+  pthread_cond_init(&pipeline.chunk_done, NULL);
+  pthread_cond_init(&pipeline.slot_free, NULL);
+
+  size_t started = 0;
+  for (; started < helpers; started++) {
+    if (pthread_create(&threads[started], NULL, run_chunk_helper, &pipeline)) {
+      break;
+    }
+  }
+  // Without any helper the file is left to the usual single-threaded pass.
+  *split = started > 0;
+
+  char *error = NULL;
+  for (size_t chunk = 0; *split && chunk < chunk_count && !error; chunk++) {
+    ChunkSlot *slot = &pipeline.slots[chunk % pipeline.slot_count];
+    pthread_mutex_lock(&pipeline.lock);
+    while (!slot->done) {
+      pthread_cond_wait(&pipeline.chunk_done, &pipeline.lock);
+    }
+    pthread_mutex_unlock(&pipeline.lock);
+
+    error = slot->error;
+    if (!error && slot->length > 0) {
+      // The bytes were already counted by the helper that bumped the chunk.
+      uint64_t start = read_stats_clock();
+      size_t written = fwrite(slot->output, 1, slot->length, state->output);
+      add_write_time(start);
+      if (written != slot->length) {
+        error = "An I/O error occurred while trying to write to the output file.";
+      }
+    }
+    state->versions += slot->versions;
+
+    pthread_mutex_lock(&pipeline.lock);
+    slot->done = false;
+    pipeline.written++;
+    pthread_cond_broadcast(&pipeline.slot_free);
+    pthread_mutex_unlock(&pipeline.lock);
+  }
+
+  pthread_mutex_lock(&pipeline.lock);
+  pipeline.stopped = true;
+  pthread_cond_broadcast(&pipeline.slot_free);
+  pthread_mutex_unlock(&pipeline.lock);
+  for (size_t index = 0; index < started; index++) {
+    pthread_join(threads[index], NULL);
+  }
+  atomic_fetch_sub(&split_helpers, helpers);
+  for (size_t index = 0; index < pipeline.slot_count; index++) {
+    free(pipeline.slots[index].output);
+  }
+  free(pipeline.slots);
+  free(threads);
+  pthread_cond_destroy(&pipeline.slot_free);
+  pthread_cond_destroy(&pipeline.chunk_done);
+  pthread_mutex_destroy(&pipeline.lock);
+  return error;
+}
+
+/*
+ * The scanner works directly on the mapped bytes, one block at a time.
+ * Carried-over bytes are simply presented again, as the mapping is contiguous.
+ */
+static char *process_mapping(FileState *state, const MappedFile *mapping) {
+  if (split_threshold > 0 && split_jobs > 1 && mapping->size >= split_threshold) {
+    bool split;
+    char *error = process_split_mapping(state, mapping, &split);
+    if (split) {
       return error;
     }
+  }
+  BlockState block = {0};
+  char *error = NULL;
+  size_t position = 0;
+  size_t carried = 0;
 
-    while (line_state.input_index < len) {
-      error = process_line(&line_state, state->bump_level);
-      if (error) {
-        return error;
+  while (position < mapping->size && !error) {
+    size_t remaining = mapping->size - position;
+    bool final = remaining <= carried + state->block_size;
+    size_t length = final ? remaining : carried + state->block_size;
+    size_t consumed;
+    error = process_block(state, &block, mapping->data + position, length, final, &consumed);
+    position += consumed;
+    carried = length - consumed;
+  }
+  free(block.output);
+  return error;
+}
+
+/*
+ * Fallback for inputs that cannot be mapped, such as pipes and other
+ * special files. Input is read in blocks behind the bytes carried over
+ * from the previous block.
+ */
+static char *process_stream(FileState *state) {
+  size_t capacity = state->block_size + CARRY_CAPACITY;
+  char *buffer = malloc(capacity);
+  if (!buffer) {
+    return "Could not allocate memory for the input buffer.";
+  }
+
+  BlockState block = {0};
+  size_t carried = 0;
+  char *error = NULL;
+  while (!error) {
+    if (carried + state->block_size > capacity) {
+      // Only a version with very long components is carried this far.
+      char *resized = realloc(buffer, carried + state->block_size);
+      if (!resized) {
+        error = "Could not allocate memory for the input buffer.";
+        break;
       }
+      buffer = resized;
+      capacity = carried + state->block_size;
+    }
+    size_t count = fread(buffer + carried, 1, state->block_size, state->input);
+    thread_stats.bytes_read += count;
+    thread_stats.system_calls++;
+    if (ferror(state->input)) {
+      error = "An I/O error occurred while trying to read input file.";
+      break;
     }
+    bool final = count < state->block_size;
+    size_t length = carried + count;
+    size_t consumed;
+    error = process_block(state, &block, buffer, length, final, &consumed);
+    if (final) {
+      break;
+    }
+    carried = length - consumed;
+    memmove(buffer, buffer + consumed, carried);
+  }
+  free(block.output);
+  free(buffer);
+  return error;
+}
+
+void configure_binary_detection(bool enabled) {
+  binary_detection = enabled;
+}
+
+bool skips_binary_file(bool binary) {
+  if (!binary_detection || !binary) {
+    return false;
+  }
+  thread_stats.files_binary++;
+  return true;
+}
+
+bool is_skipped_binary(const char *data, size_t size) {
+  return binary_detection && skips_binary_file(looks_binary(data, size));
+}
+
+// Copies a version given on its own, such as one from the command line.
+static char *copy_version(const char *version, char *buffer, size_t *buffer_length) {
+  if (!version) {
+    return "Empty version received.";
+  }
+  size_t length = strlen(version);
+  VersionSpan span;
+  if (length >= TARGET_CAPACITY || !find_version(version, 0, length, &span) || span.starts[0] != 0 ||
+      span.ends[2] != length) {
+    return "The value given is not a version.";
+  }
+  memcpy(buffer, version, length);
+  *buffer_length = length;
+  return NULL;
+}
+
+char *configure_target(const char *version) {
+  return copy_version(version, target_version, &target_length);
+}
+
+char *configure_source(const char *version) {
+  if (!version) {
+    // Every version is bumped again.
+    source_length = 0;
+    return NULL;
+  }
+  return copy_version(version, source_version, &source_length);
+}
+
+void configure_pipeline(bool enabled) {
+  pipeline_enabled = enabled;
+}
+
+typedef struct pipeline_buffer_struct {
+  char *data;
+  size_t capacity;
+  size_t length;
+  bool final;
+} PipelineBuffer;
+
+/*
+ * A reader thread fills input buffers, the calling thread bumps them into
+ * output buffers, and a writer thread writes those out. Every queue links
+ * exactly two stages, and a buffer goes back to the stage that fills it
+ * once it has been used. Input buffers keep room in front of the data for
+ * the bytes carried over from the previous block.
+ */
+typedef struct stream_pipeline_struct {
+  FileState *state;
+  SpscQueue filled_inputs;
+  SpscQueue free_inputs;
+  SpscQueue filled_outputs;
+  SpscQueue free_outputs;
+  PipelineBuffer inputs[PIPELINE_DEPTH];
+  PipelineBuffer outputs[PIPELINE_DEPTH];
+  // Set once the result is known to be an error, so that the reader stops early.
+  atomic_bool stopped;
+  char *read_error;
+  char *write_error;
+} StreamPipeline;
 
-    if (keep_going) {
-      int n = fprintf(state->output, "%s\n", output_buffer);
-      if (ferror(state->output)) {
-        return "An I/O error occurred while trying to write to the output file.";
+static void *run_pipeline_reader(void *argument) {
+  StreamPipeline *pipeline = argument;
+  FileState *state = pipeline->state;
+  bool final = false;
+  while (!final) {
+    PipelineBuffer *buffer = pop_queue(&pipeline->free_inputs);
+    buffer->length = 0;
+    if (!atomic_load(&pipeline->stopped)) {
+      buffer->length = fread(buffer->data + CARRY_CAPACITY, 1, state->block_size, state->input);
+      thread_stats.bytes_read += buffer->length;
+      thread_stats.system_calls++;
+      if (ferror(state->input)) {
+        pipeline->read_error = "An I/O error occurred while trying to read input file.";
       }
-      if (n < 0 || ((size_t) n) != (len + 1)) {
-        char *error = close_streams(state);
-        if (error) {
-          return error;
+    }
+    final = buffer->length < state->block_size || pipeline->read_error;
+    buffer->final = final;
+    push_queue(&pipeline->filled_inputs, buffer);
+  }
+  flush_thread_stats();
+  return NULL;
+}
+
+static void *run_pipeline_writer(void *argument) {
+  StreamPipeline *pipeline = argument;
+  bool final = false;
+  while (!final) {
+    PipelineBuffer *buffer = pop_queue(&pipeline->filled_outputs);
+    final = buffer->final;
+    if (!pipeline->write_error && buffer->length > 0) {
+      // The bytes were already counted when they were bumped.
+      uint64_t start = read_stats_clock();
+      size_t written = fwrite(buffer->data, 1, buffer->length, pipeline->state->output);
+      add_write_time(start);
+      if (written != buffer->length) {
+        pipeline->write_error = "An I/O error occurred while trying to write to the output file.";
+        atomic_store(&pipeline->stopped, true);
+      }
+    }
+    push_queue(&pipeline->free_outputs, buffer);
+  }
+  flush_thread_stats();
+  return NULL;
+}
+
+static char *reserve_carry(char **carry, size_t *capacity, size_t size) {
+  if (size <= *capacity) {
+    return NULL;
+  }
+  char *resized = realloc(*carry, size);
+  if (!resized) {
+    return "Could not allocate memory for the input buffer.";
+  }
+  *carry = resized;
+  *capacity = size;
+  return NULL;
+}
+
+// Bumps one block into an output buffer, in the same way as process_block().
+static char *bump_block_into(FileState *state,
+                             BlockState *block,
+                             const char *data,
+                             size_t length,
+                             bool final,
+                             size_t *consumed,
+                             PipelineBuffer *output) {
+  FILE *memory = open_bumped_buffer(&output->data, &output->capacity, length);
+  if (!memory) {
+    return "Could not allocate memory for the output buffer.";
+  }
+  FileState block_state = *state;
+  block_state.output = memory;
+  block_state.versions = 0;
+  char *error = process_block(&block_state, block, data, length, final, consumed);
+  long written = ftell(memory);
+  fclose(memory);
+  if (!error && written < 0) {
+    error = "Could not bump a block of the file.";
+  }
+  output->length = error ? 0 : (size_t) written;
+  state->versions += block_state.versions;
+  return error;
+}
+
+/*
+ * The scanning stage. Every input buffer yields exactly one output buffer,
+ * so the writer sees the final flag of the reader, even after an error.
+ */
+static char *scan_pipeline(StreamPipeline *pipeline) {
+  FileState *state = pipeline->state;
+  BlockState block = {0};
+  size_t carry_capacity = CARRY_CAPACITY;
+  char *carry = malloc(carry_capacity);
+  size_t carried = 0;
+  char *error = carry ? NULL : "Could not allocate memory for the input buffer.";
+  bool final = false;
+  while (!final) {
+    PipelineBuffer *input = pop_queue(&pipeline->filled_inputs);
+    PipelineBuffer *output = pop_queue(&pipeline->free_outputs);
+    final = input->final;
+    output->final = final;
+    output->length = 0;
+    if (!error && final && pipeline->read_error) {
+      error = pipeline->read_error;
+    }
+    if (!error) {
+      size_t length = carried + input->length;
+      char *data;
+      if (carried <= CARRY_CAPACITY) {
+        // The carried bytes fit into the room in front of the new ones.
+        data = input->data + CARRY_CAPACITY - carried;
+        memcpy(data, carry, carried);
+      } else {
+        // Longer runs of digits are joined in the carry buffer instead.
+        error = reserve_carry(&carry, &carry_capacity, length);
+        if (!error) {
+          data = carry;
+          memcpy(data + carried, input->data + CARRY_CAPACITY, input->length);
         }
-        return "Incorrect number of characters written to output stream.";
       }
-    } else {
-      int n = fprintf(state->output, "%s", output_buffer);
-      if (ferror(state->output)) {
-        return "An I/O error occurred while trying to write to the output file.";
+      size_t consumed = 0;
+      if (!error) {
+        error = bump_block_into(state, &block, data, length, final, &consumed, output);
       }
-      if (n < 0 || ((size_t) n) != len) {
-        char *error = close_streams(state);
-        if (error) {
-          return error;
-        }
-        return "Incorrect number of characters written to output stream.";
+      if (!error) {
+        carried = length - consumed;
+        error = reserve_carry(&carry, &carry_capacity, carried);
       }
-      char *error = close_streams(state);
-      if (error) {
-        return error;
+      if (!error) {
+        memmove(carry, data + consumed, carried);
       }
-      return NULL;
     }
+    if (error) {
+      atomic_store(&pipeline->stopped, true);
+    }
+    push_queue(&pipeline->free_inputs, input);
+    push_queue(&pipeline->filled_outputs, output);
+  }
+  free(carry);
+  free(block.output);
+  return error;
+}
+
+static void free_pipeline(StreamPipeline *pipeline) {
+  for (size_t index = 0; index < PIPELINE_DEPTH; index++) {
+    free(pipeline->inputs[index].data);
+    free(pipeline->outputs[index].data);
+  }
+  free_queue(&pipeline->filled_inputs);
+  free_queue(&pipeline->free_inputs);
+  free_queue(&pipeline->filled_outputs);
+  free_queue(&pipeline->free_outputs);
+}
+
+/*
+ * Reads, bumps and writes a stream in three overlapping stages, so that
+ * the processor is kept busy while the disk works and the other way round.
+ * Files are processed as plain streams when the stages cannot be set up.
+ */
+static char *process_pipelined(FileState *state) {
+  StreamPipeline pipeline = {0};
+  pipeline.state = state;
+  atomic_init(&pipeline.stopped, false);
+  bool ready = !initialize_queue(&pipeline.filled_inputs, PIPELINE_DEPTH) &&
+               !initialize_queue(&pipeline.free_inputs, PIPELINE_DEPTH) &&
+               !initialize_queue(&pipeline.filled_outputs, PIPELINE_DEPTH) &&
+               !initialize_queue(&pipeline.free_outputs, PIPELINE_DEPTH);
+  for (size_t index = 0; ready && index < PIPELINE_DEPTH; index++) {
+    pipeline.inputs[index].data = malloc(CARRY_CAPACITY + state->block_size);
+    ready = pipeline.inputs[index].data != NULL;
+    push_queue(&pipeline.free_inputs, &pipeline.inputs[index]);
+    push_queue(&pipeline.free_outputs, &pipeline.outputs[index]);
+  }
+  pthread_t reader;
+  pthread_t writer;
+  if (!ready || pthread_create(&writer, NULL, run_pipeline_writer, &pipeline)) {
+    free_pipeline(&pipeline);
+    return process_stream(state);
   }
+  if (pthread_create(&reader, NULL, run_pipeline_reader, &pipeline)) {
+    // Nothing has been written yet, so the writer is just told to finish.
+    PipelineBuffer *output = pop_queue(&pipeline.free_outputs);
+    output->length = 0;
+    output->final = true;
+    push_queue(&pipeline.filled_outputs, output);
+    pthread_join(writer, NULL);
+    free_pipeline(&pipeline);
+    return process_stream(state);
+  }
+  char *error = scan_pipeline(&pipeline);
+  pthread_join(reader, NULL);
+  pthread_join(writer, NULL);
+  free_pipeline(&pipeline);
+  return error ? error : pipeline.write_error;
+}
+
+char *process_file(FileState *state) {
+  if (!state) {
+    return "File state is null";
+  }
+
+  StatsTimer timer;
+  start_phase(&timer);
+  MappedFile mapping;
+  char *error;
+  if (pipeline_enabled) {
+    end_phase(&timer, PHASE_OPEN);
+    error = process_pipelined(state);
+  } else if (map_file(fileno(state->input), &mapping) == NULL) {
+    end_phase(&timer, PHASE_OPEN);
+    error = process_mapping(state, &mapping);
+    unmap_file(&mapping);
+  } else {
+    end_phase(&timer, PHASE_OPEN);
+    error = process_stream(state);
+  }
+  end_phase(&timer, PHASE_SCAN);
+
+  // The streams are closed on every path so that a failed file
+  // does not leak descriptors when many files are processed in one run.
+  char *close_error = close_streams(state);
+  error = error ? error : close_error;
+  if (state->replacement) {
+    // An output opened by path only takes the place of the old one when everything went well.
+    if (error) {
+      discard_replacement_file(state->replacement);
+    } else {
+      error = commit_replacement_file(state->replacement);
+    }
+    free(state->replacement);
+    state->replacement = NULL;
+  }
+  end_phase(&timer, PHASE_FINALIZE);
+  thread_stats.versions += state->versions;
+  return error;
+}
+
+// Like process_file(), for an input whose contents are already mapped.
+static char *process_contents(FileState *state, const MappedFile *contents) {
+  StatsTimer timer;
+  start_phase(&timer);
+  char *error = process_mapping(state, contents);
+  end_phase(&timer, PHASE_SCAN);
+  char *close_error = close_streams(state);
+  end_phase(&timer, PHASE_FINALIZE);
+  thread_stats.versions += state->versions;
+  return error ? error : close_error;
+}
+
+/*
+ * Scratch space for one bumped version. Versions fit the inline buffer
+ * unless their components are unusually long.
+ */
+typedef struct scratch_struct {
+  char inline_buffer[CARRY_CAPACITY];
+  char *data;
+  size_t capacity;
+} Scratch;
+
+static char *reserve_scratch(Scratch *scratch, size_t size) {
+  if (!scratch->data) {
+    scratch->data = scratch->inline_buffer;
+    scratch->capacity = sizeof(scratch->inline_buffer);
+  }
+  if (size > scratch->capacity) {
+    char *data = realloc(scratch->data == scratch->inline_buffer ? NULL : scratch->data, size);
+    if (!data) {
+      return "Could not allocate memory for a version";
+    }
+    scratch->data = data;
+    scratch->capacity = size;
+  }
+  return NULL;
+}
+
+static void free_scratch(Scratch *scratch) {
+  if (scratch->data != scratch->inline_buffer) {
+    free(scratch->data);
+  }
+}
+
+/*
+ * Hands out the versions of mapped contents in order, either by scanning
+ * the contents or from an earlier scan of exactly the same contents.
+ */
+typedef struct span_cursor_struct {
+  const MappedFile *mapping;
+  const FileScan *scan;
+  size_t next;
+} SpanCursor;
+
+static bool next_span(SpanCursor *cursor, VersionSpan *span) {
+  if (!cursor->scan) {
+    if (!find_next_version(cursor->mapping->data, cursor->next, cursor->mapping->size, span)) {
+      return false;
+    }
+    cursor->next = span->ends[2];
+    return true;
+  }
+  if (cursor->next == cursor->scan->count) {
+    return false;
+  }
+  // The spans of a scan refer to its text, so they are moved back to where the version is in the file.
+  const VersionMatch *match = &cursor->scan->matches[cursor->next++];
+  size_t start = match->span.starts[0];
+  for (size_t index = 0; index < 3; index++) {
+    span->starts[index] = match->span.starts[index] - start + match->offset;
+    span->ends[index] = match->span.ends[index] - start + match->offset;
+  }
+  return true;
+}
+
+/*
+ * Reports whether every version in the mapping keeps its length when
+ * bumped, and whether there is any version at all.
+ */
+static char *check_lengths(const MappedFile *mapping,
+                           const FileScan *scan,
+                           BumpLevel level,
+                           bool *preserved,
+                           bool *found) {
+  *preserved = true;
+  *found = false;
+  Scratch scratch = {0};
+  char *error = NULL;
+  VersionSpan span;
+  SpanCursor cursor = {mapping, scan, 0};
+  while (!error && *preserved && next_span(&cursor, &span)) {
+    *found = true;
+    size_t length = span.ends[2] - span.starts[0];
+    error = reserve_scratch(&scratch, bumped_length_limit(length));
+    if (!error) {
+      *preserved = format_bumped_version(mapping->data, &span, level, scratch.data) == length;
+    }
+  }
+  free_scratch(&scratch);
+  return error;
+}
+
+static char *write_at(int descriptor, const char *bytes, size_t length, off_t offset) {
+  while (length > 0) {
+    uint64_t start = read_stats_clock();
+    ssize_t written = pwrite(descriptor, bytes, length, offset);
+    add_write_time(start);
+    thread_stats.system_calls++;
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return "Could not write to the file";
+    }
+    thread_stats.bytes_written += (size_t) written;
+    bytes += written;
+    length -= (size_t) written;
+    offset += written;
+  }
+  return NULL;
+}
+
+/*
+ * Where patched bytes go: straight to a descriptor, or onto a list that is
+ * written through the ring once the file has been handled.
+ */
+typedef struct patch_target_struct {
+  int descriptor;
+  PatchList *list;
+} PatchTarget;
+
+static char *write_patch(const PatchTarget *target, const char *bytes, size_t length, off_t offset) {
+  if (target->list) {
+    return add_file_patch(target->list, (uint64_t) offset, bytes, length);
+  }
+  return write_at(target->descriptor, bytes, length, offset);
+}
+
+/*
+ * Overwrites the bumped versions where they stand. Only the bytes that
+ * differ are written, so a typical patch bump writes a single byte.
+ */
+static char *patch_versions(const PatchTarget *target,
+                            const MappedFile *mapping,
+                            const FileScan *scan,
+                            BumpLevel level) {
+  Scratch scratch = {0};
+  char *error = NULL;
+  VersionSpan span;
+  SpanCursor cursor = {mapping, scan, 0};
+  while (!error && next_span(&cursor, &span)) {
+    const char *original = mapping->data + span.starts[0];
+    size_t length = span.ends[2] - span.starts[0];
+    error = reserve_scratch(&scratch, length);
+    if (error) {
+      break;
+    }
+    format_bumped_version(mapping->data, &span, level, scratch.data);
+    size_t first = 0;
+    while (first < length && scratch.data[first] == original[first]) {
+      first++;
+    }
+    size_t last = length;
+    while (last > first && scratch.data[last - 1] == original[last - 1]) {
+      last--;
+    }
+    error = write_patch(target, scratch.data + first, last - first, (off_t) (span.starts[0] + first));
+    thread_stats.versions += !error;
+  }
+  free_scratch(&scratch);
+  return error;
+}
+
+/*
+ * Bumps the contents of a file that were already read without rewriting
+ * the file when that is possible: files without a version are left alone,
+ * and when no version changes length the new digits are written over the
+ * old ones through the given target. Anything else, including files
+ * without a target, is left to the full rewrite, which is signalled by
+ * clearing the done flag.
+ */
+static char *patch_contents(const PatchTarget *target,
+                            const MappedFile *contents,
+                            const FileScan *scan,
+                            BumpLevel level,
+                            bool *done,
+                            bool *changed) {
+  *done = false;
+  StatsTimer timer;
+  start_phase(&timer);
+  bool preserved;
+  bool found;
+  char *error = check_lengths(contents, scan, level, &preserved, &found);
+  end_phase(&timer, PHASE_SCAN);
+  if (stats_enabled && (error || !found || preserved)) {
+    // Lines are counted by whichever path ends up handling the file.
+    thread_stats.lines += count_lines(contents->data, contents->size);
+  }
+  if (error || !found || !preserved || !target) {
+    *done = error || !found;
+    return error;
+  }
+  error = patch_versions(target, contents, scan, level);
+  end_phase(&timer, PHASE_WRITE);
+  *done = true;
+  *changed = !error;
+  return error;
+}
+
+// Maps an open file to patch it, as above, through the same descriptor when it is writable.
+static char *patch_in_place(FILE *input, bool writable, BumpLevel level, bool *done, bool *changed) {
+  *done = false;
+  StatsTimer timer;
+  start_phase(&timer);
+  // The descriptor that was opened is the one inspected, so the file is not looked up again.
+  struct stat status;
+  MappedFile mapping;
+  if (inspect_file(fileno(input), &status) || map_inspected_file(fileno(input), &status, &mapping)) {
+    return NULL;
+  }
+  end_phase(&timer, PHASE_OPEN);
+  if (mapping.size == 0) {
+    *done = true;
+    return NULL;
+  }
+  if (is_skipped_binary(mapping.data, mapping.size)) {
+    *done = true;
+    unmap_file(&mapping);
+    return binary_file_skipped;
+  }
+  PatchTarget target = {fileno(input), NULL};
+  char *error = patch_contents(writable ? &target : NULL, &mapping, NULL, level, done, changed);
+  unmap_file(&mapping);
+  return error;
+}
+
+/*
+ * Opens a file that is bumped in place, for writing as well whenever that
+ * is allowed, so that a patch is written through the descriptor it was
+ * read from. Opening a file for writing changes nothing on disk by itself.
+ * Links are followed, so that the file they point to is patched.
+ */
+FILE *open_in_place(int directory, const char *path, bool *writable) {
+  int descriptor = openat(directory, path, O_RDWR | O_CLOEXEC);
+  thread_stats.system_calls++;
+  *writable = descriptor != -1;
+  if (descriptor == -1 && errno != ENOENT) {
+    // Read-only files, read-only file systems and the like can still be read.
+    descriptor = openat(directory, path, O_RDONLY | O_CLOEXEC);
+    thread_stats.system_calls++;
+  }
+  if (descriptor == -1) {
+    return NULL;
+  }
+  FILE *file = fdopen(descriptor, "r");
+  if (!file) {
+    close(descriptor);
+  }
+  return file;
+}
+
+/*
+ * Bumps the open input of a state into a replacement file and commits it.
+ * The input is closed and the replacement discarded on failure.
+ */
+static char *write_replacement(FileState *state,
+                               ReplacementFile *replacement,
+                               const MappedFile *contents,
+                               const char *bump_level,
+                               size_t block_size,
+                               bool *changed) {
+  FILE *output = open_replacement_stream(replacement);
+  if (!output) {
+    if (state->input) {
+      fclose(state->input);
+    }
+    discard_replacement_file(replacement);
+    return "Could open output stream";
+  }
+  char *error = attach_output(state, output, bump_level, block_size);
+  if (!error) {
+    error = contents ? process_contents(state, contents) : process_file(state);
+  }
+
+  if (error) {
+    discard_replacement_file(replacement);
+    return error;
+  }
+  *changed = state->versions > 0;
+  StatsTimer timer;
+  start_phase(&timer);
+  error = commit_replacement_file(replacement);
+  end_phase(&timer, PHASE_FINALIZE);
+  return error;
+}
+
+/*
+ * Rewrites a file through a temporary file next to it, which then replaces
+ * the original in one step. The original is left untouched on failure, and
+ * also when it has no version to bump, so that its timestamps stay as they are.
+ * Bumps that keep every version the same length are patched instead.
+ */
+static char *process_in_place(int directory,
+                              const char *path,
+                              const char *bump_level,
+                              size_t block_size,
+                              bool *changed) {
+  if (!bump_level) {
+    return "Invalid value received for bump level";
+  }
+  StatsTimer timer;
+  start_phase(&timer);
+  FileState state = {0};
+  bool writable;
+  state.input = open_in_place(directory, path, &writable);
+  end_phase(&timer, PHASE_OPEN);
+  if (!state.input) {
+    return "Could open input stream";
+  }
+  BumpLevel level;
+  bool done;
+  char *error = parse_bump_level(bump_level, &level);
+  if (!error) {
+    error = patch_in_place(state.input, writable, level, &done, changed);
+  }
+  if (error || done) {
+    // Writes to some file systems only fail once the file is closed.
+    start_phase(&timer);
+    thread_stats.system_calls++;
+    if (fclose(state.input) && !error && *changed) {
+      error = "Could not write to the file";
+    }
+    end_phase(&timer, PHASE_FINALIZE);
+    return error;
+  }
+
+  start_phase(&timer);
+  ReplacementFile replacement;
+  error = open_replacement_file(directory, path, INTERMEDIATE_SUFFIX, &replacement);
+  end_phase(&timer, PHASE_OPEN);
+  if (error) {
+    fclose(state.input);
+    return error;
+  }
+  return write_replacement(&state, &replacement, NULL, bump_level, block_size, changed);
+}
+
+/*
+ * Bumps a file into another one. An existing output is only replaced once
+ * the whole file has been bumped, rather than truncated up front.
+ */
+static char *process_into_output(int directory,
+                                 const char *input_path,
+                                 const char *output_path,
+                                 const char *bump_level,
+                                 size_t block_size,
+                                 bool *changed) {
+  if (!bump_level) {
+    return "Invalid value received for bump level";
+  }
+  StatsTimer timer;
+  start_phase(&timer);
+  FileState state = {0};
+  state.input = open_file_at(directory, input_path, "r");
+  if (!state.input) {
+    return "Could open input stream";
+  }
+  // The output is only created once the input is known not to be binary.
+  char start[BINARY_SNIFF_SIZE + 1];
+  ssize_t sniffed = pread(fileno(state.input), start, sizeof(start), 0);
+  thread_stats.system_calls++;
+  if (sniffed > 0 && is_skipped_binary(start, (size_t) sniffed)) {
+    fclose(state.input);
+    return binary_file_skipped;
+  }
+  ReplacementFile output;
+  char *error = open_output_file(directory, output_path, INTERMEDIATE_SUFFIX, &output);
+  end_phase(&timer, PHASE_OPEN);
+  if (error) {
+    fclose(state.input);
+    return error;
+  }
+  return write_replacement(&state, &output, NULL, bump_level, block_size, changed);
+}
+
+// Tells whether two paths name one file, once links are followed.
+static bool is_same_file(int directory, const char *first_path, const char *second_path) {
+  struct stat first;
+  struct stat second;
+  thread_stats.system_calls += 2;
+  return fstatat(directory, first_path, &first, 0) == 0 && fstatat(directory, second_path, &second, 0) == 0 &&
+         first.st_dev == second.st_dev && first.st_ino == second.st_ino;
+}
+
+char *process_path_at(int directory,
+                      const char *input_path,
+                      const char *output_path,
+                      const char *bump_level,
+                      const size_t block_size,
+                      bool *changed) {
+  bool bumped = false;
+  if (!changed) {
+    changed = &bumped;
+  }
+  *changed = false;
+  if (!input_path || !output_path) {
+    return "Empty file path provided";
+  }
+  thread_stats.files++;
+  char *error;
+  // An output that is the input under another name, such as a link to it, is bumped in place as well.
+  if (strcmp(input_path, output_path) == 0 || is_same_file(directory, input_path, output_path)) {
+    error = process_in_place(directory, input_path, bump_level, block_size, changed);
+  } else {
+    error = process_into_output(directory, input_path, output_path, bump_level, block_size, changed);
+    *changed = !error && *changed;
+  }
+  thread_stats.files_unchanged += !error && !*changed;
+  return error;
+}
+
+/*
+ * Bumps a file in place whose contents are already in memory, patching it
+ * through the target when possible and rewriting it from memory otherwise.
+ * The input, which may be missing, is closed.
+ */
+static char *bump_contents(int directory,
+                           const char *path,
+                           FILE *input,
+                           const PatchTarget *target,
+                           const char *data,
+                           size_t size,
+                           const FileScan *scan,
+                           const char *bump_level,
+                           size_t block_size,
+                           bool *changed) {
+  *changed = false;
+  BumpLevel level;
+  char *error = !path || (!data && size > 0) ? "Empty pointer received for the file contents."
+                                             : parse_bump_level(bump_level, &level);
+  if (error) {
+    if (input) {
+      fclose(input);
+    }
+    return error;
+  }
+  thread_stats.files++;
+  MappedFile contents = {data, size};
+  bool done = size == 0;
+  if (!done) {
+    error = patch_contents(target, &contents, scan, level, &done, changed);
+  }
+  if (error || done) {
+    thread_stats.system_calls += input != NULL;
+    // Writes to some file systems only fail once the file is closed.
+    if (input && fclose(input) && !error && *changed) {
+      error = "Could not write to the file";
+    }
+  } else {
+    // The contents are rewritten from memory, so the file is not read again.
+    StatsTimer timer;
+    start_phase(&timer);
+    FileState state = {0};
+    state.input = input;
+    ReplacementFile replacement;
+    error = open_replacement_file(directory, path, INTERMEDIATE_SUFFIX, &replacement);
+    end_phase(&timer, PHASE_OPEN);
+    if (!error) {
+      error = write_replacement(&state, &replacement, &contents, bump_level, block_size, changed);
+    } else if (input) {
+      fclose(input);
+    }
+  }
+  thread_stats.files_unchanged += !error && !*changed;
+  return error;
+}
+
+char *bump_loaded_file(int directory,
+                       const char *path,
+                       const char *data,
+                       size_t size,
+                       PatchList *patches,
+                       const char *bump_level,
+                       size_t block_size,
+                       bool *changed) {
+  bool bumped = false;
+  if (!changed) {
+    changed = &bumped;
+  }
+  if (size > 0 && data && is_skipped_binary(data, size)) {
+    *changed = false;
+    thread_stats.files++;
+    return binary_file_skipped;
+  }
+  PatchTarget target = {-1, patches};
+  return bump_contents(directory, path, NULL, patches ? &target : NULL, data, size, NULL, bump_level, block_size,
+                       changed);
+}
+
+char *bump_mapped_file(int directory,
+                       const char *path,
+                       FILE *input,
+                       bool writable,
+                       const char *data,
+                       size_t size,
+                       const FileScan *scan,
+                       const char *bump_level,
+                       size_t block_size,
+                       bool *changed) {
+  bool bumped = false;
+  if (!changed) {
+    changed = &bumped;
+  }
+  *changed = false;
+  if (!input) {
+    return "Empty stream provided";
+  }
+  PatchTarget target = {fileno(input), NULL};
+  return bump_contents(directory, path, input, writable ? &target : NULL, data, size, scan, bump_level, block_size,
+                       changed);
+}
+
+char *process_streams(FILE *input, FILE *output, const char *bump_level, size_t block_size, bool *changed) {
+  bool bumped = false;
+  if (!changed) {
+    changed = &bumped;
+  }
+  *changed = false;
+  if (!input || !output) {
+    return "Empty stream provided";
+  }
+  if (!bump_level) {
+    fclose(input);
+    fclose(output);
+    return "Invalid value received for bump level";
+  }
+  thread_stats.files++;
+  FileState state = {0};
+  state.input = input;
+  char *error = attach_output(&state, output, bump_level, block_size);
+  if (!error) {
+    error = process_file(&state);
+  }
+  *changed = !error && state.versions > 0;
+  thread_stats.files_unchanged += !error && !*changed;
+  return error;
+}
+
+char *process_stream_to_path(FILE *input,
+                             int directory,
+                             const char *output_path,
+                             const char *bump_level,
+                             size_t block_size,
+                             bool *changed) {
+  bool bumped = false;
+  if (!changed) {
+    changed = &bumped;
+  }
+  *changed = false;
+  if (!input || !output_path) {
+    return "Empty stream provided";
+  }
+  if (!bump_level) {
+    fclose(input);
+    return "Invalid value received for bump level";
+  }
+  thread_stats.files++;
+  FileState state = {0};
+  state.input = input;
+  ReplacementFile output;
+  char *error = open_output_file(directory, output_path, INTERMEDIATE_SUFFIX, &output);
+  if (error) {
+    fclose(input);
+    return error;
+  }
+  error = write_replacement(&state, &output, NULL, bump_level, block_size, changed);
+  *changed = !error && *changed;
+  thread_stats.files_unchanged += !error && !*changed;
+  return error;
+}
+
+char *process_path(const char *input_path,
+                   const char *output_path,
+                   const char *bump_level,
+                   const size_t block_size,
+                   bool *changed) {
+  return process_path_at(AT_FDCWD, input_path, output_path, bump_level, block_size, changed);
 }
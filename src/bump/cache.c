@@ -0,0 +1,659 @@
+#include <bump/bump.h>
+#include <bump/cache.h>
+#include <bump/fileutil.h>
+#include <bump/scan.h>
+#include <bump/stats.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC "BUMPCACH"
+#define CACHE_MAGIC_LENGTH 8
+// Some file systems only keep timestamps to the nearest two seconds.
+#define RACY_SECONDS 2
+
+uint64_t hash_bytes(const char *data, size_t size) {
+  uint64_t hash = 0x9E3779B97F4A7C15u ^ (uint64_t) size;
+  size_t index = 0;
+  for (; index + sizeof(uint64_t) <= size; index += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + index, sizeof(word));
+    hash = (hash ^ word) * 0xBF58476D1CE4E5B9u;
+    hash ^= hash >> 29;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + index, size - index);
+  hash = (hash ^ tail) * 0x94D049BB133111EBu;
+  return hash ^ (hash >> 32);
+}
+
+static FileIdentity identify(const struct stat *status) {
+  FileIdentity identity = {
+          (uint64_t) status->st_dev,
+          (uint64_t) status->st_ino,
+          (uint64_t) status->st_size,
+          (int64_t) status->st_mtim.tv_sec,
+          (int64_t) status->st_mtim.tv_nsec,
+  };
+  return identity;
+}
+
+static bool same_identity(const FileIdentity *left, const FileIdentity *right) {
+  return left->device == right->device &&
+         left->inode == right->inode &&
+         left->size == right->size &&
+         left->modified_seconds == right->modified_seconds &&
+         left->modified_nanoseconds == right->modified_nanoseconds;
+}
+
+/*
+ * A file that was modified within the timestamp granularity of the scan
+ * could be modified again without its timestamp moving.
+ */
+static bool is_racy(const FileIdentity *identity) {
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  return identity->modified_seconds >= (int64_t) now.tv_sec - RACY_SECONDS;
+}
+
+static void free_entry(CacheEntry *entry) {
+  free(entry->path);
+  free_file_scan(&entry->scan);
+}
+
+static void free_entries(CacheEntry *entries, size_t count) {
+  for (size_t index = 0; index < count; index++) {
+    free_entry(&entries[index]);
+  }
+  free(entries);
+}
+
+static int compare_entries(const void *left, const void *right) {
+  return strcmp(((const CacheEntry *) left)->path, ((const CacheEntry *) right)->path);
+}
+
+static char *join_cache_path(const char *directory, const char *name) {
+  size_t length = strlen(directory) + strlen(name) + 2;
+  char *path = malloc(length);
+  if (path) {
+    snprintf(path, length, "%s/%s", directory, name);
+  }
+  return path;
+}
+
+/*
+ * SERIALIZATION
+ * =============
+ *
+ * The index is a header followed by the entries in path order. Every
+ * number is stored as a native 64-bit value, since the cache is never
+ * shared between machines.
+ */
+
+typedef struct cache_buffer_struct {
+  char *data;
+  size_t length;
+  size_t capacity;
+  bool failed;
+} CacheBuffer;
+
+static void put_bytes(CacheBuffer *buffer, const void *bytes, size_t length) {
+  if (buffer->failed || length == 0) {
+    return;
+  }
+  if (buffer->length + length > buffer->capacity) {
+    size_t capacity = buffer->capacity ? buffer->capacity * 2 : 4096;
+    while (capacity < buffer->length + length) {
+      capacity *= 2;
+    }
+    char *data = realloc(buffer->data, capacity);
+    if (!data) {
+      buffer->failed = true;
+      return;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+  }
+  memcpy(buffer->data + buffer->length, bytes, length);
+  buffer->length += length;
+}
+
+static void put_number(CacheBuffer *buffer, uint64_t value) {
+  put_bytes(buffer, &value, sizeof(value));
+}
+
+static void put_entry(CacheBuffer *buffer, const CacheEntry *entry) {
+  size_t path_length = strlen(entry->path);
+  put_number(buffer, path_length);
+  put_bytes(buffer, entry->path, path_length);
+  put_number(buffer, entry->identity.device);
+  put_number(buffer, entry->identity.inode);
+  put_number(buffer, entry->identity.size);
+  put_number(buffer, (uint64_t) entry->identity.modified_seconds);
+  put_number(buffer, (uint64_t) entry->identity.modified_nanoseconds);
+  put_number(buffer, entry->hash);
+  put_number(buffer, entry->racy);
+  put_number(buffer, entry->binary);
+  put_number(buffer, entry->scan.count);
+  put_number(buffer, entry->scan.text_length);
+  for (size_t index = 0; index < entry->scan.count; index++) {
+    const VersionMatch *match = &entry->scan.matches[index];
+    put_number(buffer, match->offset);
+    put_number(buffer, match->line);
+    put_number(buffer, match->column);
+    for (size_t component = 0; component < 3; component++) {
+      put_number(buffer, match->span.starts[component]);
+      put_number(buffer, match->span.ends[component]);
+    }
+  }
+  put_bytes(buffer, entry->scan.text, entry->scan.text_length);
+}
+
+typedef struct cache_reader_struct {
+  const char *data;
+  size_t length;
+  size_t position;
+  bool failed;
+} CacheReader;
+
+static const char *get_bytes(CacheReader *reader, size_t length) {
+  if (reader->failed || length > reader->length - reader->position) {
+    reader->failed = true;
+    return NULL;
+  }
+  const char *bytes = reader->data + reader->position;
+  reader->position += length;
+  return bytes;
+}
+
+static uint64_t get_number(CacheReader *reader) {
+  uint64_t value = 0;
+  const char *bytes = get_bytes(reader, sizeof(value));
+  if (bytes) {
+    memcpy(&value, bytes, sizeof(value));
+  }
+  return value;
+}
+
+// Spans must stay inside the text and in order, or bumping them would read past it.
+static bool span_is_valid(const VersionSpan *span, size_t text_length) {
+  size_t previous = span->starts[0];
+  for (size_t component = 0; component < 3; component++) {
+    if (span->starts[component] < previous || span->ends[component] < span->starts[component]) {
+      return false;
+    }
+    previous = span->ends[component];
+  }
+  return previous <= text_length;
+}
+
+static bool get_entry(CacheReader *reader, CacheEntry *entry) {
+  memset(entry, 0, sizeof(CacheEntry));
+  size_t path_length = get_number(reader);
+  const char *path = get_bytes(reader, path_length);
+  entry->identity.device = get_number(reader);
+  entry->identity.inode = get_number(reader);
+  entry->identity.size = get_number(reader);
+  entry->identity.modified_seconds = (int64_t) get_number(reader);
+  entry->identity.modified_nanoseconds = (int64_t) get_number(reader);
+  entry->hash = get_number(reader);
+  entry->racy = get_number(reader) != 0;
+  entry->binary = get_number(reader) != 0;
+  size_t count = get_number(reader);
+  size_t text_length = get_number(reader);
+  // Every match takes nine numbers, which bounds a sane count by the size of the index.
+  if (reader->failed || count > (reader->length - reader->position) / (9 * sizeof(uint64_t))) {
+    return false;
+  }
+
+  entry->path = malloc(path_length + 1);
+  entry->scan.matches = count ? malloc(count * sizeof(VersionMatch)) : NULL;
+  if (!entry->path || (count && !entry->scan.matches)) {
+    free_entry(entry);
+    return false;
+  }
+  memcpy(entry->path, path, path_length);
+  entry->path[path_length] = '\0';
+  entry->scan.count = count;
+  entry->scan.capacity = count;
+  for (size_t index = 0; index < count; index++) {
+    VersionMatch *match = &entry->scan.matches[index];
+    match->offset = get_number(reader);
+    match->line = get_number(reader);
+    match->column = get_number(reader);
+    for (size_t component = 0; component < 3; component++) {
+      match->span.starts[component] = get_number(reader);
+      match->span.ends[component] = get_number(reader);
+    }
+    if (!span_is_valid(&match->span, text_length)) {
+      reader->failed = true;
+    }
+  }
+  const char *text = get_bytes(reader, text_length);
+  if (!reader->failed && text_length > 0) {
+    entry->scan.text = malloc(text_length);
+    if (entry->scan.text) {
+      memcpy(entry->scan.text, text, text_length);
+      entry->scan.text_length = text_length;
+      entry->scan.text_capacity = text_length;
+    }
+  }
+  if (reader->failed || (text_length > 0 && !entry->scan.text)) {
+    free_entry(entry);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * Reads the index in the cache directory. A missing, damaged or outdated
+ * index is not an error: the cache then simply starts out empty.
+ */
+static void load_index(const char *directory, CacheEntry **entries, size_t *count) {
+  *entries = NULL;
+  *count = 0;
+  char *path = join_cache_path(directory, BUMP_CACHE_INDEX);
+  FILE *input = path ? fopen(path, "rb") : NULL;
+  free(path);
+  if (!input) {
+    return;
+  }
+  MappedFile mapping;
+  if (map_file(fileno(input), &mapping)) {
+    fclose(input);
+    return;
+  }
+
+  CacheReader reader = {mapping.data, mapping.size, 0, false};
+  const char *magic = get_bytes(&reader, CACHE_MAGIC_LENGTH);
+  uint64_t format = get_number(&reader);
+  uint64_t total = get_number(&reader);
+  // Every entry takes at least eleven numbers, which bounds a sane total.
+  if (reader.failed || memcmp(magic, CACHE_MAGIC, CACHE_MAGIC_LENGTH) != 0 || format != BUMP_CACHE_FORMAT ||
+      total > mapping.size / (11 * sizeof(uint64_t))) {
+    total = 0;
+  }
+  CacheEntry *loaded = total ? calloc(total, sizeof(CacheEntry)) : NULL;
+  size_t loaded_count = 0;
+  while (loaded && loaded_count < total && get_entry(&reader, &loaded[loaded_count])) {
+    loaded_count++;
+  }
+  if (loaded && loaded_count < total) {
+    // A damaged index is dropped as a whole.
+    free_entries(loaded, loaded_count);
+    loaded = NULL;
+    loaded_count = 0;
+  }
+  unmap_file(&mapping);
+  fclose(input);
+
+  if (loaded_count > 1) {
+    qsort(loaded, loaded_count, sizeof(CacheEntry), compare_entries);
+  }
+  *entries = loaded;
+  *count = loaded_count;
+}
+
+char *open_scan_cache(ScanCache *cache, const char *directory) {
+  if (!cache || !directory) {
+    return "Empty pointer received for the cache.";
+  }
+  memset(cache, 0, sizeof(ScanCache));
+  if (mkdir(directory, 0777) && errno != EEXIST) {
+    return "Could not create the cache directory.";
+  }
+  cache->directory = strdup(directory);
+  if (!cache->directory) {
+    return "Could not allocate memory for the cache.";
+  }
+  load_index(directory, &cache->entries, &cache->count);
+  pthread_mutex_init(&cache->lock, NULL);
+  return NULL;
+}
+
+static const CacheEntry *find_entry(const ScanCache *cache, const char *key) {
+  if (cache->count == 0) {
+    return NULL;
+  }
+  CacheEntry probe = {0};
+  probe.path = (char *) key;
+  return bsearch(&probe, cache->entries, cache->count, sizeof(CacheEntry), compare_entries);
+}
+
+static void record_entry(ScanCache *cache, CacheEntry *entry) {
+  pthread_mutex_lock(&cache->lock);
+  if (cache->update_count == cache->update_capacity) {
+    size_t capacity = cache->update_capacity ? cache->update_capacity * 2 : 64;
+    CacheEntry *updates = realloc(cache->updates, capacity * sizeof(CacheEntry));
+    if (!updates) {
+      // The entry is simply not cached.
+      pthread_mutex_unlock(&cache->lock);
+      free_entry(entry);
+      return;
+    }
+    cache->updates = updates;
+    cache->update_capacity = capacity;
+  }
+  cache->updates[cache->update_count++] = *entry;
+  pthread_mutex_unlock(&cache->lock);
+}
+
+static void record_removal(ScanCache *cache, const char *key) {
+  CacheEntry entry = {0};
+  entry.path = strdup(key);
+  entry.removed = true;
+  if (entry.path) {
+    record_entry(cache, &entry);
+  }
+}
+
+/*
+ * Scans the mapped contents of a regular file, or takes the scan of the
+ * cached entry when the contents are still exactly the ones it describes.
+ * The result is recorded, unless the file is about to be bumped, which
+ * would leave the entry out of date right away.
+ */
+static char *examine_contents(ScanCache *cache,
+                              const char *key,
+                              const CacheEntry *entry,
+                              const struct stat *status,
+                              const MappedFile *mapping,
+                              bool bumping,
+                              FileScan *scan) {
+  // Skipped files have no scan to record, and scanned ones are marked for runs that skip them.
+  bool binary = mapping->size > 0 && looks_binary(mapping->data, mapping->size);
+  if (skips_binary_file(binary)) {
+    memset(scan, 0, sizeof(FileScan));
+    return binary_file_skipped;
+  }
+  CacheEntry update = {0};
+  update.binary = binary;
+  update.identity = identify(status);
+  update.hash = hash_bytes(mapping->data, mapping->size);
+  update.racy = is_racy(&update.identity);
+  char *error;
+  if (entry && same_identity(&entry->identity, &update.identity) && entry->hash == update.hash) {
+    // The file is exactly as it was scanned before.
+    error = copy_file_scan(scan, &entry->scan);
+  } else {
+    error = scan_buffer(mapping->data, mapping->size, scan);
+  }
+
+  if (!error && (!bumping || scan->count == 0)) {
+    update.path = strdup(key);
+    if (update.path && copy_file_scan(&update.scan, scan) == NULL) {
+      record_entry(cache, &update);
+    } else {
+      free(update.path);
+    }
+  }
+  return error;
+}
+
+/*
+ * Scans a regular file and records the result, unless the cached entry
+ * turns out to be current after all. The examined flag is cleared for
+ * files the cache cannot hold, which are left alone.
+ */
+static char *examine_file(ScanCache *cache,
+                          int directory,
+                          const char *path,
+                          const char *key,
+                          const CacheEntry *entry,
+                          FileScan *scan,
+                          bool *examined) {
+  *examined = false;
+  FILE *input = open_file_at(directory, path, "r");
+  if (!input) {
+    return "Could open input stream";
+  }
+  struct stat status;
+  MappedFile mapping;
+  if (inspect_file(fileno(input), &status) || map_inspected_file(fileno(input), &status, &mapping)) {
+    fclose(input);
+    return NULL;
+  }
+  char *error = examine_contents(cache, key, entry, &status, &mapping, false, scan);
+  *examined = error != binary_file_skipped;
+  unmap_file(&mapping);
+  fclose(input);
+  return error;
+}
+
+/*
+ * Returns the cached entry for a file if it can be trusted without reading
+ * the file, or NULL. The entry is also returned through the candidate when
+ * it matches, but only its content hash can tell whether it is current.
+ */
+static const CacheEntry *lookup(const ScanCache *cache,
+                                int directory,
+                                const char *path,
+                                const char *key,
+                                const CacheEntry **candidate) {
+  *candidate = NULL;
+  struct stat status;
+  if (fstatat(directory, path, &status, 0) || !S_ISREG(status.st_mode)) {
+    return NULL;
+  }
+  const CacheEntry *entry = find_entry(cache, key);
+  if (!entry) {
+    return NULL;
+  }
+  FileIdentity identity = identify(&status);
+  if (!same_identity(&entry->identity, &identity)) {
+    return NULL;
+  }
+  *candidate = entry;
+  return entry->racy ? NULL : entry;
+}
+
+char *bump_with_cache(ScanCache *cache,
+                      int directory,
+                      const char *path,
+                      const char *key,
+                      const char *bump_level,
+                      const size_t block_size,
+                      bool *changed) {
+  if (!cache || !path || !key || !changed) {
+    return "Empty pointer received for the cache.";
+  }
+  *changed = false;
+  const CacheEntry *candidate;
+  const CacheEntry *entry = lookup(cache, directory, path, key, &candidate);
+  if (entry && skips_binary_file(entry->binary)) {
+    thread_stats.files++;
+    return binary_file_skipped;
+  }
+  if (entry && entry->scan.count == 0) {
+    thread_stats.files++;
+    thread_stats.files_unchanged++;
+    return NULL;
+  }
+
+  // The file is opened, read and scanned once, and bumped straight from the mapping.
+  bool writable;
+  FILE *input = open_in_place(directory, path, &writable);
+  if (!input) {
+    return "Could open input stream";
+  }
+  struct stat status;
+  MappedFile mapping;
+  if (inspect_file(fileno(input), &status) || map_inspected_file(fileno(input), &status, &mapping)) {
+    // Files the cache cannot hold are bumped as usual.
+    fclose(input);
+    return process_path_at(directory, path, path, bump_level, block_size, changed);
+  }
+  FileScan scan;
+  char *error = examine_contents(cache, key, candidate, &status, &mapping, true, &scan);
+  if (error || scan.count == 0) {
+    if (!error) {
+      thread_stats.files++;
+      thread_stats.files_unchanged++;
+      free_file_scan(&scan);
+    }
+    unmap_file(&mapping);
+    fclose(input);
+    return error;
+  }
+  if (find_entry(cache, key)) {
+    // The entry on disk describes the file as it was before the bump.
+    record_removal(cache, key);
+  }
+  error = bump_mapped_file(directory, path, input, writable, mapping.data, mapping.size, &scan, bump_level, block_size, changed);
+  unmap_file(&mapping);
+  free_file_scan(&scan);
+  return error;
+}
+
+char *scan_with_cache(ScanCache *cache, int directory, const char *path, const char *key, FileScan *scan) {
+  if (!cache || !path || !key || !scan) {
+    return "Empty pointer received for the cache.";
+  }
+  const CacheEntry *candidate;
+  const CacheEntry *entry = lookup(cache, directory, path, key, &candidate);
+  if (entry && skips_binary_file(entry->binary)) {
+    memset(scan, 0, sizeof(FileScan));
+    return binary_file_skipped;
+  }
+  if (entry) {
+    return copy_file_scan(scan, &entry->scan);
+  }
+  bool examined;
+  char *error = examine_file(cache, directory, path, key, candidate, scan, &examined);
+  if (error || examined) {
+    return error;
+  }
+  return scan_path_at(directory, path, scan);
+}
+
+typedef struct merged_entry_struct {
+  const CacheEntry *entry;
+  size_t order;
+} MergedEntry;
+
+static int compare_merged(const void *left, const void *right) {
+  const MergedEntry *first = left;
+  const MergedEntry *second = right;
+  int result = strcmp(first->entry->path, second->entry->path);
+  if (result) {
+    return result;
+  }
+  return first->order < second->order ? -1 : first->order > second->order;
+}
+
+static char *write_index(const char *directory, MergedEntry *merged, size_t count) {
+  size_t written = 0;
+  for (size_t index = 0; index < count; index++) {
+    // Only the last record for every path counts, and removals are dropped.
+    bool superseded = index + 1 < count && strcmp(merged[index].entry->path, merged[index + 1].entry->path) == 0;
+    if (!superseded && !merged[index].entry->removed) {
+      merged[written++] = merged[index];
+    }
+  }
+
+  CacheBuffer buffer = {0};
+  put_bytes(&buffer, CACHE_MAGIC, CACHE_MAGIC_LENGTH);
+  put_number(&buffer, BUMP_CACHE_FORMAT);
+  put_number(&buffer, written);
+  for (size_t index = 0; index < written; index++) {
+    put_entry(&buffer, merged[index].entry);
+  }
+  if (buffer.failed) {
+    free(buffer.data);
+    return "Could not allocate memory for the cache index.";
+  }
+
+  // Readers never see a partly written index, because it is renamed into place.
+  char *index_path = join_cache_path(directory, BUMP_CACHE_INDEX);
+  char *temporary_path = join_cache_path(directory, BUMP_CACHE_INDEX ".XXXXXX");
+  char *error = NULL;
+  int descriptor = -1;
+  if (!index_path || !temporary_path) {
+    error = "Could not allocate memory for the cache index.";
+  } else if ((descriptor = mkstemp(temporary_path)) == -1) {
+    error = "Could not create a temporary cache index.";
+  } else {
+    FILE *output = fdopen(descriptor, "wb");
+    if (!output) {
+      close(descriptor);
+      error = "Could not write the cache index.";
+    } else {
+      if (fwrite(buffer.data, 1, buffer.length, output) != buffer.length) {
+        error = "Could not write the cache index.";
+      }
+      if (fclose(output) && !error) {
+        error = "Could not write the cache index.";
+      }
+    }
+    if (!error && rename(temporary_path, index_path)) {
+      error = "Could not replace the cache index.";
+    }
+    if (error) {
+      unlink(temporary_path);
+    }
+  }
+  free(index_path);
+  free(temporary_path);
+  free(buffer.data);
+  return error;
+}
+
+char *save_scan_cache(ScanCache *cache) {
+  if (!cache || !cache->directory) {
+    return "Empty pointer received for the cache.";
+  }
+  if (cache->update_count == 0) {
+    return NULL;
+  }
+
+  // Concurrent runs take turns, and each merges its updates into what the others saved.
+  char *lock_path = join_cache_path(cache->directory, BUMP_CACHE_LOCK);
+  int lock = lock_path ? open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0666) : -1;
+  free(lock_path);
+  if (lock == -1 || flock(lock, LOCK_EX)) {
+    if (lock != -1) {
+      close(lock);
+    }
+    return "Could not lock the cache.";
+  }
+
+  CacheEntry *current;
+  size_t current_count;
+  load_index(cache->directory, &current, &current_count);
+  size_t total = current_count + cache->update_count;
+  MergedEntry *merged = malloc(total * sizeof(MergedEntry));
+  char *error = NULL;
+  if (!merged) {
+    error = "Could not allocate memory for the cache index.";
+  } else {
+    for (size_t index = 0; index < current_count; index++) {
+      merged[index] = (MergedEntry) {&current[index], index};
+    }
+    for (size_t index = 0; index < cache->update_count; index++) {
+      merged[current_count + index] = (MergedEntry) {&cache->updates[index], current_count + index};
+    }
+    qsort(merged, total, sizeof(MergedEntry), compare_merged);
+    error = write_index(cache->directory, merged, total);
+  }
+  free(merged);
+  free_entries(current, current_count);
+  flock(lock, LOCK_UN);
+  close(lock);
+  return error;
+}
+
+void free_scan_cache(ScanCache *cache) {
+  if (!cache || !cache->directory) {
+    return;
+  }
+  free_entries(cache->entries, cache->count);
+  free_entries(cache->updates, cache->update_count);
+  free(cache->directory);
+  pthread_mutex_destroy(&cache->lock);
+  memset(cache, 0, sizeof(ScanCache));
+}
@@ -1,21 +1,580 @@
+// O_TMPFILE is a Linux extension.
+#define _GNU_SOURCE
+
 #include <bump/fileutil.h>
+#include <bump/stats.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <memory.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+bool file_is_valid(const char *path, bool for_input) {
+  // Only the permissions are checked, so that nothing is opened or truncated twice.
+  if (for_input || access(path, F_OK) == 0) {
+    return access(path, for_input ? R_OK : W_OK) == 0;
+  }
+  const char *slash = strrchr(path, '/');
+  if (!slash) {
+    return access(".", W_OK | X_OK) == 0;
+  }
+  size_t length = slash == path ? 1 : (size_t) (slash - path);
+  char *parent = malloc(length + 1);
+  if (!parent) {
+    return false;
+  }
+  memcpy(parent, path, length);
+  parent[length] = '\0';
+  bool result = access(parent, W_OK | X_OK) == 0;
+  free(parent);
+  return result;
+}
+
+FILE *open_file_at(int directory, const char *path, const char *mode) {
+  // Only the two modes used by the engine are supported.
+  int flags;
+  if (strcmp(mode, "r") == 0) {
+    flags = O_RDONLY;
+  } else if (strcmp(mode, "w") == 0) {
+    flags = O_WRONLY | O_CREAT | O_TRUNC;
+  } else {
+    return NULL;
+  }
+  int descriptor = openat(directory, path, flags | O_CLOEXEC, 0666);
+  thread_stats.system_calls++;
+  if (descriptor == -1) {
+    return NULL;
+  }
+  FILE *file = fdopen(descriptor, mode);
+  if (!file) {
+    close(descriptor);
+  }
+  return file;
+}
+
+char *inspect_file(int descriptor, struct stat *status) {
+  if (!status) {
+    return "Empty pointer for file status.";
+  }
+  thread_stats.system_calls++;
+  if (fstat(descriptor, status)) {
+    return "Could not query the input file.";
+  }
+  // Pipes, terminals and other special files must be read as streams.
+  if (!S_ISREG(status->st_mode)) {
+    return "The input is not a regular file.";
+  }
+  if ((uintmax_t) status->st_size > SIZE_MAX) {
+    return "The input file is too large to map.";
+  }
+  return NULL;
+}
+
+char *map_inspected_file(int descriptor, const struct stat *status, MappedFile *mapping) {
+  if (!status || !mapping) {
+    return "Empty pointer for mapping.";
+  }
+  mapping->data = "";
+  mapping->size = 0;
+  if (status->st_size <= 0) {
+    return NULL;
+  }
+
+  size_t size = (size_t) status->st_size;
+  void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+  thread_stats.system_calls++;
+  if (data == MAP_FAILED) {
+    return "Could not map the input file.";
+  }
+  // The file is read once from front to back, so aggressive read-ahead pays off.
+  madvise(data, size, MADV_SEQUENTIAL);
+  thread_stats.system_calls++;
+  thread_stats.bytes_read += size;
+
+  mapping->data = data;
+  mapping->size = size;
+  return NULL;
+}
+
+char *map_file(int descriptor, MappedFile *mapping) {
+  if (!mapping) {
+    return "Empty pointer for mapping.";
+  }
+  struct stat status;
+  char *error = inspect_file(descriptor, &status);
+  if (error) {
+    return error;
+  }
+  if (status.st_size <= 0) {
+    return "The input file is empty.";
+  }
+  return map_inspected_file(descriptor, &status, mapping);
+}
+
+void unmap_file(MappedFile *mapping) {
+  // Empty mappings point at a constant rather than at mapped memory.
+  if (mapping && mapping->data && mapping->size > 0) {
+    munmap((void *) mapping->data, mapping->size);
+    thread_stats.system_calls++;
+    mapping->data = NULL;
+    mapping->size = 0;
+  }
+}
+
+// Large enough for nearly every file that cannot be mapped; grown when not.
+#define STREAM_CHUNK 65536
+#define TEMPORARY_ATTEMPTS 100
+#define TEMPORARY_LETTERS 6
+// As many links as the kernel follows before it gives up with ELOOP.
+#define LINK_LIMIT 40
+
+static atomic_uint_fast64_t temporary_counter;
+
+/*
+ * Fills the letters of a temporary name in the same way as mkstemp(). The
+ * value only has to make collisions unlikely, since they are retried.
+ */
+static void fill_temporary_letters(char *letters) {
+  static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t value = (uint64_t) now.tv_nsec ^ ((uint64_t) now.tv_sec << 30) ^ ((uint64_t) getpid() << 40);
+  value += atomic_fetch_add(&temporary_counter, 1) * 0x9E3779B97F4A7C15u;
+  value ^= value >> 31;
+  value *= 0xBF58476D1CE4E5B9u;
+  value ^= value >> 29;
+  for (size_t index = 0; index < TEMPORARY_LETTERS; index++) {
+    letters[index] = alphabet[value % (sizeof(alphabet) - 1)];
+    value /= sizeof(alphabet) - 1;
+  }
+}
+
+/*
+ * Builds "<path>.XXXXXX<suffix>" and returns the offset of the letters.
+ * The suffix lets directory walks recognize files that are in progress.
+ */
+static char *allocate_temporary_path(const char *path, const char *suffix, size_t *letters) {
+  size_t path_length = strlen(path);
+  size_t suffix_length = strlen(suffix);
+  char *temporary_path = malloc(path_length + TEMPORARY_LETTERS + suffix_length + 2);
+  if (!temporary_path) {
+    return NULL;
+  }
+  memcpy(temporary_path, path, path_length);
+  temporary_path[path_length] = '.';
+  memcpy(temporary_path + path_length + 1 + TEMPORARY_LETTERS, suffix, suffix_length + 1);
+  *letters = path_length + 1;
+  return temporary_path;
+}
+
+#ifdef O_TMPFILE
+/*
+ * Creates an unnamed file in the directory that holds the path. It only
+ * gets a name once it is complete, so an interrupted run leaves nothing
+ * behind. It is readable in case it has to be copied to get that name.
+ */
+static int open_anonymous_file(int directory, const char *path, mode_t mode) {
+  const char *slash = strrchr(path, '/');
+  if (!slash) {
+    return openat(directory, ".", O_TMPFILE | O_RDWR | O_CLOEXEC, mode);
+  }
+  size_t length = slash == path ? 1 : (size_t) (slash - path);
+  char *parent = malloc(length + 1);
+  if (!parent) {
+    return -1;
+  }
+  memcpy(parent, path, length);
+  parent[length] = '\0';
+  int descriptor = openat(directory, parent, O_TMPFILE | O_RDWR | O_CLOEXEC, mode);
+  free(parent);
+  return descriptor;
+}
+#endif
 
-bool file_is_valid(const char *input_path, const char *mode) {
-  FILE *input_file = fopen(input_path, mode);
-  bool result = input_file != NULL;
-  if (result) {
-    if (ferror(input_file)) {
-      result = false;
+static int create_temporary_file(int directory, char *temporary_path, size_t letters, mode_t mode) {
+  for (size_t attempt = 0; attempt < TEMPORARY_ATTEMPTS; attempt++) {
+    fill_temporary_letters(temporary_path + letters);
+    int descriptor = openat(directory, temporary_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+    thread_stats.system_calls++;
+    if (descriptor != -1 || errno != EEXIST) {
+      return descriptor;
     }
-    int e = fclose(input_file);
-    if (e) {
-      result = false;
+  }
+  return -1;
+}
+
+/*
+ * Reads where a link points. Relative targets are taken from the
+ * directory that holds the link, as the kernel does.
+ */
+static char *read_link_target(int directory, const char *path, size_t size) {
+  const char *slash = strrchr(path, '/');
+  size_t prefix = slash ? (size_t) (slash - path) + 1 : 0;
+  // Links in /proc report no size, so some room is left for them.
+  size_t capacity = prefix + (size > 0 ? size : 256) + 1;
+  char *target = malloc(capacity);
+  if (!target) {
+    return NULL;
+  }
+  ssize_t length = readlinkat(directory, path, target + prefix, capacity - prefix);
+  thread_stats.system_calls++;
+  if (length <= 0 || (size_t) length >= capacity - prefix) {
+    // A link that changed under the read is reported like one that vanished.
+    errno = length == -1 ? errno : ENOENT;
+    free(target);
+    return NULL;
+  }
+  if (target[prefix] == '/') {
+    memmove(target, target + prefix, (size_t) length);
+    target[length] = '\0';
+  } else {
+    memcpy(target, path, prefix);
+    target[prefix + (size_t) length] = '\0';
+  }
+  return target;
+}
+
+/*
+ * Follows the path of a replacement through any symbolic links until it
+ * names something else, which is queried. Fails with errno set, and with
+ * ENOENT when the last link points nowhere, so that it can be created.
+ */
+static int follow_links(ReplacementFile *replacement, struct stat *status) {
+  for (size_t step = 0; step <= LINK_LIMIT; step++) {
+    thread_stats.system_calls++;
+    if (fstatat(replacement->directory, replacement->path, status, AT_SYMLINK_NOFOLLOW)) {
+      return -1;
+    }
+    if (!S_ISLNK(status->st_mode)) {
+      return 0;
     }
+    char *target = read_link_target(replacement->directory, replacement->path, (size_t) status->st_size);
+    if (!target) {
+      return -1;
+    }
+    free(replacement->resolved_path);
+    replacement->resolved_path = target;
+    replacement->path = target;
   }
-  return result;
+  errno = ELOOP;
+  return -1;
+}
+
+static void prepare_replacement(int directory, const char *path, const char *suffix, ReplacementFile *replacement) {
+  replacement->directory = directory;
+  replacement->path = path;
+  replacement->resolved_path = NULL;
+  replacement->suffix = suffix;
+  replacement->temporary_path = NULL;
+  replacement->descriptor = -1;
+  replacement->direct = false;
+}
+
+// Creates the new file with the given permissions, which the umask applies to.
+static char *create_replacement(ReplacementFile *replacement, mode_t mode) {
+#ifdef O_TMPFILE
+  replacement->descriptor = open_anonymous_file(replacement->directory, replacement->path, mode);
+  thread_stats.system_calls++;
+#endif
+  if (replacement->descriptor == -1) {
+    // Not every file system supports unnamed files, so fall back to a unique name.
+    size_t letters;
+    replacement->temporary_path = allocate_temporary_path(replacement->path, replacement->suffix, &letters);
+    if (!replacement->temporary_path) {
+      return "Could not allocate memory for the temporary file name.";
+    }
+    replacement->descriptor =
+        create_temporary_file(replacement->directory, replacement->temporary_path, letters, mode);
+    if (replacement->descriptor == -1) {
+      free(replacement->temporary_path);
+      replacement->temporary_path = NULL;
+      return "Could not create a temporary file next to the input.";
+    }
+  }
+  return NULL;
+}
+
+// Only privileged users can give files away, so the owner is kept where possible.
+static bool copy_permissions(int descriptor, const struct stat *status) {
+  bool foreign = status->st_uid != geteuid() || status->st_gid != getegid();
+  thread_stats.system_calls += foreign ? 2 : 1;
+  return !(foreign && fchown(descriptor, status->st_uid, status->st_gid) && errno != EPERM) &&
+         !fchmod(descriptor, status->st_mode & 07777);
+}
+
+static char *create_replacement_like(ReplacementFile *replacement, const struct stat *status) {
+  char *error = create_replacement(replacement, 0600);
+  if (error) {
+    return error;
+  }
+  if (!copy_permissions(replacement->descriptor, status)) {
+    discard_replacement_file(replacement);
+    return "Could not copy the permissions of the file to replace.";
+  }
+  return NULL;
+}
+
+char *open_replacement_file(int directory, const char *path, const char *suffix, ReplacementFile *replacement) {
+  if (!path || !suffix || !replacement) {
+    return "Empty pointer for replacement file.";
+  }
+  prepare_replacement(directory, path, suffix, replacement);
+  // Renaming over a symbolic link would replace the link rather than the file it points to.
+  struct stat status;
+  char *error = follow_links(replacement, &status) ? "Could not query the file to replace."
+                : !S_ISREG(status.st_mode)        ? "Only regular files can be rewritten in place."
+                                                  : create_replacement_like(replacement, &status);
+  if (error) {
+    discard_replacement_file(replacement);
+  }
+  return error;
+}
+
+char *open_output_file(int directory, const char *path, const char *suffix, ReplacementFile *output) {
+  if (!path || !suffix || !output) {
+    return "Empty pointer for output file.";
+  }
+  prepare_replacement(directory, path, suffix, output);
+  struct stat status;
+  char *error = NULL;
+  if (follow_links(output, &status)) {
+    // A new file, or the missing target of a link, gets the permissions it would have had if it were created directly.
+    error = errno == ENOENT ? create_replacement(output, 0666) : "Could not query the output file.";
+  } else if (S_ISREG(status.st_mode)) {
+    error = create_replacement_like(output, &status);
+  } else {
+    // Renaming would replace devices and pipes themselves, so they are written through.
+    output->direct = true;
+    output->descriptor = openat(directory, output->path, O_WRONLY | O_TRUNC | O_CLOEXEC);
+    thread_stats.system_calls++;
+    error = output->descriptor == -1 ? "Could open output stream" : NULL;
+  }
+  if (error) {
+    discard_replacement_file(output);
+  }
+  return error;
+}
+
+#ifdef O_TMPFILE
+/*
+ * Copies a complete unnamed file into the temporary file that has just
+ * been created under its name, which then takes its place. Only needed
+ * when the unnamed file cannot be linked.
+ */
+static char *copy_anonymous_file(ReplacementFile *replacement, size_t letters) {
+  struct stat status;
+  thread_stats.system_calls++;
+  if (fstat(replacement->descriptor, &status)) {
+    free(replacement->temporary_path);
+    replacement->temporary_path = NULL;
+    return "Could not query the temporary file.";
+  }
+  int copy = create_temporary_file(replacement->directory, replacement->temporary_path, letters, 0600);
+  if (copy == -1) {
+    free(replacement->temporary_path);
+    replacement->temporary_path = NULL;
+    return "Could not give the temporary file a name.";
+  }
+  char *buffer = malloc(STREAM_CHUNK);
+  char *error = buffer ? NULL : "Could not allocate memory for the temporary file.";
+  off_t offset = 0;
+  while (!error && offset < status.st_size) {
+    ssize_t length = pread(replacement->descriptor, buffer, STREAM_CHUNK, offset);
+    thread_stats.system_calls++;
+    if (length <= 0) {
+      error = "Could not read back the temporary file.";
+    } else {
+      thread_stats.system_calls++;
+      if (write(copy, buffer, (size_t) length) != length) {
+        error = "Could not copy the temporary file.";
+      }
+      offset += length;
+    }
+  }
+  free(buffer);
+  if (!error && !copy_permissions(copy, &status)) {
+    error = "Could not copy the permissions of the temporary file.";
+  }
+  // The copy takes the place of the unnamed file, and is removed with the replacement on failure.
+  close(replacement->descriptor);
+  thread_stats.system_calls++;
+  replacement->descriptor = copy;
+  return error;
+}
+
+static char *link_anonymous_file(ReplacementFile *replacement) {
+  char descriptor_path[32];
+  snprintf(descriptor_path, sizeof(descriptor_path), "/proc/self/fd/%d", replacement->descriptor);
+  size_t letters;
+  replacement->temporary_path = allocate_temporary_path(replacement->path, replacement->suffix, &letters);
+  if (!replacement->temporary_path) {
+    return "Could not allocate memory for the temporary file name.";
+  }
+  for (size_t attempt = 0; attempt < TEMPORARY_ATTEMPTS; attempt++) {
+    fill_temporary_letters(replacement->temporary_path + letters);
+    thread_stats.system_calls++;
+    int code = linkat(AT_FDCWD, descriptor_path, replacement->directory, replacement->temporary_path, AT_SYMLINK_FOLLOW);
+    if (code && errno == ENOENT) {
+      // Without /proc, the descriptor itself can be linked by privileged users.
+      thread_stats.system_calls++;
+      code = linkat(replacement->descriptor, "", replacement->directory, replacement->temporary_path, AT_EMPTY_PATH);
+    }
+    if (code == 0) {
+      return NULL;
+    }
+    if (errno != EEXIST) {
+      break;
+    }
+  }
+  // Nothing can name the file, so its contents are copied into one that has a name.
+  return copy_anonymous_file(replacement, letters);
+}
+#endif
+
+char *commit_replacement_file(ReplacementFile *replacement) {
+  if (!replacement) {
+    return "Empty pointer for replacement file.";
+  }
+  if (replacement->direct) {
+    int code = close(replacement->descriptor);
+    thread_stats.system_calls++;
+    replacement->descriptor = -1;
+    discard_replacement_file(replacement);
+    return code ? "Could not write to the output file." : NULL;
+  }
+  char *error = NULL;
+#ifdef O_TMPFILE
+  if (!replacement->temporary_path) {
+    // A file can only be renamed once it has a name of its own.
+    error = link_anonymous_file(replacement);
+  }
+#endif
+  if (!error) {
+    thread_stats.system_calls++;
+    if (renameat(replacement->directory, replacement->temporary_path, replacement->directory, replacement->path)) {
+      error = "Could not move the new file over the original.";
+    }
+  }
+  if (!error) {
+    free(replacement->temporary_path);
+    replacement->temporary_path = NULL;
+  }
+  discard_replacement_file(replacement);
+  return error;
+}
+
+void discard_replacement_file(ReplacementFile *replacement) {
+  if (!replacement) {
+    return;
+  }
+  if (replacement->descriptor != -1) {
+    close(replacement->descriptor);
+    thread_stats.system_calls++;
+    replacement->descriptor = -1;
+  }
+  if (replacement->temporary_path) {
+    unlinkat(replacement->directory, replacement->temporary_path, 0);
+    thread_stats.system_calls++;
+    free(replacement->temporary_path);
+    replacement->temporary_path = NULL;
+  }
+  if (replacement->resolved_path) {
+    replacement->path = NULL;
+    free(replacement->resolved_path);
+    replacement->resolved_path = NULL;
+  }
+}
+
+char *read_stream(FILE *input, char **data, size_t *size) {
+  size_t capacity = 0;
+  *data = NULL;
+  *size = 0;
+  while (true) {
+    if (*size == capacity) {
+      capacity = capacity ? capacity * 2 : STREAM_CHUNK;
+      char *resized = realloc(*data, capacity);
+      if (!resized) {
+        free(*data);
+        return "Could not allocate memory for the input.";
+      }
+      *data = resized;
+    }
+    *size += fread(*data + *size, 1, capacity - *size, input);
+    if (ferror(input)) {
+      free(*data);
+      return "An I/O error occurred while trying to read input file.";
+    }
+    if (feof(input)) {
+      return NULL;
+    }
+  }
+}
+
+char *read_file_list(FILE *input, char separator, FileList *list) {
+  if (!input || !list) {
+    return "Empty pointer received for the file list.";
+  }
+  list->paths = NULL;
+  list->count = 0;
+  size_t size;
+  char *error = read_stream(input, &list->data, &size);
+  if (error) {
+    list->data = NULL;
+    return error;
+  }
+
+  // The separators become terminators, so every path points into the list itself.
+  size_t entries = 0;
+  for (size_t index = 0; index < size; index++) {
+    entries += list->data[index] == separator;
+  }
+  char *resized = realloc(list->data, size + 1);
+  list->paths = calloc(entries + 1, sizeof(const char *));
+  if (!resized || !list->paths) {
+    free(resized ? resized : list->data);
+    free(list->paths);
+    list->data = NULL;
+    list->paths = NULL;
+    return "Could not allocate memory for the file list.";
+  }
+  list->data = resized;
+  list->data[size] = separator;
+  size_t start = 0;
+  for (size_t index = 0; index <= size; index++) {
+    if (list->data[index] != separator) {
+      continue;
+    }
+    size_t end = index;
+    // Manifests written on Windows end their lines with a carriage return.
+    if (separator == '\n' && end > start && list->data[end - 1] == '\r') {
+      end--;
+    }
+    list->data[end] = '\0';
+    list->data[index] = '\0';
+    if (end > start) {
+      list->paths[list->count++] = list->data + start;
+    }
+    start = index + 1;
+  }
+  return NULL;
+}
+
+void free_file_list(FileList *list) {
+  if (!list) {
+    return;
+  }
+  free(list->data);
+  free(list->paths);
+  list->data = NULL;
+  list->paths = NULL;
+  list->count = 0;
 }
 
 static char *validate(FILE *input, const char *buffer) {
@@ -36,7 +595,6 @@ char *read_line(FILE *input, char *buffer, size_t *length, size_t limit) {
 
   int ch = EOF;
   *length = 0;
-  memset(buffer, 0, limit);
 
   while (*length < limit && (ch = fgetc(input)) != '\n' && ch != EOF) {
     buffer[*length] = (char) ch;
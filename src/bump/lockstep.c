@@ -0,0 +1,197 @@
+#include <bump/lockstep.h>
+#include <stdlib.h>
+#include <string.h>
+
+// The minor and patch components each take half of the low word of a key.
+#define KEY_COMPONENT_LIMIT ((uint64_t) 1 << 32)
+
+static char *parse_component(const char *digits, size_t length, size_t *value) {
+  *value = 0;
+  for (size_t index = 0; index < length; index++) {
+    size_t digit = (size_t) (digits[index] - '0');
+    if (*value > (SIZE_MAX - digit) / 10) {
+      return "A version component is too large to compare.";
+    }
+    *value = *value * 10 + digit;
+  }
+  return NULL;
+}
+
+char *parse_version(const char *input, const VersionSpan *span, Version *version) {
+  if (!input || !span || !version) {
+    return "Empty pointer received for the version.";
+  }
+  size_t *components[3] = {&version->major, &version->minor, &version->patch};
+  for (size_t index = 0; index < 3; index++) {
+    char *error = parse_component(input + span->starts[index], span->ends[index] - span->starts[index], components[index]);
+    if (error) {
+      return error;
+    }
+  }
+  return NULL;
+}
+
+char *pack_version_key(const Version *version, VersionKey *key) {
+  if (!version || !key) {
+    return "Empty pointer received for the version key.";
+  }
+  if ((uint64_t) version->minor >= KEY_COMPONENT_LIMIT || (uint64_t) version->patch >= KEY_COMPONENT_LIMIT) {
+    return "A version component is too large to compare.";
+  }
+  key->high = (uint64_t) version->major;
+  key->low = (uint64_t) version->minor << 32 | (uint64_t) version->patch;
+  return NULL;
+}
+
+void unpack_version_key(VersionKey key, Version *version) {
+  version->major = (size_t) key.high;
+  version->minor = (size_t) (key.low >> 32);
+  version->patch = (size_t) (key.low & (KEY_COMPONENT_LIMIT - 1));
+}
+
+bool version_key_less(VersionKey left, VersionKey right) {
+  return left.high < right.high || (left.high == right.high && left.low < right.low);
+}
+
+// Leaves at least one digit, so that a zero stays a zero.
+static void skip_leading_zeros(const char **digits, size_t *length) {
+  while (*length > 1 && **digits == '0') {
+    (*digits)++;
+    (*length)--;
+  }
+}
+
+static int compare_digits(const char *left, size_t left_length, const char *right, size_t right_length) {
+  skip_leading_zeros(&left, &left_length);
+  skip_leading_zeros(&right, &right_length);
+  if (left_length != right_length) {
+    return left_length < right_length ? -1 : 1;
+  }
+  return memcmp(left, right, left_length);
+}
+
+int compare_version_digits(const char *left, const VersionSpan *left_span, const char *right, const VersionSpan *right_span) {
+  for (size_t index = 0; index < 3; index++) {
+    int order = compare_digits(left + left_span->starts[index],
+                               left_span->ends[index] - left_span->starts[index],
+                               right + right_span->starts[index],
+                               right_span->ends[index] - right_span->starts[index]);
+    if (order != 0) {
+      return order;
+    }
+  }
+  return 0;
+}
+
+char *initialize_highest_version(HighestVersion *highest) {
+  if (!highest) {
+    return "Empty pointer received for the highest version.";
+  }
+  if (pthread_mutex_init(&highest->lock, NULL)) {
+    return "Could not initialize the lock of the highest version.";
+  }
+  highest->key.high = 0;
+  highest->key.low = 0;
+  highest->packed = true;
+  highest->text = NULL;
+  highest->capacity = 0;
+  highest->found = false;
+  return NULL;
+}
+
+// Copies the digits of a version without their leading zeros. Called with the lock held.
+static char *store_highest_version(HighestVersion *highest, const char *input, const VersionSpan *span) {
+  const char *digits[3];
+  size_t lengths[3];
+  size_t length = 2;
+  for (size_t index = 0; index < 3; index++) {
+    digits[index] = input + span->starts[index];
+    lengths[index] = span->ends[index] - span->starts[index];
+    skip_leading_zeros(&digits[index], &lengths[index]);
+    length += lengths[index];
+  }
+  if (length > highest->capacity) {
+    char *text = realloc(highest->text, length);
+    if (!text) {
+      return "Could not allocate memory for the highest version.";
+    }
+    highest->text = text;
+    highest->capacity = length;
+  }
+  size_t offset = 0;
+  for (size_t index = 0; index < 3; index++) {
+    if (index > 0) {
+      highest->text[offset++] = '.';
+    }
+    highest->span.starts[index] = offset;
+    memcpy(highest->text + offset, digits[index], lengths[index]);
+    offset += lengths[index];
+    highest->span.ends[index] = offset;
+  }
+  return NULL;
+}
+
+char *merge_highest_version(HighestVersion *highest, const FileScan *scan) {
+  if (!highest || !scan) {
+    return "Empty pointer received for the highest version.";
+  }
+  if (scan->count == 0) {
+    return NULL;
+  }
+  // The keys order the versions until one of them does not fit, and their digits order them then.
+  const VersionSpan *maximum = NULL;
+  VersionKey maximum_key = {0, 0};
+  bool packed = true;
+  for (size_t index = 0; index < scan->count; index++) {
+    const VersionSpan *span = &scan->matches[index].span;
+    Version version;
+    VersionKey key = {0, 0};
+    bool fits = !parse_version(scan->text, span, &version) && !pack_version_key(&version, &key);
+    if (!maximum || (packed && fits ? version_key_less(maximum_key, key)
+                                    : compare_version_digits(scan->text, maximum, scan->text, span) < 0)) {
+      maximum = span;
+      maximum_key = key;
+      packed = fits;
+    }
+  }
+
+  char *error = NULL;
+  pthread_mutex_lock(&highest->lock);
+  if (!highest->found || (highest->packed && packed ? version_key_less(highest->key, maximum_key)
+                                                    : compare_version_digits(highest->text, &highest->span, scan->text, maximum) < 0)) {
+    error = store_highest_version(highest, scan->text, maximum);
+    if (!error) {
+      highest->key = maximum_key;
+      highest->packed = packed;
+      highest->found = true;
+    }
+  }
+  pthread_mutex_unlock(&highest->lock);
+  return error;
+}
+
+char *bump_highest_version(HighestVersion *highest, BumpLevel level, char *target, size_t capacity, bool *found) {
+  if (!highest || !target || !found) {
+    return "Empty pointer received for the highest version.";
+  }
+  char *error = NULL;
+  pthread_mutex_lock(&highest->lock);
+  *found = highest->found;
+  // A bump adds at most one digit, and the terminator takes one more character.
+  if (*found && highest->span.ends[2] + 2 > capacity) {
+    error = "The highest version is too long to become the target.";
+  } else if (*found) {
+    size_t length = format_bumped_version(highest->text, &highest->span, level, target);
+    target[length] = '\0';
+  }
+  pthread_mutex_unlock(&highest->lock);
+  return error;
+}
+
+void free_highest_version(HighestVersion *highest) {
+  if (highest) {
+    pthread_mutex_destroy(&highest->lock);
+    free(highest->text);
+    highest->text = NULL;
+  }
+}
@@ -0,0 +1,426 @@
+#include <bump/matcher.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NO_PATTERN SIZE_MAX
+
+char *initialize_pattern_set(PatternSet *set) {
+  if (!set) {
+    return "Null pointer received for PatternSet";
+  }
+  set->patterns = NULL;
+  set->count = 0;
+  set->capacity = 0;
+  set->literal_table = NULL;
+  set->literal_capacity = 0;
+  return NULL;
+}
+
+static bool has_wildcard(const char *text, size_t length) {
+  for (size_t index = 0; index < length; index++) {
+    char c = text[index];
+    if (c == '*' || c == '?' || c == '[' || c == '\\') {
+      return true;
+    }
+  }
+  return false;
+}
+
+char *add_pattern(PatternSet *set, const char *pattern, size_t length) {
+  if (!set || !pattern) {
+    return "Null pointer received for pattern";
+  }
+
+  // Trailing whitespace is ignored unless it is escaped with a backslash.
+  while (length > 0) {
+    char c = pattern[length - 1];
+    bool blank = c == '\r' || c == '\n' || c == ' ' || c == '\t';
+    if (!blank || (length > 1 && pattern[length - 2] == '\\')) {
+      break;
+    }
+    length--;
+  }
+  if (length == 0 || pattern[0] == '#') {
+    return NULL;
+  }
+
+  unsigned flags = 0;
+  if (pattern[0] == '!') {
+    flags |= PATTERN_NEGATED;
+    pattern++;
+    length--;
+  } else if (length > 1 && pattern[0] == '\\' && (pattern[1] == '#' || pattern[1] == '!')) {
+    pattern++;
+    length--;
+  }
+  if (length > 0 && pattern[length - 1] == '/') {
+    flags |= PATTERN_DIRECTORY_ONLY;
+    length--;
+  }
+  if (length > 0 && pattern[0] == '/') {
+    flags |= PATTERN_ANCHORED;
+    pattern++;
+    length--;
+  }
+  if (length == 0) {
+    return NULL;
+  }
+  // A separator anywhere else also ties the pattern to the directory of the ignore file.
+  if (memchr(pattern, '/', length)) {
+    flags |= PATTERN_ANCHORED;
+  }
+
+  PatternKind kind = PATTERN_GLOB;
+  if (!has_wildcard(pattern, length)) {
+    kind = PATTERN_LITERAL;
+  } else if (!(flags & PATTERN_ANCHORED) && pattern[0] == '*' && !has_wildcard(pattern + 1, length - 1)) {
+    kind = PATTERN_SUFFIX;
+  }
+
+  if (set->count == set->capacity) {
+    size_t capacity = set->capacity ? set->capacity * 2 : 16;
+    Pattern *patterns = realloc(set->patterns, capacity * sizeof(Pattern));
+    if (!patterns) {
+      return "Could not allocate memory for patterns";
+    }
+    set->patterns = patterns;
+    set->capacity = capacity;
+  }
+  char *text = malloc(length + 1);
+  if (!text) {
+    return "Could not allocate memory for pattern";
+  }
+  memcpy(text, pattern, length);
+  text[length] = '\0';
+
+  Pattern *entry = &set->patterns[set->count++];
+  entry->text = text;
+  entry->length = length;
+  entry->flags = flags;
+  entry->kind = kind;
+  entry->hashed = false;
+  return NULL;
+}
+
+char *load_pattern_file(PatternSet *set, int directory, const char *name) {
+  int descriptor = openat(directory, name, O_RDONLY | O_CLOEXEC);
+  if (descriptor == -1) {
+    return "Could not open ignore file";
+  }
+  struct stat status;
+  if (fstat(descriptor, &status) || !S_ISREG(status.st_mode)) {
+    close(descriptor);
+    return "Ignore file is not a regular file";
+  }
+
+  size_t size = (size_t) status.st_size;
+  char *contents = malloc(size + 1);
+  if (!contents) {
+    close(descriptor);
+    return "Could not allocate memory for ignore file";
+  }
+  size_t filled = 0;
+  while (filled < size) {
+    ssize_t count = read(descriptor, contents + filled, size - filled);
+    if (count <= 0) {
+      break;
+    }
+    filled += (size_t) count;
+  }
+  close(descriptor);
+
+  char *error = NULL;
+  const char *line = contents;
+  const char *end = contents + filled;
+  while (line < end && !error) {
+    const char *newline = memchr(line, '\n', (size_t) (end - line));
+    const char *line_end = newline ? newline : end;
+    error = add_pattern(set, line, (size_t) (line_end - line));
+    line = line_end + 1;
+  }
+  free(contents);
+  return error;
+}
+
+static size_t hash_name(const char *text, size_t length) {
+  // FNV-1a
+  uint64_t hash = 14695981039346656037u;
+  for (size_t index = 0; index < length; index++) {
+    hash ^= (unsigned char) text[index];
+    hash *= 1099511628211u;
+  }
+  return (size_t) hash;
+}
+
+static size_t find_literal(const PatternSet *set, const char *name, size_t length) {
+  if (set->literal_capacity == 0) {
+    return NO_PATTERN;
+  }
+  size_t mask = set->literal_capacity - 1;
+  for (size_t slot = hash_name(name, length) & mask;; slot = (slot + 1) & mask) {
+    size_t entry = set->literal_table[slot];
+    if (entry == 0) {
+      return NO_PATTERN;
+    }
+    const Pattern *pattern = &set->patterns[entry - 1];
+    if (pattern->length == length && memcmp(pattern->text, name, length) == 0) {
+      return entry - 1;
+    }
+  }
+}
+
+char *compile_pattern_set(PatternSet *set) {
+  if (!set) {
+    return "Null pointer received for PatternSet";
+  }
+  free(set->literal_table);
+  set->literal_table = NULL;
+  set->literal_capacity = 0;
+
+  size_t literal_count = 0;
+  for (size_t index = 0; index < set->count; index++) {
+    set->patterns[index].hashed = false;
+    if (set->patterns[index].kind == PATTERN_LITERAL && !(set->patterns[index].flags & PATTERN_ANCHORED)) {
+      literal_count++;
+    }
+  }
+  if (literal_count == 0) {
+    return NULL;
+  }
+
+  size_t capacity = 8;
+  while (capacity < literal_count * 2) {
+    capacity *= 2;
+  }
+  set->literal_table = calloc(capacity, sizeof(size_t));
+  if (!set->literal_table) {
+    return "Could not allocate memory for pattern table";
+  }
+  set->literal_capacity = capacity;
+
+  // Walk backwards so that only the last occurrence of a name is hashed.
+  // Earlier duplicates stay in the ordinary list where precedence still applies.
+  for (size_t index = set->count; index-- > 0;) {
+    Pattern *pattern = &set->patterns[index];
+    if (pattern->kind != PATTERN_LITERAL || (pattern->flags & PATTERN_ANCHORED)) {
+      continue;
+    }
+    if (find_literal(set, pattern->text, pattern->length) != NO_PATTERN) {
+      continue;
+    }
+    size_t mask = capacity - 1;
+    size_t slot = hash_name(pattern->text, pattern->length) & mask;
+    while (set->literal_table[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    set->literal_table[slot] = index + 1;
+    pattern->hashed = true;
+  }
+  return NULL;
+}
+
+static bool class_matches(const char **pattern, const char *pattern_end, char c) {
+  const char *p = *pattern + 1;
+  bool negated = p < pattern_end && (*p == '!' || *p == '^');
+  if (negated) {
+    p++;
+  }
+  bool matched = false;
+  bool first = true;
+  while (p < pattern_end && (*p != ']' || first)) {
+    char low = *p;
+    if (p + 2 < pattern_end && p[1] == '-' && p[2] != ']') {
+      if (low <= c && c <= p[2]) {
+        matched = true;
+      }
+      p += 3;
+    } else {
+      if (low == c) {
+        matched = true;
+      }
+      p++;
+    }
+    first = false;
+  }
+  if (p == pattern_end) {
+    // An unterminated class is matched as a literal bracket.
+    *pattern += 1;
+    return c == '[';
+  }
+  *pattern = p + 1;
+  return matched != negated;
+}
+
+static bool match_glob(const char *p, const char *pattern_end, const char *t, const char *text_end) {
+  while (p < pattern_end) {
+    char c = *p;
+    if (c == '*') {
+      if (p + 1 < pattern_end && p[1] == '*') {
+        p += 2;
+        if (p < pattern_end && *p == '/') {
+          // "**/" matches zero or more leading directories.
+          p++;
+          if (match_glob(p, pattern_end, t, text_end)) {
+            return true;
+          }
+          for (const char *s = t; s < text_end; s++) {
+            if (*s == '/' && match_glob(p, pattern_end, s + 1, text_end)) {
+              return true;
+            }
+          }
+          return false;
+        }
+        // Any other "**" matches across directory separators.
+        for (const char *s = t; s <= text_end; s++) {
+          if (match_glob(p, pattern_end, s, text_end)) {
+            return true;
+          }
+        }
+        return false;
+      }
+      p++;
+      for (const char *s = t;; s++) {
+        if (match_glob(p, pattern_end, s, text_end)) {
+          return true;
+        }
+        if (s == text_end || *s == '/') {
+          return false;
+        }
+      }
+    }
+    if (t == text_end) {
+      return false;
+    }
+    if (c == '?') {
+      if (*t == '/') {
+        return false;
+      }
+      p++;
+    } else if (c == '[') {
+      if (*t == '/' || !class_matches(&p, pattern_end, *t)) {
+        return false;
+      }
+    } else {
+      if (c == '\\' && p + 1 < pattern_end) {
+        p++;
+        c = *p;
+      }
+      if (c != *t) {
+        return false;
+      }
+      p++;
+    }
+    t++;
+  }
+  return t == text_end;
+}
+
+bool glob_matches(const char *pattern, size_t pattern_length, const char *text, size_t text_length) {
+  return match_glob(pattern, pattern + pattern_length, text, text + text_length);
+}
+
+static bool pattern_applies(const Pattern *pattern, const char *relative_path, const char *name) {
+  const char *target = pattern->flags & PATTERN_ANCHORED ? relative_path : name;
+  size_t length = strlen(target);
+  switch (pattern->kind) {
+    case PATTERN_LITERAL:
+      return length == pattern->length && memcmp(target, pattern->text, length) == 0;
+    case PATTERN_SUFFIX:
+      return length >= pattern->length - 1 &&
+             memcmp(target + length - (pattern->length - 1), pattern->text + 1, pattern->length - 1) == 0;
+    case PATTERN_GLOB:
+      return glob_matches(pattern->text, pattern->length, target, length);
+  }
+  return false;
+}
+
+static PatternMatch outcome(const Pattern *pattern) {
+  return pattern->flags & PATTERN_NEGATED ? PATTERN_REINCLUDED : PATTERN_MATCHED;
+}
+
+PatternMatch match_pattern_set(const PatternSet *set,
+                               const char *relative_path,
+                               const char *name,
+                               bool is_directory) {
+  if (!set || set->count == 0) {
+    return PATTERN_UNMATCHED;
+  }
+
+  size_t literal = find_literal(set, name, strlen(name));
+  if (literal != NO_PATTERN && (set->patterns[literal].flags & PATTERN_DIRECTORY_ONLY) && !is_directory) {
+    literal = NO_PATTERN;
+  }
+
+  // Only patterns after the hashed match can override it.
+  for (size_t index = set->count; index-- > 0;) {
+    if (literal != NO_PATTERN && index <= literal) {
+      break;
+    }
+    const Pattern *pattern = &set->patterns[index];
+    if (pattern->hashed) {
+      continue;
+    }
+    if ((pattern->flags & PATTERN_DIRECTORY_ONLY) && !is_directory) {
+      continue;
+    }
+    if (pattern_applies(pattern, relative_path, name)) {
+      return outcome(pattern);
+    }
+  }
+  return literal == NO_PATTERN ? PATTERN_UNMATCHED : outcome(&set->patterns[literal]);
+}
+
+void free_pattern_set(PatternSet *set) {
+  if (!set) {
+    return;
+  }
+  for (size_t index = 0; index < set->count; index++) {
+    free(set->patterns[index].text);
+  }
+  free(set->patterns);
+  free(set->literal_table);
+  initialize_pattern_set(set);
+}
+
+IgnoreScope *create_ignore_scope(IgnoreScope *parent, size_t base_length) {
+  IgnoreScope *scope = malloc(sizeof(IgnoreScope));
+  if (!scope) {
+    return NULL;
+  }
+  initialize_pattern_set(&scope->patterns);
+  scope->base_length = base_length;
+  scope->parent = acquire_ignore_scope(parent);
+  atomic_init(&scope->references, 1);
+  return scope;
+}
+
+IgnoreScope *acquire_ignore_scope(IgnoreScope *scope) {
+  if (scope) {
+    atomic_fetch_add(&scope->references, 1);
+  }
+  return scope;
+}
+
+void release_ignore_scope(IgnoreScope *scope) {
+  while (scope && atomic_fetch_sub(&scope->references, 1) == 1) {
+    IgnoreScope *parent = scope->parent;
+    free_pattern_set(&scope->patterns);
+    free(scope);
+    scope = parent;
+  }
+}
+
+bool ignore_scope_excludes(const IgnoreScope *scope, const char *relative_path, const char *name, bool is_directory) {
+  for (; scope; scope = scope->parent) {
+    // Patterns are relative to the directory that holds the ignore file.
+    const char *path = scope->base_length ? relative_path + scope->base_length + 1 : relative_path;
+    PatternMatch match = match_pattern_set(&scope->patterns, path, name, is_directory);
+    if (match != PATTERN_UNMATCHED) {
+      return match == PATTERN_MATCHED;
+    }
+  }
+  return false;
+}
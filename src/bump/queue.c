@@ -0,0 +1,73 @@
+#include <bump/queue.h>
+#include <sched.h>
+
+// Attempts made before a consumer parks, which covers a producer that is about to push.
+#define QUEUE_SPINS 64
+
+char *initialize_queue(SpscQueue *queue, size_t capacity) {
+  if (!queue || capacity == 0) {
+    return "Invalid arguments received for the queue.";
+  }
+  size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  queue->items = calloc(size, sizeof(void *));
+  if (!queue->items) {
+    return "Could not allocate memory for the queue.";
+  }
+  queue->mask = size - 1;
+  atomic_init(&queue->head, 0);
+  atomic_init(&queue->tail, 0);
+  atomic_init(&queue->waiting, 0);
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->changed, NULL);
+  return NULL;
+}
+
+bool push_queue(SpscQueue *queue, void *item) {
+  size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+  if (tail - atomic_load_explicit(&queue->head, memory_order_acquire) > queue->mask) {
+    return false;
+  }
+  queue->items[tail & queue->mask] = item;
+  atomic_store(&queue->tail, tail + 1);
+  // Both sides use sequentially consistent accesses here, so either the
+  // consumer sees the new item before it sleeps, or it is seen sleeping.
+  if (atomic_load(&queue->waiting)) {
+    pthread_mutex_lock(&queue->lock);
+    pthread_cond_signal(&queue->changed);
+    pthread_mutex_unlock(&queue->lock);
+  }
+  return true;
+}
+
+void *pop_queue(SpscQueue *queue) {
+  size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+  for (size_t spin = 0; atomic_load(&queue->tail) == head; spin++) {
+    if (spin < QUEUE_SPINS) {
+      sched_yield();
+      continue;
+    }
+    pthread_mutex_lock(&queue->lock);
+    atomic_store(&queue->waiting, 1);
+    while (atomic_load(&queue->tail) == head) {
+      pthread_cond_wait(&queue->changed, &queue->lock);
+    }
+    atomic_store(&queue->waiting, 0);
+    pthread_mutex_unlock(&queue->lock);
+  }
+  void *item = queue->items[head & queue->mask];
+  atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+  return item;
+}
+
+void free_queue(SpscQueue *queue) {
+  if (!queue || !queue->items) {
+    return;
+  }
+  free(queue->items);
+  queue->items = NULL;
+  pthread_cond_destroy(&queue->changed);
+  pthread_mutex_destroy(&queue->lock);
+}
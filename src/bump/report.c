@@ -0,0 +1,274 @@
+#include <bump/fileutil.h>
+#include <bump/report.h>
+#include <bump/stats.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static const char *const level_names[] = {"major", "minor", "patch"};
+
+char *parse_report_format(const char *name, ReportFormat *format) {
+  if (!name || !format) {
+    return "Empty pointer received for the report format.";
+  }
+  if (strcmp(name, "text") == 0) {
+    *format = REPORT_TEXT;
+  } else if (strcmp(name, "json") == 0) {
+    *format = REPORT_JSON;
+  } else {
+    return "Unrecognised report format. Valid formats are text and json.";
+  }
+  return NULL;
+}
+
+static char *add_match(FileScan *scan, const char *data, const VersionSpan *span, size_t line, size_t line_start) {
+  if (scan->count == scan->capacity) {
+    size_t capacity = scan->capacity ? scan->capacity * 2 : 16;
+    VersionMatch *matches = realloc(scan->matches, capacity * sizeof(VersionMatch));
+    if (!matches) {
+      return "Could not allocate memory for the scan results.";
+    }
+    scan->matches = matches;
+    scan->capacity = capacity;
+  }
+  size_t length = span->ends[2] - span->starts[0];
+  if (scan->text_length + length > scan->text_capacity) {
+    size_t capacity = scan->text_capacity ? scan->text_capacity * 2 : 256;
+    while (capacity < scan->text_length + length) {
+      capacity *= 2;
+    }
+    char *text = realloc(scan->text, capacity);
+    if (!text) {
+      return "Could not allocate memory for the scan results.";
+    }
+    scan->text = text;
+    scan->text_capacity = capacity;
+  }
+
+  // The original text is kept, so the report can be written once the file is closed.
+  VersionMatch *match = &scan->matches[scan->count++];
+  match->offset = span->starts[0];
+  match->line = line;
+  match->column = span->starts[0] - line_start + 1;
+  for (size_t index = 0; index < 3; index++) {
+    match->span.starts[index] = span->starts[index] - span->starts[0] + scan->text_length;
+    match->span.ends[index] = span->ends[index] - span->starts[0] + scan->text_length;
+  }
+  memcpy(scan->text + scan->text_length, data + span->starts[0], length);
+  scan->text_length += length;
+  return NULL;
+}
+
+char *scan_buffer(const char *data, size_t size, FileScan *scan) {
+  if (!data && size > 0) {
+    return "Empty pointer received for the data to scan.";
+  }
+  if (!scan) {
+    return "Empty pointer received for the scan.";
+  }
+  memset(scan, 0, sizeof(FileScan));
+
+  size_t line = 1;
+  size_t line_start = 0;
+  size_t from = 0;
+  VersionSpan span;
+  while (find_next_version(data, from, size, &span)) {
+    // Lines are only counted up to each version, so text without versions is never looked at twice.
+    const char *newline;
+    while ((newline = memchr(data + line_start, '\n', span.starts[0] - line_start))) {
+      line++;
+      line_start = (size_t) (newline - data) + 1;
+    }
+    char *error = add_match(scan, data, &span, line, line_start);
+    if (error) {
+      free_file_scan(scan);
+      return error;
+    }
+    from = span.ends[2];
+  }
+  return NULL;
+}
+
+char *scan_file_contents(const char *data, size_t size, FileScan *scan) {
+  if (!scan) {
+    return "Empty pointer received for the scan.";
+  }
+  if (size > 0 && is_skipped_binary(data, size)) {
+    memset(scan, 0, sizeof(FileScan));
+    return binary_file_skipped;
+  }
+  thread_stats.lines += stats_enabled ? count_lines(data, size) : 0;
+  return scan_buffer(data, size, scan);
+}
+
+char *scan_path_at(int directory, const char *path, FileScan *scan) {
+  if (!path || !scan) {
+    return "Empty pointer received for the scan.";
+  }
+  FILE *input = open_file_at(directory, path, "r");
+  if (!input) {
+    return "Could open input stream";
+  }
+  thread_stats.files++;
+
+  char *error;
+  MappedFile mapping;
+  if (map_file(fileno(input), &mapping) == NULL) {
+    error = scan_file_contents(mapping.data, mapping.size, scan);
+    unmap_file(&mapping);
+  } else {
+    char *data;
+    size_t size;
+    error = read_stream(input, &data, &size);
+    thread_stats.bytes_read += error ? 0 : size;
+    if (!error) {
+      error = scan_file_contents(data, size, scan);
+      free(data);
+    }
+  }
+  fclose(input);
+  thread_stats.system_calls++;
+  return error;
+}
+
+char *scan_path(const char *path, FileScan *scan) {
+  return scan_path_at(AT_FDCWD, path, scan);
+}
+
+void write_json_string(FILE *output, const char *text) {
+  fputc('"', output);
+  for (const unsigned char *c = (const unsigned char *) text; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(output, "\\%c", *c);
+    } else if (*c < 0x20) {
+      fprintf(output, "\\u%04x", *c);
+    } else {
+      fputc(*c, output);
+    }
+  }
+  fputc('"', output);
+}
+
+static char *write_json_report(FILE *output,
+                               const char *path,
+                               const char *error,
+                               const FileScan *scan,
+                               BumpLevel level) {
+  // A bumped version is at most one character longer than the original.
+  char *bumped = error ? NULL : malloc(bumped_length_limit(scan->text_length));
+  if (!error && !bumped) {
+    return "Could not allocate memory for the report.";
+  }
+  fputs("{\"path\":", output);
+  write_json_string(output, path);
+  if (error) {
+    fputs(",\"error\":", output);
+    write_json_string(output, error);
+    fputs("}\n", output);
+    return NULL;
+  }
+
+  fputs(",\"versions\":[", output);
+  for (size_t index = 0; index < scan->count; index++) {
+    const VersionMatch *match = &scan->matches[index];
+    size_t start = match->span.starts[0];
+    fprintf(output,
+            "%s{\"offset\":%zu,\"line\":%zu,\"column\":%zu,\"text\":\"%.*s\"",
+            index ? "," : "",
+            match->offset,
+            match->line,
+            match->column,
+            (int) (match->span.ends[2] - start),
+            scan->text + start);
+    for (int named = BUMP_MAJOR; named <= BUMP_PATCH; named++) {
+      size_t length = format_bumped_version(scan->text, &match->span, (BumpLevel) named, bumped);
+      fprintf(output, ",\"%s\":\"%.*s\"", level_names[named], (int) length, bumped);
+    }
+    // A configured target is what the run would actually write.
+    if (level == BUMP_TARGET) {
+      size_t length = format_bumped_version(scan->text, &match->span, level, bumped);
+      fprintf(output, ",\"target\":\"%.*s\"", (int) length, bumped);
+    }
+    fputc('}', output);
+  }
+  fputs("]}\n", output);
+  free(bumped);
+  return NULL;
+}
+
+static char *write_text_report(FILE *output, const char *path, const FileScan *scan, BumpLevel level) {
+  char *bumped = malloc(bumped_length_limit(scan->text_length));
+  if (!bumped) {
+    return "Could not allocate memory for the report.";
+  }
+  for (size_t index = 0; index < scan->count; index++) {
+    const VersionMatch *match = &scan->matches[index];
+    size_t start = match->span.starts[0];
+    size_t length = format_bumped_version(scan->text, &match->span, level, bumped);
+    fprintf(output,
+            "%s:%zu:%zu: %.*s -> %.*s\n",
+            path,
+            match->line,
+            match->column,
+            (int) (match->span.ends[2] - start),
+            scan->text + start,
+            (int) length,
+            bumped);
+  }
+  free(bumped);
+  return NULL;
+}
+
+char *write_scan_report(FILE *output,
+                        ReportFormat format,
+                        const char *path,
+                        const char *error,
+                        const FileScan *scan,
+                        BumpLevel level) {
+  if (!output || !path || (!error && !scan)) {
+    return "Empty pointer received for the report.";
+  }
+  char *report_error = NULL;
+  if (format == REPORT_JSON) {
+    report_error = write_json_report(output, path, error, scan, level);
+  } else if (!error) {
+    report_error = write_text_report(output, path, scan, level);
+  }
+  if (!report_error && ferror(output)) {
+    report_error = "An I/O error occurred while trying to write the report.";
+  }
+  return report_error;
+}
+
+char *copy_file_scan(FileScan *destination, const FileScan *source) {
+  if (!destination || !source) {
+    return "Empty pointer received for the scan.";
+  }
+  memset(destination, 0, sizeof(FileScan));
+  if (source->count > 0) {
+    destination->matches = malloc(source->count * sizeof(VersionMatch));
+    destination->text = malloc(source->text_length);
+    if (!destination->matches || !destination->text) {
+      free_file_scan(destination);
+      return "Could not allocate memory for the scan results.";
+    }
+    memcpy(destination->matches, source->matches, source->count * sizeof(VersionMatch));
+    memcpy(destination->text, source->text, source->text_length);
+  }
+  destination->count = source->count;
+  destination->capacity = source->count;
+  destination->text_length = source->text_length;
+  destination->text_capacity = source->text_length;
+  return NULL;
+}
+
+void free_file_scan(FileScan *scan) {
+  if (!scan) {
+    return;
+  }
+  free(scan->matches);
+  free(scan->text);
+  memset(scan, 0, sizeof(FileScan));
+}
@@ -0,0 +1,306 @@
+// memmem() is a GNU extension.
+#define _GNU_SOURCE
+
+#include <bump/scan.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BUMP_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+typedef const char *(*ScanFunction)(const char *, const char *);
+
+static bool is_candidate(const char *position, const char *end) {
+  return (unsigned char) (*position - '0') <= 9 && position + 1 < end && position[1] == '.';
+}
+
+static const char *find_candidate_scalar(const char *begin, const char *end) {
+  for (const char *position = begin; position < end; position++) {
+    if (is_candidate(position, end)) {
+      return position;
+    }
+  }
+  return end;
+}
+
+#ifdef BUMP_X86_KERNELS
+
+/*
+ * Each kernel compares a block against itself shifted by one byte: a lane
+ * is a candidate when it holds a digit and the next lane holds a period.
+ * The shifted load needs one byte beyond the block, so the final bytes are
+ * always left to the scalar loop.
+ */
+
+#ifdef __SSE2__
+static const char *find_candidate_sse2(const char *begin, const char *end) {
+  const __m128i zero = _mm_set1_epi8('0');
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i period = _mm_set1_epi8('.');
+  const char *position = begin;
+  for (; end - position > 16; position += 16) {
+    __m128i current = _mm_loadu_si128((const __m128i *) position);
+    __m128i next = _mm_loadu_si128((const __m128i *) (position + 1));
+    __m128i offset = _mm_sub_epi8(current, zero);
+    __m128i digits = _mm_cmpeq_epi8(_mm_min_epu8(offset, nine), offset);
+    __m128i periods = _mm_cmpeq_epi8(next, period);
+    unsigned mask = (unsigned) _mm_movemask_epi8(_mm_and_si128(digits, periods));
+    if (mask) {
+      return position + __builtin_ctz(mask);
+    }
+  }
+  return find_candidate_scalar(position, end);
+}
+#endif
+
+__attribute__((target("avx2"))) static const char *find_candidate_avx2(const char *begin, const char *end) {
+  const __m256i zero = _mm256_set1_epi8('0');
+  const __m256i nine = _mm256_set1_epi8(9);
+  const __m256i period = _mm256_set1_epi8('.');
+  const char *position = begin;
+  for (; end - position > 32; position += 32) {
+    __m256i current = _mm256_loadu_si256((const __m256i *) position);
+    __m256i next = _mm256_loadu_si256((const __m256i *) (position + 1));
+    __m256i offset = _mm256_sub_epi8(current, zero);
+    __m256i digits = _mm256_cmpeq_epi8(_mm256_min_epu8(offset, nine), offset);
+    __m256i periods = _mm256_cmpeq_epi8(next, period);
+    unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_and_si256(digits, periods));
+    if (mask) {
+      return position + __builtin_ctz(mask);
+    }
+  }
+  return find_candidate_scalar(position, end);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static const char *find_candidate_avx512(const char *begin, const char *end) {
+  const __m512i zero = _mm512_set1_epi8('0');
+  const __m512i nine = _mm512_set1_epi8(9);
+  const __m512i period = _mm512_set1_epi8('.');
+  const char *position = begin;
+  for (; end - position > 64; position += 64) {
+    __m512i current = _mm512_loadu_si512((const void *) position);
+    __m512i next = _mm512_loadu_si512((const void *) (position + 1));
+    __mmask64 digits = _mm512_cmple_epu8_mask(_mm512_sub_epi8(current, zero), nine);
+    __mmask64 mask = _mm512_mask_cmpeq_epi8_mask(digits, next, period);
+    if (mask) {
+      return position + __builtin_ctzll(mask);
+    }
+  }
+  return find_candidate_scalar(position, end);
+}
+
+#endif
+
+// Tab, line feed, vertical tab, form feed, carriage return and escape are all common in text.
+static bool is_text_control(unsigned char byte) {
+  return (byte >= '\t' && byte <= '\r') || byte == 0x1B;
+}
+
+/*
+ * Checks the character that starts at the index and moves past it, adding
+ * one to the count when it is a control character or not valid UTF-8. A
+ * sequence cut off by the end of the sniffed part is given the benefit of
+ * the doubt when the file goes on.
+ */
+static void sniff_character(const unsigned char *data, size_t *index, size_t size, bool truncated, size_t *suspicious) {
+  unsigned char lead = data[*index];
+  if (lead < 0x80) {
+    *suspicious += (lead < 0x20 && !is_text_control(lead)) || lead == 0x7F;
+    (*index)++;
+    return;
+  }
+  size_t length = lead >= 0xC2 && lead <= 0xDF ? 2 : lead >= 0xE0 && lead <= 0xEF ? 3 : lead >= 0xF0 && lead <= 0xF4 ? 4 : 0;
+  size_t available = size - *index;
+  if (length == 0) {
+    (*suspicious)++;
+    (*index)++;
+    return;
+  }
+  for (size_t offset = 1; offset < length; offset++) {
+    if (offset == available) {
+      *suspicious += !truncated;
+      *index = size;
+      return;
+    }
+    unsigned char next = data[*index + offset];
+    // The second byte also rules out overlong forms, surrogates and code points past U+10FFFF.
+    unsigned char low = offset > 1 ? 0x80 : lead == 0xE0 ? 0xA0 : lead == 0xF0 ? 0x90 : 0x80;
+    unsigned char high = offset > 1 ? 0xBF : lead == 0xED ? 0x9F : lead == 0xF4 ? 0x8F : 0xBF;
+    if (next < low || next > high) {
+      (*suspicious)++;
+      (*index)++;
+      return;
+    }
+  }
+  *index += length;
+}
+
+bool looks_binary(const char *text, size_t size) {
+  const unsigned char *data = (const unsigned char *) text;
+  bool truncated = size > BINARY_SNIFF_SIZE;
+  if (truncated) {
+    size = BINARY_SNIFF_SIZE;
+  }
+  size_t suspicious = 0;
+  size_t index = 0;
+#if defined(BUMP_X86_KERNELS) && defined(__SSE2__)
+  // Runs of plain text are checked sixteen bytes at a time, and only other bytes are decoded one by one.
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i tab = _mm_set1_epi8('\t' - 1);
+  const __m128i carriage_return = _mm_set1_epi8('\r' + 1);
+  const __m128i escape = _mm_set1_epi8(0x1B);
+  const __m128i delete = _mm_set1_epi8(0x7F);
+  while (size - index >= 16) {
+    __m128i bytes = _mm_loadu_si128((const __m128i *) (data + index));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, zero))) {
+      return true;
+    }
+    if (_mm_movemask_epi8(bytes)) {
+      // A byte above 0x7F starts or continues a multibyte character.
+      size_t end = index + 16;
+      while (index < end) {
+        sniff_character(data, &index, size, truncated, &suspicious);
+      }
+      continue;
+    }
+    // Every byte is below 0x80 here, so the signed comparisons work as unsigned ones.
+    __m128i controls = _mm_cmplt_epi8(bytes, space);
+    __m128i whitespace = _mm_and_si128(_mm_cmpgt_epi8(bytes, tab), _mm_cmplt_epi8(bytes, carriage_return));
+    controls = _mm_andnot_si128(_mm_or_si128(whitespace, _mm_cmpeq_epi8(bytes, escape)), controls);
+    controls = _mm_or_si128(controls, _mm_cmpeq_epi8(bytes, delete));
+    suspicious += (size_t) __builtin_popcount((unsigned) _mm_movemask_epi8(controls));
+    index += 16;
+  }
+#endif
+  while (index < size) {
+    if (data[index] == 0) {
+      return true;
+    }
+    sniff_character(data, &index, size, truncated, &suspicious);
+  }
+  return suspicious * 10 > size;
+}
+
+const char *find_substring(const char *begin, const char *end, const char *needle, size_t length) {
+  if (length == 0 || (size_t) (end - begin) < length) {
+    return length == 0 ? begin : end;
+  }
+#if defined(BUMP_X86_KERNELS) && defined(__SSE2__)
+  /*
+   * Sixteen positions are tried at once by comparing their first byte with
+   * that of the needle and the byte where the needle would end with its
+   * last one. Only positions that pass both are compared in full.
+   */
+  const __m128i first = _mm_set1_epi8(needle[0]);
+  const __m128i last = _mm_set1_epi8(needle[length - 1]);
+  const char *position = begin;
+  for (; (size_t) (end - position) >= length + 15; position += 16) {
+    __m128i heads = _mm_loadu_si128((const __m128i *) position);
+    __m128i tails = _mm_loadu_si128((const __m128i *) (position + length - 1));
+    unsigned mask = (unsigned) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(heads, first), _mm_cmpeq_epi8(tails, last)));
+    while (mask) {
+      const char *candidate = position + __builtin_ctz(mask);
+      if (memcmp(candidate + 1, needle + 1, length - 1) == 0) {
+        return candidate;
+      }
+      mask &= mask - 1;
+    }
+  }
+  begin = position;
+#endif
+  // The rest, or everything on other processors, is left to the two-way search of the C library.
+  const char *found = memmem(begin, (size_t) (end - begin), needle, length);
+  return found ? found : end;
+}
+
+static bool kernel_is_supported(ScanKernel kernel) {
+  switch (kernel) {
+    case SCAN_KERNEL_SCALAR:
+      return true;
+#ifdef BUMP_X86_KERNELS
+#ifdef __SSE2__
+    case SCAN_KERNEL_SSE2:
+      return true;
+#endif
+    case SCAN_KERNEL_AVX2:
+      return __builtin_cpu_supports("avx2");
+    case SCAN_KERNEL_AVX512:
+      return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    default:
+      return false;
+  }
+}
+
+static ScanFunction kernel_function(ScanKernel kernel) {
+  switch (kernel) {
+#ifdef BUMP_X86_KERNELS
+#ifdef __SSE2__
+    case SCAN_KERNEL_SSE2:
+      return find_candidate_sse2;
+#endif
+    case SCAN_KERNEL_AVX2:
+      return find_candidate_avx2;
+    case SCAN_KERNEL_AVX512:
+      return find_candidate_avx512;
+#endif
+    default:
+      return find_candidate_scalar;
+  }
+}
+
+ScanKernel detect_scan_kernel(void) {
+  const ScanKernel preference[] = {SCAN_KERNEL_AVX512, SCAN_KERNEL_AVX2, SCAN_KERNEL_SSE2};
+  for (size_t index = 0; index < sizeof(preference) / sizeof(preference[0]); index++) {
+    if (kernel_is_supported(preference[index])) {
+      return preference[index];
+    }
+  }
+  return SCAN_KERNEL_SCALAR;
+}
+
+static _Atomic(ScanFunction) selected_function;
+static pthread_once_t detection = PTHREAD_ONCE_INIT;
+
+static void select_detected_kernel(void) {
+  ScanFunction expected = NULL;
+  // A kernel chosen explicitly before the first scan takes precedence.
+  atomic_compare_exchange_strong(&selected_function, &expected, kernel_function(detect_scan_kernel()));
+}
+
+bool select_scan_kernel(ScanKernel kernel) {
+  if (!kernel_is_supported(kernel)) {
+    return false;
+  }
+  atomic_store(&selected_function, kernel_function(kernel));
+  return true;
+}
+
+const char *scan_kernel_name(ScanKernel kernel) {
+  switch (kernel) {
+    case SCAN_KERNEL_SCALAR:
+      return "scalar";
+    case SCAN_KERNEL_SSE2:
+      return "sse2";
+    case SCAN_KERNEL_AVX2:
+      return "avx2";
+    case SCAN_KERNEL_AVX512:
+      return "avx512";
+  }
+  return "unknown";
+}
+
+const char *find_version_candidate(const char *begin, const char *end) {
+  ScanFunction function = atomic_load_explicit(&selected_function, memory_order_relaxed);
+  if (!function) {
+    pthread_once(&detection, select_detected_kernel);
+    function = atomic_load(&selected_function);
+  }
+  return function(begin, end);
+}
@@ -0,0 +1,157 @@
+#include <bump/stats.h>
+#include <bump/trace.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+_Thread_local BumpStats thread_stats;
+
+// Only set before any worker starts, which makes it visible to all of them.
+bool stats_enabled = false;
+
+static const TraceKind phase_spans[PHASE_COUNT] = {TRACE_OPEN, TRACE_SCAN, TRACE_WRITE, TRACE_COMMIT};
+
+static BumpStats total_stats;
+static pthread_mutex_t total_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void enable_stats(void) {
+  stats_enabled = true;
+}
+
+static uint64_t read_clock(clockid_t clock) {
+  struct timespec time;
+  clock_gettime(clock, &time);
+  return (uint64_t) time.tv_sec * 1000000000u + (uint64_t) time.tv_nsec;
+}
+
+uint64_t read_stats_clock(void) {
+  return stats_enabled ? read_clock(CLOCK_MONOTONIC) : 0;
+}
+
+void add_write_time(uint64_t start) {
+  if (stats_enabled) {
+    thread_stats.wall_nanoseconds[PHASE_WRITE] += read_clock(CLOCK_MONOTONIC) - start;
+  }
+}
+
+void start_phase(StatsTimer *timer) {
+  if (!stats_enabled) {
+    return;
+  }
+  timer->wall = read_clock(CLOCK_MONOTONIC);
+  timer->cpu = read_clock(CLOCK_THREAD_CPUTIME_ID);
+  timer->written = thread_stats.wall_nanoseconds[PHASE_WRITE];
+}
+
+void end_phase(StatsTimer *timer, StatsPhase phase) {
+  if (!stats_enabled) {
+    return;
+  }
+  StatsTimer now;
+  start_phase(&now);
+  uint64_t wall = now.wall - timer->wall;
+  // Writes are timed on their own, and must not be counted twice.
+  uint64_t written = now.written - timer->written;
+  thread_stats.wall_nanoseconds[phase] += wall > written ? wall - written : 0;
+  thread_stats.cpu_nanoseconds[phase] += now.cpu - timer->cpu;
+  trace_span(phase_spans[phase], NULL, timer->wall, now.wall);
+  *timer = now;
+}
+
+size_t count_lines(const char *data, size_t size) {
+  size_t lines = 0;
+  const char *end = data + size;
+  while ((data = memchr(data, '\n', (size_t) (end - data)))) {
+    lines++;
+    data++;
+  }
+  return lines;
+}
+
+static void add_stats(BumpStats *total, const BumpStats *counts) {
+  total->bytes_read += counts->bytes_read;
+  total->bytes_written += counts->bytes_written;
+  total->lines += counts->lines;
+  total->candidates += counts->candidates;
+  total->versions += counts->versions;
+  total->files += counts->files;
+  total->files_unchanged += counts->files_unchanged;
+  total->files_binary += counts->files_binary;
+  total->system_calls += counts->system_calls;
+  for (size_t phase = 0; phase < PHASE_COUNT; phase++) {
+    total->wall_nanoseconds[phase] += counts->wall_nanoseconds[phase];
+    total->cpu_nanoseconds[phase] += counts->cpu_nanoseconds[phase];
+  }
+}
+
+void flush_thread_stats(void) {
+  pthread_mutex_lock(&total_lock);
+  add_stats(&total_stats, &thread_stats);
+  pthread_mutex_unlock(&total_lock);
+  memset(&thread_stats, 0, sizeof(BumpStats));
+}
+
+void collect_stats(BumpStats *total) {
+  flush_thread_stats();
+  pthread_mutex_lock(&total_lock);
+  *total = total_stats;
+  pthread_mutex_unlock(&total_lock);
+}
+
+static double seconds(uint64_t nanoseconds) {
+  return (double) nanoseconds / 1e9;
+}
+
+static double timeval_seconds(struct timeval time) {
+  return (double) time.tv_sec + (double) time.tv_usec / 1e6;
+}
+
+char *write_stats(FILE *output, ReportFormat format, const BumpStats *stats, double wall_seconds) {
+  if (!output || !stats) {
+    return "Empty pointer received for the statistics.";
+  }
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage)) {
+    memset(&usage, 0, sizeof(usage));
+  }
+  double user = timeval_seconds(usage.ru_utime);
+  double system = timeval_seconds(usage.ru_stime);
+  const uint64_t *wall = stats->wall_nanoseconds;
+  const uint64_t *cpu = stats->cpu_nanoseconds;
+
+  if (format == REPORT_JSON) {
+    fprintf(output,
+            "{\"bytes_read\":%llu,\"bytes_written\":%llu,\"lines\":%llu,\"candidates\":%llu,"
+            "\"versions\":%llu,\"files\":%llu,\"files_unchanged\":%llu,\"files_binary\":%llu,\"system_calls\":%llu,"
+            "\"wall_seconds\":{\"total\":%.6f,\"open\":%.6f,\"scan\":%.6f,\"write\":%.6f,\"finalize\":%.6f},"
+            "\"cpu_seconds\":{\"user\":%.6f,\"system\":%.6f,\"open\":%.6f,\"process\":%.6f,\"finalize\":%.6f}}\n",
+            (unsigned long long) stats->bytes_read, (unsigned long long) stats->bytes_written,
+            (unsigned long long) stats->lines, (unsigned long long) stats->candidates,
+            (unsigned long long) stats->versions, (unsigned long long) stats->files,
+            (unsigned long long) stats->files_unchanged, (unsigned long long) stats->files_binary,
+            (unsigned long long) stats->system_calls,
+            wall_seconds, seconds(wall[PHASE_OPEN]), seconds(wall[PHASE_SCAN]), seconds(wall[PHASE_WRITE]),
+            seconds(wall[PHASE_FINALIZE]), user, system, seconds(cpu[PHASE_OPEN]),
+            seconds(cpu[PHASE_SCAN] + cpu[PHASE_WRITE]), seconds(cpu[PHASE_FINALIZE]));
+  } else {
+    fprintf(output,
+            "Files           : %llu (%llu unchanged, %llu binary)\n"
+            "Bytes read      : %llu\n"
+            "Bytes written   : %llu\n"
+            "Lines           : %llu\n"
+            "Candidates      : %llu\n"
+            "Versions bumped : %llu\n"
+            "System calls    : %llu\n"
+            "Wall time       : %.6f s (open %.6f s, scan %.6f s, write %.6f s, finalize %.6f s)\n"
+            "CPU time        : %.6f s user, %.6f s system (open %.6f s, process %.6f s, finalize %.6f s)\n",
+            (unsigned long long) stats->files, (unsigned long long) stats->files_unchanged,
+            (unsigned long long) stats->files_binary, (unsigned long long) stats->bytes_read, (unsigned long long) stats->bytes_written,
+            (unsigned long long) stats->lines, (unsigned long long) stats->candidates,
+            (unsigned long long) stats->versions, (unsigned long long) stats->system_calls,
+            wall_seconds, seconds(wall[PHASE_OPEN]), seconds(wall[PHASE_SCAN]), seconds(wall[PHASE_WRITE]),
+            seconds(wall[PHASE_FINALIZE]), user, system, seconds(cpu[PHASE_OPEN]),
+            seconds(cpu[PHASE_SCAN] + cpu[PHASE_WRITE]), seconds(cpu[PHASE_FINALIZE]));
+  }
+  return ferror(output) ? "Could not write the statistics." : NULL;
+}
@@ -0,0 +1,113 @@
+#include <bump/report.h>
+#include <bump/stats.h>
+#include <bump/trace.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Only set before any worker starts, which makes it visible to all of them.
+bool tracing_enabled = false;
+
+static uint64_t trace_origin;
+static _Atomic(TraceBuffer *) trace_buffers;
+static atomic_size_t trace_threads;
+static _Thread_local TraceBuffer *thread_buffer;
+
+static const char *kind_names[] = {"file", "open", "scan", "write", "commit"};
+
+void enable_tracing(void) {
+  // Spans need the clocks that statistics read.
+  enable_stats();
+  tracing_enabled = true;
+  trace_origin = read_stats_clock();
+}
+
+static TraceBuffer *attach_buffer(void) {
+  TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+  if (!buffer) {
+    return NULL;
+  }
+  buffer->events = malloc(TRACE_THREAD_CAPACITY * sizeof(TraceEvent));
+  if (!buffer->events) {
+    free(buffer);
+    return NULL;
+  }
+  buffer->thread = atomic_fetch_add(&trace_threads, 1) + 1;
+  buffer->next = atomic_load(&trace_buffers);
+  while (!atomic_compare_exchange_weak(&trace_buffers, &buffer->next, buffer)) {
+  }
+  return buffer;
+}
+
+void trace_span(TraceKind kind, const char *name, uint64_t start, uint64_t end) {
+  if (!tracing_enabled) {
+    return;
+  }
+  if (!thread_buffer) {
+    thread_buffer = attach_buffer();
+    if (!thread_buffer) {
+      return;
+    }
+  }
+  if (thread_buffer->count == TRACE_THREAD_CAPACITY) {
+    thread_buffer->dropped++;
+    return;
+  }
+  TraceEvent *event = &thread_buffer->events[thread_buffer->count++];
+  event->start = start;
+  event->end = end;
+  event->kind = kind;
+  event->name[0] = '\0';
+  if (name) {
+    // The end of a long path tells more about the file than its start.
+    size_t length = strlen(name);
+    size_t skipped = length < TRACE_NAME_LENGTH ? 0 : length - TRACE_NAME_LENGTH + 4;
+    snprintf(event->name, TRACE_NAME_LENGTH, "%s%s", skipped ? "..." : "", name + skipped);
+  }
+}
+
+static double microseconds(uint64_t nanoseconds) {
+  return nanoseconds > trace_origin ? (double) (nanoseconds - trace_origin) / 1e3 : 0;
+}
+
+/*
+ * Writes every recorded span in the trace event format read by Chrome and
+ * Perfetto. Each worker shows up as a thread of its own.
+ */
+char *write_trace(FILE *output) {
+  if (!output) {
+    return "Empty pointer received for the trace.";
+  }
+  size_t dropped = 0;
+  bool first = true;
+  fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", output);
+  for (TraceBuffer *buffer = atomic_load(&trace_buffers); buffer; buffer = buffer->next) {
+    fprintf(output, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,"
+                    "\"args\":{\"name\":\"worker %zu\"}}",
+            first ? "" : ",", buffer->thread, buffer->thread);
+    first = false;
+    for (size_t index = 0; index < buffer->count; index++) {
+      const TraceEvent *event = &buffer->events[index];
+      fputs(",\n{\"name\":", output);
+      write_json_string(output, event->kind == TRACE_FILE ? event->name : kind_names[event->kind]);
+      fprintf(output, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%zu}",
+              kind_names[event->kind], microseconds(event->start),
+              microseconds(event->end) - microseconds(event->start), buffer->thread);
+    }
+    dropped += buffer->dropped;
+  }
+  fprintf(output, "\n],\"otherData\":{\"dropped_events\":%zu}}\n", dropped);
+  return ferror(output) ? "Could not write the trace." : NULL;
+}
+
+void free_trace(void) {
+  TraceBuffer *buffer = atomic_exchange(&trace_buffers, NULL);
+  while (buffer) {
+    TraceBuffer *next = buffer->next;
+    free(buffer->events);
+    free(buffer);
+    buffer = next;
+  }
+  thread_buffer = NULL;
+}
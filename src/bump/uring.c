@@ -0,0 +1,488 @@
+// statx() is a Linux extension.
+#define _GNU_SOURCE
+
+#include <bump/stats.h>
+#include <bump/uring.h>
+#include <string.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BUMP_IO_URING
+#endif
+#endif
+
+char *add_file_patch(PatchList *list, uint64_t offset, const char *bytes, size_t length) {
+  if (!list || (!bytes && length > 0)) {
+    return "Empty pointer received for the patch.";
+  }
+  if (length == 0) {
+    return NULL;
+  }
+  if (list->count == list->capacity) {
+    size_t capacity = list->capacity ? list->capacity * 2 : 8;
+    FilePatch *patches = realloc(list->patches, capacity * sizeof(FilePatch));
+    if (!patches) {
+      return "Could not allocate memory for the writes.";
+    }
+    list->patches = patches;
+    list->capacity = capacity;
+  }
+  if (list->used + length > list->byte_capacity) {
+    size_t capacity = list->byte_capacity ? list->byte_capacity * 2 : 64;
+    while (capacity < list->used + length) {
+      capacity *= 2;
+    }
+    char *resized = realloc(list->bytes, capacity);
+    if (!resized) {
+      return "Could not allocate memory for the writes.";
+    }
+    list->bytes = resized;
+    list->byte_capacity = capacity;
+  }
+  memcpy(list->bytes + list->used, bytes, length);
+  list->used += length;
+  list->patches[list->count++] = (FilePatch) {offset, length};
+  return NULL;
+}
+
+#ifdef BUMP_IO_URING
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * The rings are shared with the kernel. Only this thread writes the tail of
+ * the submission ring and the head of the completion ring, while the kernel
+ * moves the other ends.
+ */
+typedef struct ring_struct {
+  int descriptor;
+  void *submission_map;
+  size_t submission_map_size;
+  void *completion_map;
+  size_t completion_map_size;
+  struct io_uring_sqe *entries;
+  size_t entries_size;
+  unsigned *submission_head;
+  unsigned *submission_tail;
+  unsigned *submission_mask;
+  unsigned *submission_array;
+  unsigned *completion_head;
+  unsigned *completion_tail;
+  unsigned *completion_mask;
+  struct io_uring_cqe *completions;
+  unsigned pending;
+} Ring;
+
+typedef enum load_stage_enum {
+  LOAD_IDLE,
+  LOAD_OPEN,
+  LOAD_STAT,
+  LOAD_READ,
+  LOAD_WRITE,
+  LOAD_CLOSE,
+} LoadStage;
+
+// Every file in flight has exactly one request outstanding at a time.
+typedef struct load_slot_struct {
+  LoadStage stage;
+  size_t index;
+  LoadedFile file;
+  int descriptor;
+  bool writable;
+  struct statx status;
+  char *buffer;
+  size_t capacity;
+  // The writes of the file, the one being written, and how far it got.
+  PatchList patches;
+  size_t patch;
+  size_t patch_start;
+  size_t patch_written;
+  char *write_error;
+} LoadSlot;
+
+static void free_ring(Ring *ring) {
+  if (ring->entries) {
+    munmap(ring->entries, ring->entries_size);
+  }
+  if (ring->completion_map && ring->completion_map != ring->submission_map) {
+    munmap(ring->completion_map, ring->completion_map_size);
+  }
+  if (ring->submission_map) {
+    munmap(ring->submission_map, ring->submission_map_size);
+  }
+  close(ring->descriptor);
+}
+
+static char *setup_ring(Ring *ring, unsigned size) {
+  memset(ring, 0, sizeof(Ring));
+  struct io_uring_params parameters = {0};
+  parameters.flags = IORING_SETUP_CQSIZE;
+  parameters.cq_entries = size * 2;
+  long descriptor = syscall(__NR_io_uring_setup, size, &parameters);
+  thread_stats.system_calls++;
+  if (descriptor < 0) {
+    return "Could not set up io_uring.";
+  }
+  ring->descriptor = (int) descriptor;
+  // Opening, inspecting and closing files through the ring came with the same kernel as this feature.
+  if (!(parameters.features & IORING_FEAT_RW_CUR_POS)) {
+    close(ring->descriptor);
+    return "The io_uring of this kernel cannot open files.";
+  }
+
+  ring->submission_map_size = parameters.sq_off.array + parameters.sq_entries * sizeof(unsigned);
+  ring->completion_map_size = parameters.cq_off.cqes + parameters.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_map = parameters.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_map && ring->completion_map_size > ring->submission_map_size) {
+    ring->submission_map_size = ring->completion_map_size;
+  }
+  ring->submission_map = mmap(NULL, ring->submission_map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                              ring->descriptor, IORING_OFF_SQ_RING);
+  if (ring->submission_map == MAP_FAILED) {
+    ring->submission_map = NULL;
+    free_ring(ring);
+    return "Could not map the io_uring.";
+  }
+  ring->completion_map = single_map ? ring->submission_map
+                                    : mmap(NULL, ring->completion_map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                                           ring->descriptor, IORING_OFF_CQ_RING);
+  if (ring->completion_map == MAP_FAILED) {
+    ring->completion_map = NULL;
+    free_ring(ring);
+    return "Could not map the io_uring.";
+  }
+  ring->entries_size = parameters.sq_entries * sizeof(struct io_uring_sqe);
+  ring->entries = mmap(NULL, ring->entries_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       ring->descriptor, IORING_OFF_SQES);
+  if (ring->entries == MAP_FAILED) {
+    ring->entries = NULL;
+    free_ring(ring);
+    return "Could not map the io_uring.";
+  }
+  thread_stats.system_calls += single_map ? 2 : 3;
+
+  char *submission = ring->submission_map;
+  ring->submission_head = (unsigned *) (submission + parameters.sq_off.head);
+  ring->submission_tail = (unsigned *) (submission + parameters.sq_off.tail);
+  ring->submission_mask = (unsigned *) (submission + parameters.sq_off.ring_mask);
+  ring->submission_array = (unsigned *) (submission + parameters.sq_off.array);
+  char *completion = ring->completion_map;
+  ring->completion_head = (unsigned *) (completion + parameters.cq_off.head);
+  ring->completion_tail = (unsigned *) (completion + parameters.cq_off.tail);
+  ring->completion_mask = (unsigned *) (completion + parameters.cq_off.ring_mask);
+  ring->completions = (struct io_uring_cqe *) (completion + parameters.cq_off.cqes);
+  return NULL;
+}
+
+/*
+ * Queues a request, which the kernel only sees with the next submission.
+ * The ring always has room, since it has an entry for every slot.
+ */
+static struct io_uring_sqe *queue_request(Ring *ring, size_t slot, uint8_t opcode) {
+  unsigned tail = *ring->submission_tail;
+  unsigned index = tail & *ring->submission_mask;
+  struct io_uring_sqe *entry = &ring->entries[index];
+  memset(entry, 0, sizeof(struct io_uring_sqe));
+  entry->opcode = opcode;
+  entry->user_data = slot;
+  ring->submission_array[index] = index;
+  __atomic_store_n(ring->submission_tail, tail + 1, __ATOMIC_RELEASE);
+  ring->pending++;
+  return entry;
+}
+
+// Submits everything queued and waits for at least one completion, in one system call.
+static bool submit_and_wait(Ring *ring) {
+  while (true) {
+    long submitted = syscall(__NR_io_uring_enter, ring->descriptor, ring->pending, 1,
+                             IORING_ENTER_GETEVENTS, NULL, 0);
+    thread_stats.system_calls++;
+    if (submitted >= 0) {
+      ring->pending -= (unsigned) submitted;
+      return true;
+    }
+    if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+      return false;
+    }
+  }
+}
+
+/*
+ * Files are opened for writing as well when they are to be patched, so
+ * that they need no other open.
+ */
+static void queue_open(Ring *ring, LoadSlot *slot, size_t index, bool writable) {
+  slot->stage = LOAD_OPEN;
+  slot->descriptor = -1;
+  slot->writable = writable;
+  struct io_uring_sqe *entry = queue_request(ring, index, IORING_OP_OPENAT);
+  entry->fd = AT_FDCWD;
+  entry->addr = (uintptr_t) slot->file.path;
+  entry->open_flags = writable ? O_RDWR | O_CLOEXEC : O_RDONLY | O_CLOEXEC;
+}
+
+// Writes what is left of the current patch.
+static void queue_write(Ring *ring, LoadSlot *slot, size_t index) {
+  const FilePatch *patch = &slot->patches.patches[slot->patch];
+  slot->stage = LOAD_WRITE;
+  struct io_uring_sqe *entry = queue_request(ring, index, IORING_OP_WRITE);
+  entry->fd = slot->descriptor;
+  entry->addr = (uintptr_t) (slot->patches.bytes + slot->patch_start + slot->patch_written);
+  entry->len = (unsigned) (patch->length - slot->patch_written);
+  entry->off = patch->offset + slot->patch_written;
+}
+
+static void queue_close(Ring *ring, LoadSlot *slot, size_t index) {
+  slot->stage = LOAD_CLOSE;
+  struct io_uring_sqe *entry = queue_request(ring, index, IORING_OP_CLOSE);
+  entry->fd = slot->descriptor;
+}
+
+// Files the ring cannot handle are passed on without data, for the handler to read them itself.
+static void hand_over(LoadSlot *slot, const char *data, HandleLoadedFile handle, void *context) {
+  slot->patches.count = 0;
+  slot->patches.used = 0;
+  slot->write_error = NULL;
+  slot->file.patches = data && slot->writable ? &slot->patches : NULL;
+  slot->file.data = data;
+  slot->file.size = data ? slot->status.stx_size : 0;
+  handle(context, slot->index, &slot->file);
+}
+
+/*
+ * Moves a file on to its next request once the previous one completed,
+ * and reports whether it is still in flight.
+ */
+static bool advance_slot(Ring *ring, LoadSlot *slot, size_t index, int result,
+                         HandleLoadedFile handle, FinishPatchedFile finish, void *context) {
+  switch (slot->stage) {
+    case LOAD_OPEN:
+      if (result < 0 && slot->writable && result != -ENOENT) {
+        // Read-only files, read-only file systems and the like can still be read.
+        queue_open(ring, slot, index, false);
+        return true;
+      }
+      if (result < 0) {
+        slot->stage = LOAD_IDLE;
+        hand_over(slot, NULL, handle, context);
+        return false;
+      }
+      slot->descriptor = result;
+      slot->stage = LOAD_STAT;
+      memset(&slot->status, 0, sizeof(struct statx));
+      struct io_uring_sqe *inspect = queue_request(ring, index, IORING_OP_STATX);
+      inspect->fd = slot->descriptor;
+      inspect->addr = (uintptr_t) "";
+      inspect->statx_flags = AT_EMPTY_PATH;
+      inspect->len = STATX_TYPE | STATX_SIZE;
+      inspect->off = (uintptr_t) &slot->status;
+      return true;
+
+    case LOAD_STAT:
+      if (result < 0 || !S_ISREG(slot->status.stx_mode) || slot->status.stx_size > URING_FILE_LIMIT) {
+        hand_over(slot, NULL, handle, context);
+        queue_close(ring, slot, index);
+        return true;
+      }
+      // One byte more than the file holds shows whether it grew in the meantime.
+      size_t wanted = (size_t) slot->status.stx_size + 1;
+      if (wanted > slot->capacity) {
+        char *buffer = realloc(slot->buffer, wanted);
+        if (!buffer) {
+          hand_over(slot, NULL, handle, context);
+          queue_close(ring, slot, index);
+          return true;
+        }
+        slot->buffer = buffer;
+        slot->capacity = wanted;
+      }
+      slot->stage = LOAD_READ;
+      struct io_uring_sqe *load = queue_request(ring, index, IORING_OP_READ);
+      load->fd = slot->descriptor;
+      load->addr = (uintptr_t) slot->buffer;
+      load->len = (unsigned) wanted;
+      load->off = 0;
+      return true;
+
+    case LOAD_READ:
+      if (result >= 0 && (uint64_t) result == slot->status.stx_size) {
+        thread_stats.bytes_read += (size_t) result;
+        hand_over(slot, slot->buffer, handle, context);
+      } else {
+        hand_over(slot, NULL, handle, context);
+      }
+      if (slot->patches.count > 0) {
+        slot->patch = 0;
+        slot->patch_start = 0;
+        slot->patch_written = 0;
+        queue_write(ring, slot, index);
+      } else {
+        queue_close(ring, slot, index);
+      }
+      return true;
+
+    case LOAD_WRITE:
+      if (result == -EINTR || result == -EAGAIN) {
+        queue_write(ring, slot, index);
+        return true;
+      }
+      if (result <= 0) {
+        // The rest of the writes are dropped, and the file is still closed.
+        slot->write_error = "Could not write to the file";
+        queue_close(ring, slot, index);
+        return true;
+      }
+      thread_stats.bytes_written += (size_t) result;
+      slot->patch_written += (size_t) result;
+      if (slot->patch_written == slot->patches.patches[slot->patch].length) {
+        slot->patch_start += slot->patch_written;
+        slot->patch_written = 0;
+        slot->patch++;
+      }
+      if (slot->patch < slot->patches.count) {
+        queue_write(ring, slot, index);
+      } else {
+        queue_close(ring, slot, index);
+      }
+      return true;
+
+    case LOAD_CLOSE:
+      if (slot->patches.count > 0) {
+        // Writes to some file systems only fail once the file is closed.
+        finish(context, slot->index, slot->write_error ? slot->write_error
+                                                       : result < 0 ? "Could not write to the file" : NULL);
+      }
+      break;
+
+    case LOAD_IDLE:
+      break;
+  }
+  slot->stage = LOAD_IDLE;
+  return false;
+}
+
+char *load_files(size_t in_flight,
+                 bool writable,
+                 NextLoadPath next,
+                 HandleLoadedFile handle,
+                 FinishPatchedFile finish,
+                 void *context) {
+  if (!next || !handle || (writable && !finish)) {
+    return "Empty pointer received for the files to load.";
+  }
+  if (in_flight == 0) {
+    in_flight = 1;
+  }
+  Ring ring;
+  char *error = setup_ring(&ring, (unsigned) in_flight);
+  if (error) {
+    return error;
+  }
+  LoadSlot *slots = calloc(in_flight, sizeof(LoadSlot));
+  if (!slots) {
+    free_ring(&ring);
+    return "Could not allocate memory for the files in flight.";
+  }
+
+  size_t active = 0;
+  bool exhausted = false;
+  bool broken = false;
+  while (!broken) {
+    for (size_t index = 0; !exhausted && index < in_flight; index++) {
+      if (slots[index].stage != LOAD_IDLE) {
+        continue;
+      }
+      if (!next(context, &slots[index].index, &slots[index].file.path)) {
+        exhausted = true;
+        break;
+      }
+      slots[index].file.started = read_stats_clock();
+      queue_open(&ring, &slots[index], index, writable);
+      active++;
+    }
+    if (active == 0) {
+      break;
+    }
+    if (!submit_and_wait(&ring)) {
+      broken = true;
+      break;
+    }
+
+    unsigned head = *ring.completion_head;
+    unsigned tail = __atomic_load_n(ring.completion_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+      const struct io_uring_cqe *completion = &ring.completions[head & *ring.completion_mask];
+      size_t index = (size_t) completion->user_data;
+      if (!advance_slot(&ring, &slots[index], index, completion->res, handle, finish, context)) {
+        active--;
+      }
+    }
+    __atomic_store_n(ring.completion_head, head, __ATOMIC_RELEASE);
+  }
+
+  free_ring(&ring);
+  if (broken) {
+    // The kernel may still write into the slots while it cancels their
+    // requests, so their memory is never given back. The files that were
+    // in flight, and all the ones after them, are read without the ring.
+    for (size_t index = 0; index < in_flight; index++) {
+      LoadSlot *slot = &slots[index];
+      if (slot->stage == LOAD_CLOSE && slot->patches.count > 0) {
+        // Every write went through, but the close cannot be waited for.
+        finish(context, slot->index, slot->write_error);
+      }
+      if (slot->stage == LOAD_IDLE || slot->stage == LOAD_CLOSE) {
+        continue;
+      }
+      if (slot->stage != LOAD_OPEN) {
+        close(slot->descriptor);
+      }
+      if (slot->stage == LOAD_WRITE) {
+        // The file was already handled, and only part of it may have been written.
+        finish(context, slot->index, "Could not write to the file");
+        continue;
+      }
+      LoadedFile file = {.path = slot->file.path};
+      handle(context, slot->index, &file);
+    }
+    size_t index;
+    const char *path;
+    while (next(context, &index, &path)) {
+      LoadedFile file = {.path = path};
+      handle(context, index, &file);
+    }
+    return NULL;
+  }
+  for (size_t index = 0; index < in_flight; index++) {
+    free(slots[index].buffer);
+    free(slots[index].patches.patches);
+    free(slots[index].patches.bytes);
+  }
+  free(slots);
+  return NULL;
+}
+
+#else
+
+char *load_files(size_t in_flight,
+                 bool writable,
+                 NextLoadPath next,
+                 HandleLoadedFile handle,
+                 FinishPatchedFile finish,
+                 void *context) {
+  (void) in_flight;
+  (void) writable;
+  (void) next;
+  (void) handle;
+  (void) finish;
+  (void) context;
+  return "io_uring is not available on this system.";
+}
+
+#endif
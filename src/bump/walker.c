@@ -0,0 +1,663 @@
+#include <bump/batch.h>
+#include <bump/bump.h>
+#include <bump/cache.h>
+#include <bump/lockstep.h>
+#include <bump/matcher.h>
+#include <bump/stats.h>
+#include <bump/trace.h>
+#include <bump/walker.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INITIAL_DEQUE_CAPACITY 64
+#define GIT_IGNORE_FILE ".gitignore"
+#define BUMP_IGNORE_FILE ".bumpignore"
+
+/*
+ * A directory that has been opened and still has subdirectories waiting
+ * to be opened relative to it. The descriptor is closed once the last
+ * pending subdirectory has been opened.
+ */
+typedef struct walk_directory_struct {
+  int descriptor;
+  char *path;
+  size_t relative_offset;
+  IgnoreScope *scope;
+  atomic_size_t references;
+} WalkDirectory;
+
+typedef struct walk_entry_struct {
+  size_t name_offset;
+  unsigned char type;
+} WalkEntry;
+
+typedef struct walk_task_struct {
+  WalkDirectory *parent;
+  char *name;
+} WalkTask;
+
+/*
+ * The owner pushes and pops at the bottom so that it walks depth-first
+ * and keeps few descriptors open. Idle workers steal from the top, which
+ * holds the oldest and usually largest subtrees.
+ */
+typedef struct walk_deque_struct {
+  pthread_mutex_t lock;
+  WalkTask *tasks;
+  size_t capacity;
+  size_t head;
+  size_t count;
+} WalkDeque;
+
+typedef struct walk_worker_struct {
+  WalkState *state;
+  WalkDeque deque;
+  WalkEntry *entries;
+  size_t entry_capacity;
+  char *names;
+  size_t name_capacity;
+  char *relative_path;
+  size_t relative_capacity;
+  WalkResult *results;
+  size_t result_count;
+  size_t result_capacity;
+  size_t file_count;
+  size_t index;
+  pthread_t thread;
+} WalkWorker;
+
+static bool push_task(WalkDeque *deque, WalkTask task) {
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count == deque->capacity) {
+    size_t capacity = deque->capacity ? deque->capacity * 2 : INITIAL_DEQUE_CAPACITY;
+    WalkTask *tasks = malloc(capacity * sizeof(WalkTask));
+    if (!tasks) {
+      pthread_mutex_unlock(&deque->lock);
+      return false;
+    }
+    for (size_t index = 0; index < deque->count; index++) {
+      tasks[index] = deque->tasks[(deque->head + index) % deque->capacity];
+    }
+    free(deque->tasks);
+    deque->tasks = tasks;
+    deque->capacity = capacity;
+    deque->head = 0;
+  }
+  deque->tasks[(deque->head + deque->count) % deque->capacity] = task;
+  deque->count++;
+  pthread_mutex_unlock(&deque->lock);
+  return true;
+}
+
+static bool pop_task(WalkDeque *deque, WalkTask *task) {
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count > 0) {
+    deque->count--;
+    *task = deque->tasks[(deque->head + deque->count) % deque->capacity];
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+static bool steal_task(WalkDeque *deque, WalkTask *task) {
+  bool found = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->count > 0) {
+    *task = deque->tasks[deque->head];
+    deque->head = (deque->head + 1) % deque->capacity;
+    deque->count--;
+    found = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return found;
+}
+
+/*
+ * Wakes idle workers after a directory was queued, or all of them once the
+ * walk is over. Both sides use sequentially consistent accesses, so either
+ * a worker about to sleep sees the new epoch, or it is seen sleeping.
+ */
+static void announce_work(WalkState *state, bool finished) {
+  atomic_fetch_add(&state->epoch, 1);
+  if (atomic_load(&state->sleepers) > 0) {
+    pthread_mutex_lock(&state->idle_lock);
+    if (finished) {
+      pthread_cond_broadcast(&state->work_changed);
+    } else {
+      pthread_cond_signal(&state->work_changed);
+    }
+    pthread_mutex_unlock(&state->idle_lock);
+  }
+}
+
+static char *join_path(const char *directory, const char *name) {
+  size_t directory_length = strlen(directory);
+  size_t name_length = strlen(name);
+  bool separator = directory_length > 0 && directory[directory_length - 1] != '/';
+  char *path = malloc(directory_length + separator + name_length + 1);
+  if (!path) {
+    return NULL;
+  }
+  memcpy(path, directory, directory_length);
+  if (separator) {
+    path[directory_length] = '/';
+  }
+  memcpy(path + directory_length + separator, name, name_length + 1);
+  return path;
+}
+
+static bool is_intermediate_file(const char *name) {
+  size_t length = strlen(name);
+  size_t suffix_length = sizeof(INTERMEDIATE_SUFFIX) - 1;
+  return length > suffix_length && strcmp(name + length - suffix_length, INTERMEDIATE_SUFFIX) == 0;
+}
+
+static void release_directory(WalkDirectory *directory) {
+  if (directory && atomic_fetch_sub(&directory->references, 1) == 1) {
+    close(directory->descriptor);
+    release_ignore_scope(directory->scope);
+    free(directory->path);
+    free(directory);
+  }
+}
+
+static bool reserve(void **buffer, size_t *capacity, size_t needed, size_t element_size) {
+  if (needed <= *capacity) {
+    return true;
+  }
+  size_t new_capacity = *capacity ? *capacity : 64;
+  while (new_capacity < needed) {
+    new_capacity *= 2;
+  }
+  void *resized = realloc(*buffer, new_capacity * element_size);
+  if (!resized) {
+    return false;
+  }
+  *buffer = resized;
+  *capacity = new_capacity;
+  return true;
+}
+
+/*
+ * Read every entry of the directory before acting on any of them, so that
+ * the ignore files of the directory are known up front without having to
+ * probe for them.
+ */
+static char *read_entries(WalkWorker *worker,
+                          DIR *stream,
+                          size_t *count,
+                          bool *has_git_ignore,
+                          bool *has_bump_ignore) {
+  size_t names_used = 0;
+  *count = 0;
+  struct dirent *entry;
+  while (true) {
+    // The end of the directory and a failure to read it are only told apart by errno.
+    errno = 0;
+    entry = readdir(stream);
+    if (!entry) {
+      return errno ? "Could not read directory" : NULL;
+    }
+    const char *name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 || strcmp(name, ".git") == 0 ||
+        strcmp(name, BUMP_CACHE_DIRECTORY) == 0) {
+      continue;
+    }
+    if (strcmp(name, GIT_IGNORE_FILE) == 0) {
+      *has_git_ignore = true;
+    } else if (strcmp(name, BUMP_IGNORE_FILE) == 0) {
+      *has_bump_ignore = true;
+    }
+    size_t length = strlen(name) + 1;
+    if (!reserve((void **) &worker->entries, &worker->entry_capacity, *count + 1, sizeof(WalkEntry)) ||
+        !reserve((void **) &worker->names, &worker->name_capacity, names_used + length, 1)) {
+      return "Could not allocate memory for the directory entries";
+    }
+    memcpy(worker->names + names_used, name, length);
+    worker->entries[*count].name_offset = names_used;
+    worker->entries[*count].type = entry->d_type;
+    names_used += length;
+    (*count)++;
+  }
+}
+
+static const char *build_relative_path(WalkWorker *worker, const char *directory, const char *name) {
+  size_t directory_length = strlen(directory);
+  size_t name_length = strlen(name);
+  if (!reserve((void **) &worker->relative_path, &worker->relative_capacity, directory_length + name_length + 2, 1)) {
+    return NULL;
+  }
+  char *path = worker->relative_path;
+  memcpy(path, directory, directory_length);
+  if (directory_length > 0) {
+    path[directory_length++] = '/';
+  }
+  memcpy(path + directory_length, name, name_length + 1);
+  return path;
+}
+
+static bool is_excluded(const WalkState *state,
+                        const IgnoreScope *scope,
+                        const char *relative_path,
+                        const char *name,
+                        bool is_directory) {
+  // Patterns from the command line cannot be overridden by ignore files.
+  if (match_pattern_set(&state->excludes, relative_path, name, is_directory) == PATTERN_MATCHED) {
+    return true;
+  }
+  if (ignore_scope_excludes(scope, relative_path, name, is_directory)) {
+    return true;
+  }
+  if (!is_directory && state->includes.count > 0) {
+    return match_pattern_set(&state->includes, relative_path, name, false) != PATTERN_MATCHED;
+  }
+  return false;
+}
+
+/*
+ * Adds a failure, or the versions found by a dry run, to the results of the
+ * worker. The result takes over the path and the scan.
+ */
+static void record_result(WalkWorker *worker, char *path, char *error, FileScan *scan) {
+  if (!path) {
+    free_file_scan(scan);
+    return;
+  }
+  if (worker->result_count == worker->result_capacity) {
+    size_t capacity = worker->result_capacity ? worker->result_capacity * 2 : 8;
+    WalkResult *results = realloc(worker->results, capacity * sizeof(WalkResult));
+    if (!results) {
+      // Losing the report is preferable to aborting the walk.
+      free(path);
+      free_file_scan(scan);
+      return;
+    }
+    worker->results = results;
+    worker->result_capacity = capacity;
+  }
+  WalkResult *result = &worker->results[worker->result_count++];
+  result->path = path;
+  result->error = error;
+  if (scan) {
+    result->scan = *scan;
+  } else {
+    memset(&result->scan, 0, sizeof(FileScan));
+  }
+}
+
+static void record_failure(WalkWorker *worker, char *path, char *error) {
+  record_result(worker, path, error, NULL);
+}
+
+/*
+ * Bumps or scans one file of a directory. Its full path is only built when
+ * something needs it: the cache, the trace or the results.
+ */
+static void process_walk_file(WalkWorker *worker, int descriptor, const char *path, const char *name) {
+  WalkState *state = worker->state;
+  uint64_t started = read_stats_clock();
+  // Cached files are known by their path from the working directory.
+  char *full_path = state->cache || tracing_enabled ? join_path(path, name) : NULL;
+  ScanCache *cache = full_path ? state->cache : NULL;
+  FileScan scan = {0};
+  char *error;
+  if (state->dry_run) {
+    error = cache ? scan_with_cache(cache, descriptor, name, full_path, &scan)
+                  : scan_path_at(descriptor, name, &scan);
+    if (state->highest && !error) {
+      // A lockstep bump only needs the highest version, so the scan is not kept.
+      error = merge_highest_version(state->highest, &scan);
+      free_file_scan(&scan);
+    }
+  } else {
+    bool changed;
+    error = cache ? bump_with_cache(cache, descriptor, name, full_path, state->bump_level, state->block_size, &changed)
+                  : process_path_at(descriptor, name, name, state->bump_level, state->block_size, NULL);
+  }
+  trace_span(TRACE_FILE, full_path, started, read_stats_clock());
+  // Binary files are passed over like ignored ones.
+  if (error == binary_file_skipped) {
+    error = NULL;
+  }
+
+  if (error || scan.count > 0) {
+    record_result(worker, full_path ? full_path : join_path(path, name), error, error ? NULL : &scan);
+  } else {
+    free(full_path);
+    free_file_scan(&scan);
+  }
+}
+
+static void walk_directory(WalkWorker *worker, WalkTask task) {
+  WalkState *state = worker->state;
+  int parent = task.parent ? task.parent->descriptor : AT_FDCWD;
+  // Roots may be symbolic links given explicitly by the user. Below
+  // them, links are never followed so the walk cannot leave the tree.
+  int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC | (task.parent ? O_NOFOLLOW : 0);
+  int descriptor = openat(parent, task.name, flags);
+
+  char *path = task.parent ? join_path(task.parent->path, task.name) : strdup(task.name);
+  // Below a root, paths that are matched against patterns start right after the root.
+  size_t relative_offset = 0;
+  if (task.parent) {
+    relative_offset = task.parent->relative_offset;
+  } else if (path) {
+    relative_offset = strlen(path);
+    relative_offset += relative_offset > 0 && path[relative_offset - 1] != '/';
+  }
+  IgnoreScope *scope = task.parent ? acquire_ignore_scope(task.parent->scope) : NULL;
+  release_directory(task.parent);
+  free(task.name);
+
+  if (descriptor == -1) {
+    record_failure(worker, path, "Could not open directory");
+    release_ignore_scope(scope);
+    return;
+  }
+  if (!path) {
+    close(descriptor);
+    release_ignore_scope(scope);
+    return;
+  }
+
+  WalkDirectory *directory = malloc(sizeof(WalkDirectory));
+  int stream_descriptor = dup(descriptor);
+  DIR *stream = stream_descriptor == -1 ? NULL : fdopendir(stream_descriptor);
+  if (!directory || !stream) {
+    if (stream_descriptor != -1 && !stream) {
+      close(stream_descriptor);
+    }
+    record_failure(worker, path, "Could not read directory");
+    close(descriptor);
+    release_ignore_scope(scope);
+    free(directory);
+    return;
+  }
+
+  bool has_git_ignore = false;
+  bool has_bump_ignore = false;
+  size_t count;
+  char *error = read_entries(worker, stream, &count, &has_git_ignore, &has_bump_ignore);
+  closedir(stream);
+  if (error) {
+    // Nothing in a directory that was only partly read is bumped, so the failure covers all of it.
+    record_failure(worker, path, error);
+    close(descriptor);
+    release_ignore_scope(scope);
+    free(directory);
+    return;
+  }
+
+  size_t path_length = strlen(path);
+  const char *relative = path + (relative_offset < path_length ? relative_offset : path_length);
+  if (has_git_ignore || has_bump_ignore) {
+    IgnoreScope *own_scope = create_ignore_scope(scope, strlen(relative));
+    if (own_scope) {
+      // The .bumpignore file is loaded last so that its patterns win.
+      if (has_git_ignore) {
+        load_pattern_file(&own_scope->patterns, descriptor, GIT_IGNORE_FILE);
+      }
+      if (has_bump_ignore) {
+        load_pattern_file(&own_scope->patterns, descriptor, BUMP_IGNORE_FILE);
+      }
+      compile_pattern_set(&own_scope->patterns);
+      release_ignore_scope(scope);
+      scope = own_scope;
+    }
+  }
+
+  directory->descriptor = descriptor;
+  directory->path = path;
+  directory->relative_offset = relative_offset;
+  directory->scope = scope;
+  atomic_init(&directory->references, 1);
+
+  for (size_t index = 0; index < count; index++) {
+    const char *name = worker->names + worker->entries[index].name_offset;
+    unsigned char type = worker->entries[index].type;
+
+    bool is_directory = type == DT_DIR;
+    bool is_file = type == DT_REG;
+    if (type == DT_UNKNOWN) {
+      // Some file systems do not report the type in the directory entry.
+      struct stat status;
+      if (fstatat(descriptor, name, &status, AT_SYMLINK_NOFOLLOW) == 0) {
+        is_directory = S_ISDIR(status.st_mode);
+        is_file = S_ISREG(status.st_mode);
+      }
+    }
+    if (!is_directory && !is_file) {
+      continue;
+    }
+
+    // Excluded directories are pruned here, before they are ever opened.
+    const char *relative_path = build_relative_path(worker, relative, name);
+    if (!relative_path || is_excluded(state, scope, relative_path, name, is_directory)) {
+      continue;
+    }
+
+    if (is_directory) {
+      WalkTask child = {directory, strdup(name)};
+      if (!child.name) {
+        continue;
+      }
+      atomic_fetch_add(&directory->references, 1);
+      atomic_fetch_add(&state->pending, 1);
+      if (!push_task(&worker->deque, child)) {
+        atomic_fetch_sub(&state->pending, 1);
+        atomic_fetch_sub(&directory->references, 1);
+        free(child.name);
+        record_failure(worker, join_path(path, name), "Could not queue directory");
+      } else {
+        announce_work(state, false);
+      }
+    } else if (!is_intermediate_file(name)) {
+      // In-place bumps create intermediate files in the directory that
+      // is being read, so those must not be picked up as inputs.
+      worker->file_count++;
+      process_walk_file(worker, descriptor, path, name);
+    }
+  }
+  release_directory(directory);
+}
+
+static bool find_task(WalkWorker *worker, WalkTask *task) {
+  if (pop_task(&worker->deque, task)) {
+    return true;
+  }
+  WalkState *state = worker->state;
+  for (size_t offset = 1; offset < state->jobs; offset++) {
+    WalkWorker *victim = &state->workers[(worker->index + offset) % state->jobs];
+    if (steal_task(&victim->deque, task)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void *run_walk_worker(void *argument) {
+  WalkWorker *worker = argument;
+  WalkState *state = worker->state;
+  while (true) {
+    WalkTask task;
+    size_t epoch = atomic_load(&state->epoch);
+    if (find_task(worker, &task)) {
+      walk_directory(worker, task);
+      if (atomic_fetch_sub(&state->pending, 1) == 1) {
+        announce_work(state, true);
+      }
+    } else if (atomic_load(&state->pending) == 0) {
+      // Nothing is queued anywhere and nobody is still producing work.
+      break;
+    } else {
+      // Other workers are still busy, and may queue more directories.
+      pthread_mutex_lock(&state->idle_lock);
+      atomic_fetch_add(&state->sleepers, 1);
+      while (atomic_load(&state->epoch) == epoch && atomic_load(&state->pending) > 0) {
+        pthread_cond_wait(&state->work_changed, &state->idle_lock);
+      }
+      atomic_fetch_sub(&state->sleepers, 1);
+      pthread_mutex_unlock(&state->idle_lock);
+    }
+  }
+  flush_thread_stats();
+  return NULL;
+}
+
+char *initialize_walk_state(WalkState *state,
+                            const char **roots,
+                            const size_t root_count,
+                            const char *bump_level,
+                            const size_t jobs,
+                            const size_t block_size) {
+  if (!state) {
+    return "Null pointer received for WalkState";
+  }
+  if (!roots || root_count == 0) {
+    return "No directories provided";
+  }
+  if (!bump_level) {
+    return "Invalid value received for bump level";
+  }
+  state->roots = roots;
+  state->root_count = root_count;
+  state->bump_level = bump_level;
+  state->block_size = block_size;
+  state->dry_run = false;
+  state->highest = NULL;
+  state->cache = NULL;
+  state->jobs = jobs == 0 ? count_online_processors() : jobs;
+  state->results = NULL;
+  state->result_count = 0;
+  state->file_count = 0;
+  atomic_init(&state->pending, 0);
+  atomic_init(&state->epoch, 0);
+  atomic_init(&state->sleepers, 0);
+  pthread_mutex_init(&state->idle_lock, NULL);
+  pthread_cond_init(&state->work_changed, NULL);
+  initialize_pattern_set(&state->includes);
+  initialize_pattern_set(&state->excludes);
+
+  state->workers = calloc(state->jobs, sizeof(WalkWorker));
+  if (!state->workers) {
+    return "Could not allocate memory for the walk workers";
+  }
+  for (size_t index = 0; index < state->jobs; index++) {
+    state->workers[index].state = state;
+    state->workers[index].index = index;
+    pthread_mutex_init(&state->workers[index].deque.lock, NULL);
+  }
+  return NULL;
+}
+
+static int compare_results(const void *left, const void *right) {
+  return strcmp(((const WalkResult *) left)->path, ((const WalkResult *) right)->path);
+}
+
+char *process_walk(WalkState *state) {
+  if (!state || !state->workers) {
+    return "Walk state is not initialized";
+  }
+
+  char *error = compile_pattern_set(&state->includes);
+  if (!error) {
+    error = compile_pattern_set(&state->excludes);
+  }
+  if (error) {
+    return error;
+  }
+
+  // Roots are spread over the workers up front; stealing evens out the rest.
+  for (size_t index = 0; index < state->root_count; index++) {
+    WalkTask task = {NULL, strdup(state->roots[index])};
+    if (!task.name) {
+      return "Could not allocate memory for the directory name";
+    }
+    atomic_fetch_add(&state->pending, 1);
+    if (!push_task(&state->workers[index % state->jobs].deque, task)) {
+      free(task.name);
+      return "Could not queue directory";
+    }
+  }
+
+  size_t started = 1;
+  for (; started < state->jobs; started++) {
+    WalkWorker *worker = &state->workers[started];
+    if (pthread_create(&worker->thread, NULL, run_walk_worker, worker)) {
+      break;
+    }
+  }
+
+  // The calling thread acts as the first worker. Queues of workers that
+  // failed to start are drained by stealing.
+  run_walk_worker(&state->workers[0]);
+
+  for (size_t index = 1; index < started; index++) {
+    pthread_join(state->workers[index].thread, NULL);
+  }
+
+  size_t result_count = 0;
+  for (size_t index = 0; index < state->jobs; index++) {
+    result_count += state->workers[index].result_count;
+    state->file_count += state->workers[index].file_count;
+  }
+  if (result_count > 0) {
+    state->results = malloc(result_count * sizeof(WalkResult));
+    if (!state->results) {
+      return "Could not allocate memory for the walk results";
+    }
+  }
+  for (size_t index = 0; index < state->jobs; index++) {
+    WalkWorker *worker = &state->workers[index];
+    if (worker->result_count > 0) {
+      memcpy(state->results + state->result_count, worker->results, worker->result_count * sizeof(WalkResult));
+      state->result_count += worker->result_count;
+    }
+    free(worker->results);
+    worker->results = NULL;
+    worker->result_count = 0;
+  }
+  // Workers finish in any order, so results are sorted to make reports repeatable.
+  if (state->result_count > 1) {
+    qsort(state->results, state->result_count, sizeof(WalkResult), compare_results);
+  }
+  return NULL;
+}
+
+void free_walk_state(WalkState *state) {
+  if (!state) {
+    return;
+  }
+  if (state->workers) {
+    for (size_t index = 0; index < state->jobs; index++) {
+      WalkWorker *worker = &state->workers[index];
+      free(worker->deque.tasks);
+      free(worker->entries);
+      free(worker->names);
+      free(worker->relative_path);
+      free(worker->results);
+      pthread_mutex_destroy(&worker->deque.lock);
+    }
+    free(state->workers);
+    state->workers = NULL;
+    pthread_cond_destroy(&state->work_changed);
+    pthread_mutex_destroy(&state->idle_lock);
+  }
+  for (size_t index = 0; index < state->result_count; index++) {
+    free(state->results[index].path);
+    free_file_scan(&state->results[index].scan);
+  }
+  free(state->results);
+  state->results = NULL;
+  state->result_count = 0;
+  free_pattern_set(&state->includes);
+  free_pattern_set(&state->excludes);
+}
@@ -1,15 +1,25 @@
+#include <bump/batch.h>
 #include <bump/bump.h>
+#include <bump/cache.h>
 #include <bump/fileutil.h>
+#include <bump/lockstep.h>
+#include <bump/report.h>
+#include <bump/stats.h>
+#include <bump/trace.h>
 #include <bump/version.h>
+#include <bump/walker.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define MAX_LINE_LENGTH 511
+// Three components of at most twenty digits each and their periods.
+#define TARGET_LENGTH 62
 #define INCORRECT_USAGE "Incorrect usage. Type bump --help for more information."
-#define INTERMEDIATE_FILE "intermediate.temp"
 
 /**
  * Convert the characters stored in the source string to lowercase and store
@@ -38,7 +48,7 @@ static void store_file_name_in(const char *prompt, char *file_name_buffer, bool
       fprintf(stderr, "Could not read line. The following error occurred: %s\nTry again.\n", error);
       continue;
     }
-    we_have_file = file_is_valid(buffer, for_input ? "r" : "w");
+    we_have_file = file_is_valid(buffer, for_input);
     if (we_have_file) {
       memcpy(file_name_buffer, buffer, len + 1);
       break;
@@ -141,47 +151,318 @@ static void print_help_message() {
           "3. bump [--version|-v]\n"
           "          Shows the current version of this program.\n"
           "4. bump [--input|-i] path/to/file.txt [[--level|-l] [major|minor|patch]]? \\\n"
-          "        [[--output|-o] path/to/output_file.txt]?\n"
-          "          Performs the processing on the file path provided if it exists.\n\n"
+          "        [[--output|-o] path/to/output_file.txt]? [[--jobs|-j] N]? \\\n"
+          "        [[--recursive|-r] path/to/directory]? [[--include|--exclude] glob]? \\\n"
+          "        [--dry-run]? [--report [text|json]]? [--cache]? \\\n"
+          "        [--stats [text|json]]? [--trace path/to/trace.json]? \\\n"
+          "        [--io [sync|uring]]? [--split-above N[K|M|G]]? [--pipeline]? \\\n"
+          "        [--files-from path/to/list.txt [-0|--null]?]? [--lockstep]? [--binary]? \\\n"
+          "        [--from x.y.z]? [[--to|--set] x.y.z]? \\\n"
+          "        [path/to/another_file.txt ...]\n"
+          "          Performs the processing on the file paths provided if they exist.\n\n"
           "          The level switch and value is optional. The values allowed are:\n"
           "          a. patch or p - a.b.c -> a.b.(c + 1)\n"
           "          b. minor or m - a.b.c -> a.(b + 1).0\n"
           "          c. major or M - a.b.c -> (a + 1).0.0\n\n"
           "          The default level is \"patch\".\n\n"
           "          The output switch and value pair is also optional. By default\n"
-          "          the result is stored in-place, in the input file.";
-  printf("%s\n", help_message);
+          "          the result is stored in-place, in the input file. It can only\n"
+          "          be used when a single input file is given.\n\n"
+          "          Any number of input files can be given, either with repeated\n"
+          "          input switches or as plain arguments. They are processed in\n"
+          "          parallel by N worker threads. By default, N is the number of\n"
+          "          online processors.\n\n"
+          "          The files-from switch reads more input paths from the given\n"
+          "          file, or from standard input when it is -, one per line. With\n"
+          "          -0, the paths are separated by NUL characters instead, as\n"
+          "          written by find -print0 or git ls-files -z.\n\n"
+          "          The recursive switch bumps every regular file below the given\n"
+          "          directory in-place. The directories are walked in parallel by\n"
+          "          the same number of worker threads. Symbolic links and .git\n"
+          "          directories are skipped. It may be repeated.\n\n"
+          "          While walking, patterns in .gitignore and .bumpignore files are\n"
+          "          honoured, and ignored directories are never opened. The include\n"
+          "          and exclude switches add patterns in the same syntax. Excluded\n"
+          "          paths are always skipped. When any include pattern is given,\n"
+          "          only files matching one of them are bumped.\n\n";
+  // Split in two, since compilers need not support longer string literals.
+  const char *switch_message =
+          "          The dry run switch only scans the files and writes nothing.\n"
+          "          Instead, every version found is listed with its line and\n"
+          "          column, and what the bump would turn it into. The report\n"
+          "          switch selects the format of that listing and implies a dry\n"
+          "          run. The json format prints one object per file, with the\n"
+          "          byte offset of every version, its bump at every level and\n"
+          "          any target set by the to, set or lockstep switches.\n\n"
+          "          The cache switch remembers what was found in every file in a\n"
+          "          .bump-cache directory under the working directory. Files that\n"
+          "          have not changed since and hold no version are then skipped\n"
+          "          without being read, and dry runs reuse the earlier results.\n\n"
+          "          The stats switch prints counters gathered while working to the\n"
+          "          standard error stream, in the given format: bytes read and\n"
+          "          written, lines, candidates examined, versions bumped, files\n"
+          "          left unchanged and system calls, with the wall and CPU time\n"
+          "          spent opening, scanning, writing and finalizing files.\n\n"
+          "          The trace switch records when every worker opened, scanned,\n"
+          "          wrote and committed every file, and saves it to the given path\n"
+          "          in the trace event format read by Chrome and Perfetto.\n\n"
+          "          The io switch selects how input files are read. With uring,\n"
+          "          small files are opened, read, patched and closed in batches\n"
+          "          through io_uring, many at a time, and the other files are\n"
+          "          read as usual. Systems without io_uring fall back to sync,\n"
+          "          which is the default.\n\n"
+          "          Files of at least the split size are cut into chunks that\n"
+          "          are bumped by all workers at once and written back in order.\n"
+          "          The size is in bytes, or with a K, M or G suffix, and is 64M\n"
+          "          by default. A size of 0 turns splitting off.\n\n"
+          "          The lockstep switch bumps every version in every file to the\n"
+          "          same one: the highest version found in any of them, bumped at\n"
+          "          the given level. All files are scanned before any is written.\n\n"
+          "          The from switch only bumps copies of the given version, and\n"
+          "          leaves every other version as it is. The to switch, or set,\n"
+          "          turns versions into the given one instead of bumping them at\n"
+          "          a level. Together, they rename a single version everywhere.\n\n"
+          "          Files that look binary, since they start with a NUL byte or\n"
+          "          with many bytes that are neither text nor UTF-8, are skipped\n"
+          "          unless the binary switch is given.\n\n"
+          "          The pipeline switch reads, bumps and writes every file on\n"
+          "          three threads at once instead of mapping it, which keeps the\n"
+          "          processor busy on slow disks and network filesystems.\n"
+          "5. bump [-|--stdin] [[--level|-l] [major|minor|patch]]? \\\n"
+          "        [[--output|-o] path/to/output_file.txt]?\n"
+          "          Bumps standard input into standard output, or into the output\n"
+          "          file when one is given, as a filter in a pipeline. It cannot\n"
+          "          be combined with other inputs, a dry run or the cache switch.";
+  printf("%s%s\n", help_message, switch_message);
 }
 
 
-static char *process_input_path_value(char *input_file_name,
-                                      bool *we_have_input_path,
+static char *process_input_path_value(const char **input_paths,
+                                      size_t *input_count,
                                       const char *file_path) {
-  if (*we_have_input_path) {
-    return "Repeated input file switch.";
-  }
-  if (!file_is_valid(file_path, "r")) {
-    return "The input file path provided is not valid.";
-  }
-  strcpy(input_file_name, file_path);
-  *we_have_input_path = true;
+  // Files are checked when they are opened, so that each one is opened once.
+  input_paths[*input_count] = file_path;
+  (*input_count)++;
   return NULL;
 }
 
-static char *process_output_path_value(char *output_file_name,
-                                       bool *we_have_output_path,
+static char *process_output_path_value(const char **output_path,
                                        const char *file_path) {
-  if (*we_have_output_path) {
+  if (*output_path) {
     return "Repeated output file switch.";
   }
-  if (!file_is_valid(file_path, "w")) {
-    return "The output file path provided is not valid.";
+  *output_path = file_path;
+  return NULL;
+}
+
+static char *process_directory_value(const char **directory_paths,
+                                     size_t *directory_count,
+                                     const char *directory_path) {
+  if (directory_path[0] == '\0') {
+    return "The directory path provided is not valid.";
+  }
+  directory_paths[*directory_count] = directory_path;
+  (*directory_count)++;
+  return NULL;
+}
+
+static char *process_jobs_value(size_t *jobs,
+                                bool *we_have_jobs_value,
+                                const char *jobs_argument) {
+  if (*we_have_jobs_value) {
+    return "Repeated jobs switch.";
+  }
+  char *end;
+  unsigned long value = strtoul(jobs_argument, &end, 10);
+  if (!isdigit(jobs_argument[0]) || *end != '\0' || value == 0) {
+    return "The number of jobs must be a positive integer.";
+  }
+  *jobs = (size_t) value;
+  *we_have_jobs_value = true;
+  return NULL;
+}
+
+static char *process_report_value(ReportFormat *format,
+                                  bool *we_have_report_value,
+                                  const char *format_argument) {
+  if (*we_have_report_value) {
+    return "Repeated report switch.";
+  }
+  char *error = parse_report_format(format_argument, format);
+  if (error) {
+    return error;
+  }
+  *we_have_report_value = true;
+  return NULL;
+}
+
+static char *process_stats_value(ReportFormat *format,
+                                 bool *we_have_stats_value,
+                                 const char *format_argument) {
+  if (*we_have_stats_value) {
+    return "Repeated stats switch.";
+  }
+  char *error = parse_report_format(format_argument, format);
+  if (error) {
+    return error;
+  }
+  *we_have_stats_value = true;
+  return NULL;
+}
+
+static char *process_io_value(bool *use_io_uring,
+                              bool *we_have_io_value,
+                              const char *io_argument) {
+  if (*we_have_io_value) {
+    return "Repeated io switch.";
+  }
+  if (strcmp(io_argument, "uring") == 0) {
+    *use_io_uring = true;
+  } else if (strcmp(io_argument, "sync") != 0) {
+    return "The io value must be sync or uring.";
+  }
+  *we_have_io_value = true;
+  return NULL;
+}
+
+static char *process_split_value(size_t *threshold,
+                                 bool *we_have_split_value,
+                                 const char *size_argument) {
+  if (*we_have_split_value) {
+    return "Repeated split switch.";
+  }
+  char *end;
+  unsigned long long value = strtoull(size_argument, &end, 10);
+  unsigned long long unit = 1;
+  if (*end == 'K' || *end == 'k') {
+    unit = 1024ull;
+  } else if (*end == 'M' || *end == 'm') {
+    unit = 1024ull * 1024;
+  } else if (*end == 'G' || *end == 'g') {
+    unit = 1024ull * 1024 * 1024;
+  }
+  if (unit > 1) {
+    end++;
+  }
+  if (!isdigit(size_argument[0]) || *end != '\0' || value > SIZE_MAX / unit) {
+    return "The split size must be a number of bytes, optionally followed by K, M or G.";
   }
-  strcpy(output_file_name, file_path);
-  *we_have_output_path = true;
+  *threshold = (size_t) (value * unit);
+  *we_have_split_value = true;
   return NULL;
 }
 
+/*
+ * Prints what a dry run found in one file. With the JSON format, failures
+ * are part of the report; otherwise they go to the standard error stream.
+ */
+static bool report_scan(ReportFormat format, const char *path, const char *error, const FileScan *scan, const char *bump_level) {
+  BumpLevel level = BUMP_PATCH;
+  parse_bump_level(bump_level, &level);
+  if (error && format == REPORT_TEXT) {
+    fprintf(stderr, "Error occurred while trying to process file \"%s\": %s\n", path, error);
+    return false;
+  }
+  char *report_error = write_scan_report(stdout, format, path, error, scan, level);
+  if (report_error) {
+    fprintf(stderr, "%s\n", report_error);
+    return false;
+  }
+  return !error;
+}
+
+/*
+ * The first pass of a lockstep bump. Every input is scanned in parallel,
+ * and the highest version found anywhere is bumped into the target that
+ * every version becomes in the second pass. Files that cannot be scanned
+ * are reported, and stop the bump before anything is written.
+ */
+static char *find_lockstep_target(const char **input_paths,
+                                  size_t input_count,
+                                  const char **directory_paths,
+                                  size_t directory_count,
+                                  const char **patterns,
+                                  const bool *pattern_includes,
+                                  size_t pattern_count,
+                                  size_t jobs,
+                                  ScanCache *cache,
+                                  bool io_uring,
+                                  const char *bump_level,
+                                  char *target,
+                                  bool *found) {
+  *found = false;
+  HighestVersion highest;
+  char *error = initialize_highest_version(&highest);
+  if (error) {
+    return error;
+  }
+  bool scanned = true;
+
+  if (input_count > 0) {
+    BatchState batch = {0};
+    error = initialize_batch_state(&batch, input_paths, input_count, NULL, bump_level, jobs, BUMP_BLOCK_SIZE);
+    if (!error) {
+      batch.dry_run = true;
+      batch.cache = cache;
+      batch.io_uring = io_uring;
+      batch.highest = &highest;
+      error = process_batch(&batch);
+    }
+    for (size_t index = 0; index < batch.count; index++) {
+      BatchResult *result = &batch.results[index];
+      if (result->error) {
+        fprintf(stderr, "Error occurred while trying to scan file \"%s\": %s\n", result->path, result->error);
+        scanned = false;
+      }
+    }
+    free_batch_state(&batch);
+  }
+
+  if (!error && directory_count > 0) {
+    WalkState walk = {0};
+    error = initialize_walk_state(&walk, directory_paths, directory_count, bump_level, jobs, BUMP_BLOCK_SIZE);
+    for (size_t index = 0; index < pattern_count && !error; index++) {
+      PatternSet *set = pattern_includes[index] ? &walk.includes : &walk.excludes;
+      error = add_pattern(set, patterns[index], strlen(patterns[index]));
+    }
+    if (!error) {
+      walk.dry_run = true;
+      walk.cache = cache;
+      walk.highest = &highest;
+      error = process_walk(&walk);
+    }
+    for (size_t index = 0; index < walk.result_count; index++) {
+      WalkResult *result = &walk.results[index];
+      fprintf(stderr, "Error occurred while trying to scan \"%s\": %s\n", result->path, result->error);
+      scanned = false;
+    }
+    free_walk_state(&walk);
+  }
+
+  if (!error && !scanned) {
+    error = "Nothing was bumped, since not every file could be scanned.";
+  }
+  BumpLevel level = BUMP_PATCH;
+  parse_bump_level(bump_level, &level);
+  if (!error) {
+    error = bump_highest_version(&highest, level, target, TARGET_LENGTH + 1, found);
+  }
+  free_highest_version(&highest);
+  return error;
+}
+
+static bool switch_matches(const char *argument, char abbreviation, const char *name) {
+  if (argument[1] == abbreviation && argument[2] == '\0') {
+    return true;
+  }
+  return strcmp(argument, name) == 0;
+}
+
+// A lone dash stands for standard input, as in most filters.
+static bool is_stdin_switch(const char *argument) {
+  return strcmp(argument, "-") == 0 || strcmp(argument, "--stdin") == 0;
+}
+
 static char *process_single_switch(const char *switch_value) {
   char command[MAX_LINE_LENGTH] = {0};
   size_t len;
@@ -258,183 +539,419 @@ static char *process_bump_value(char *bump_level,
   return NULL;
 }
 
+/*
+ * Reads a list of input paths, from standard input when the path is "-",
+ * and appends them to the paths given as arguments.
+ */
+static char *append_file_list(const char ***input_paths,
+                              size_t *input_count,
+                              FileList *list,
+                              const char *list_path,
+                              char separator) {
+  FILE *input = strcmp(list_path, "-") == 0 ? stdin : fopen(list_path, "rb");
+  if (!input) {
+    return "The file list path provided is not valid.";
+  }
+  char *error = read_file_list(input, separator, list);
+  if (input != stdin) {
+    fclose(input);
+  }
+  if (error) {
+    return error;
+  }
+  const char **paths = realloc(*input_paths, (*input_count + list->count + 1) * sizeof(const char *));
+  if (!paths) {
+    return "Could not allocate memory for the input paths.";
+  }
+  memcpy(paths + *input_count, list->paths, list->count * sizeof(const char *));
+  *input_count += list->count;
+  paths[*input_count] = NULL;
+  *input_paths = paths;
+  return NULL;
+}
+
 int main(int argc, char const *argv[]) {
   char input_file_name[MAX_LINE_LENGTH + 1] = {0};
   char output_file_name[MAX_LINE_LENGTH + 1] = {0};
   char bump_level[MAX_LINE_LENGTH + 1] = {0};
 
+  // There can never be more input paths than there are arguments.
+  const char **input_paths = calloc((size_t) argc + 1, sizeof(const char *));
+  const char **directory_paths = calloc((size_t) argc + 1, sizeof(const char *));
+  const char **patterns = calloc((size_t) argc + 1, sizeof(const char *));
+  bool *pattern_includes = calloc((size_t) argc + 1, sizeof(bool));
+  size_t input_count = 0;
+  size_t directory_count = 0;
+  size_t pattern_count = 0;
+  const char *output_path = NULL;
+  size_t jobs = 0;
+  bool dry_run = false;
+  bool use_cache = false;
+  bool use_stdin = false;
+  bool use_io_uring = false;
+  bool use_pipeline = false;
+  bool lockstep = false;
+  bool bump_binary = false;
+  size_t split_threshold = BUMP_SPLIT_THRESHOLD;
+  ReportFormat report_format = REPORT_TEXT;
+  ReportFormat stats_format = REPORT_TEXT;
+  bool we_have_stats_value = false;
+  const char *trace_path = NULL;
+  const char *list_path = NULL;
+  char list_separator = '\n';
+  const char *source_version = NULL;
+  const char *target_version = NULL;
+  FileList list = {0};
+
   char *error;
 
+  if (!input_paths || !directory_paths || !patterns || !pattern_includes) {
+    fprintf(stderr, "Could not allocate memory for the input paths.\n");
+    free(input_paths);
+    free(directory_paths);
+    free(patterns);
+    free(pattern_includes);
+    return EXIT_FAILURE;
+  }
+
   // Process command-line arguments
   if (argc == 1) {
     // There are no arguments. We need to obtain the values required through user input.
     store_file_name_in("Enter file name to process : ", input_file_name, true);
     store_bump_level_in(bump_level);
-    if (read_confirmation()) {
-      strcpy(output_file_name, input_file_name);
-    } else {
+    if (!read_confirmation()) {
       store_file_name_in("Enter output file name : ", output_file_name, false);
+      output_path = output_file_name;
     }
-  } else if (argc == 2) {
+    input_paths[input_count++] = input_file_name;
+  } else if (argc == 2 && argv[1][0] == '-' && !is_stdin_switch(argv[1])) {
     // Help and version commands.
     // In all cases, the program will never execute code afterwards outside this block.
     error = process_single_switch(argv[1]);
+    free(input_paths);
+    free(directory_paths);
+    free(patterns);
+    free(pattern_includes);
     if (error) {
       fprintf(stderr, "%s\n", error);
       return EXIT_FAILURE;
     } else {
       return EXIT_SUCCESS;
     }
-
-  } else if (argc % 2 == 0) {
-    // The pairs are mismatched
-    fprintf(stderr, "%s\n", INCORRECT_USAGE);
-    return EXIT_FAILURE;
   } else {
-    // The parameters should be present in pairs.
-    // The count must be odd because the name of the executable is the first argument.
-    bool we_have_input_path = false;
+    // Switches are followed by their value. We do not care about the order
+    // in which they appear. Any argument that is not a switch or the value
+    // of a switch is treated as another input path.
     bool we_have_bump_value = false;
-    bool we_have_output_path = false;
+    bool we_have_jobs_value = false;
+    bool we_have_report_value = false;
+    bool we_have_io_value = false;
+    bool we_have_split_value = false;
 
     strcpy(bump_level, "patch");
 
-
-    // Iterate pair wise. We do not care about the order in which
-    // the pairs appear. We are only interested in the values, and
-    // if they are valid for the switch given.
     size_t count = (size_t) argc;
-    for (size_t index = 1; index < count; index += 2) {
-      // The first of the pair should be a switch
-      if (argv[index][0] != '-') {
-        fprintf(stderr, "%s\n", INCORRECT_USAGE);
-        return EXIT_FAILURE;
-      }
-
-      size_t arg_len = strlen(argv[index]);
-
-      if (arg_len == 2) {
-        // Abbreviated switch
-        switch (argv[index][1]) {
-          case 'i':
-            error = process_input_path_value(input_file_name, &we_have_input_path, argv[index + 1]);
-            if (error) {
-              fprintf(stderr, "%s\n", error);
-              return EXIT_FAILURE;
-            }
-            break;
-          case 'l':
-            error = process_bump_value(bump_level, &we_have_bump_value, argv[index + 1]);
-            if (error) {
-              fprintf(stderr, "%s\n", error);
-              return EXIT_FAILURE;
-            }
-            break;
-          case 'o':
-            error = process_output_path_value(output_file_name, &we_have_output_path, argv[index + 1]);
-            if (error) {
-              fprintf(stderr, "%s\n", error);
-              return EXIT_FAILURE;
-            }
-            break;
-          default:
-            fprintf(stderr, "%s\n", error);
-            return EXIT_FAILURE;
-        }
+    for (size_t index = 1; index < count; index++) {
+      const char *argument = argv[index];
+      // Switches without a value leave no error behind.
+      error = NULL;
+
+      if (argument[0] != '-') {
+        error = process_input_path_value(input_paths, &input_count, argument);
+      } else if (strcmp(argument, "--dry-run") == 0) {
+        // The only switches without a value.
+        dry_run = true;
+      } else if (strcmp(argument, "--cache") == 0) {
+        use_cache = true;
+      } else if (strcmp(argument, "--pipeline") == 0) {
+        use_pipeline = true;
+      } else if (strcmp(argument, "--lockstep") == 0) {
+        lockstep = true;
+      } else if (strcmp(argument, "--binary") == 0) {
+        bump_binary = true;
+      } else if (strcmp(argument, "-0") == 0 || strcmp(argument, "--null") == 0) {
+        list_separator = '\0';
+      } else if (is_stdin_switch(argument)) {
+        use_stdin = true;
+      } else if (index + 1 == count) {
+        // Every switch needs a value after it
+        error = INCORRECT_USAGE;
       } else {
-        // Switch is not abbreviated
-        if (strcmp(argv[index], "--input") == 0) {
-          error = process_input_path_value(input_file_name, &we_have_input_path, argv[index + 1]);
-          if (error) {
-            fprintf(stderr, "%s\n", error);
-            return EXIT_FAILURE;
-          }
-        } else if (strcmp(argv[index], "--level") == 0) {
-          error = process_bump_value(bump_level, &we_have_bump_value, argv[index + 1]);
-          if (error) {
-            fprintf(stderr, "%s\n", error);
-            return EXIT_FAILURE;
-          }
-        } else if (strcmp(argv[index], "--output") == 0) {
-          error = process_output_path_value(output_file_name, &we_have_output_path, argv[index + 1]);
-          if (error) {
-            fprintf(stderr, "%s\n", error);
-            return EXIT_FAILURE;
-          }
+        const char *value = argv[++index];
+        if (switch_matches(argument, 'i', "--input")) {
+          error = process_input_path_value(input_paths, &input_count, value);
+        } else if (switch_matches(argument, 'l', "--level")) {
+          error = process_bump_value(bump_level, &we_have_bump_value, value);
+        } else if (switch_matches(argument, 'o', "--output")) {
+          error = process_output_path_value(&output_path, value);
+        } else if (switch_matches(argument, 'r', "--recursive")) {
+          error = process_directory_value(directory_paths, &directory_count, value);
+        } else if (strcmp(argument, "--include") == 0 || strcmp(argument, "--exclude") == 0) {
+          // Patterns are validated when they are compiled for the walk.
+          pattern_includes[pattern_count] = strcmp(argument, "--include") == 0;
+          patterns[pattern_count++] = value;
+        } else if (switch_matches(argument, 'j', "--jobs")) {
+          error = process_jobs_value(&jobs, &we_have_jobs_value, value);
+        } else if (strcmp(argument, "--report") == 0) {
+          // Asking for a report implies that nothing is written.
+          error = process_report_value(&report_format, &we_have_report_value, value);
+          dry_run = true;
+        } else if (strcmp(argument, "--stats") == 0) {
+          error = process_stats_value(&stats_format, &we_have_stats_value, value);
+        } else if (strcmp(argument, "--trace") == 0) {
+          error = trace_path ? "Repeated trace switch." : NULL;
+          trace_path = value;
+        } else if (strcmp(argument, "--io") == 0) {
+          error = process_io_value(&use_io_uring, &we_have_io_value, value);
+        } else if (strcmp(argument, "--split-above") == 0) {
+          error = process_split_value(&split_threshold, &we_have_split_value, value);
+        } else if (strcmp(argument, "--files-from") == 0) {
+          error = list_path ? "Repeated files-from switch." : NULL;
+          list_path = value;
+        } else if (strcmp(argument, "--from") == 0) {
+          error = source_version ? "Repeated from switch." : configure_source(value);
+          source_version = value;
+        } else if (strcmp(argument, "--to") == 0 || strcmp(argument, "--set") == 0) {
+          error = target_version ? "Repeated to switch." : configure_target(value);
+          target_version = value;
+        } else {
+          error = INCORRECT_USAGE;
         }
       }
+
+      if (error) {
+        fprintf(stderr, "%s\n", error);
+        free(input_paths);
+        free(directory_paths);
+        free(patterns);
+        free(pattern_includes);
+        return EXIT_FAILURE;
+      }
     }
-    if (!we_have_input_path) {
+    if (input_count == 0 && directory_count == 0 && !use_stdin && !list_path) {
       fprintf(stderr, "Input file not specified.\n");
+      free(input_paths);
+      free(directory_paths);
+      free(patterns);
+      free(pattern_includes);
       return EXIT_FAILURE;
     }
-    if (!we_have_output_path) {
-      strcpy(output_file_name, input_file_name);
+    error = NULL;
+    if (output_path && directory_count > 0) {
+      error = "An output file cannot be used with a directory.";
+    } else if (use_stdin && (input_count > 0 || directory_count > 0 || list_path)) {
+      error = "Standard input cannot be combined with input files or directories.";
+    } else if (use_stdin && (dry_run || use_cache || lockstep)) {
+      error = "Standard input can only be bumped, without a dry run, a cache or a lockstep bump.";
+    } else if (output_path && dry_run) {
+      error = "An output file cannot be used with a dry run.";
+    } else if (pattern_count > 0 && directory_count == 0) {
+      error = "The include and exclude switches can only be used with a directory.";
+    } else if (list_separator == '\0' && !list_path) {
+      error = "The -0 switch can only be used with a file list.";
+    } else if ((source_version || target_version) && (lockstep || use_cache)) {
+      error = "The from and to switches cannot be combined with a lockstep bump or the cache switch.";
+    } else if (target_version && we_have_bump_value) {
+      error = "The to switch already gives the new version, so a level cannot be given with it.";
+    } else if (list_path) {
+      error = append_file_list(&input_paths, &input_count, &list, list_path, list_separator);
+    }
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+      free(input_paths);
+      free(directory_paths);
+      free(patterns);
+      free(pattern_includes);
+      free_file_list(&list);
+      return EXIT_FAILURE;
     }
   }
 
-  bool inplace = strcmp(input_file_name, output_file_name) == 0;
-  if (inplace) {
-    // Check if we can create the file for writing
-    if (!file_is_valid(INTERMEDIATE_FILE, "w")) {
-      fprintf(stderr, "%s\n", "Could not create temporary file for writing.");
+  if (target_version) {
+    strcpy(bump_level, BUMP_TARGET_LEVEL);
+  }
+
+  bool success = true;
+  // The trace file is opened up front, so that a bad path fails before any file is bumped.
+  FILE *trace_file = NULL;
+  if (trace_path) {
+    trace_file = fopen(trace_path, "w");
+    if (!trace_file) {
+      fprintf(stderr, "The trace file path provided is not valid.\n");
+      free(input_paths);
+      free(directory_paths);
+      free(patterns);
+      free(pattern_includes);
+      free_file_list(&list);
       return EXIT_FAILURE;
     }
-
-    // Mark the output as the temporary.
-    strcpy(output_file_name, INTERMEDIATE_FILE);
+    enable_tracing();
+  }
+  if (we_have_stats_value) {
+    enable_stats();
+  }
+  configure_split(split_threshold, jobs == 0 ? count_online_processors() : jobs);
+  configure_pipeline(use_pipeline);
+  configure_binary_detection(!bump_binary);
+  uint64_t started = read_stats_clock();
+
+  // The cache only saves work, so the files are still processed without it.
+  ScanCache cache;
+  ScanCache *active_cache = NULL;
+  if (use_cache) {
+    error = open_scan_cache(&cache, BUMP_CACHE_DIRECTORY);
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+    } else {
+      active_cache = &cache;
+    }
   }
 
-  FileState state = {0};
-  initialize_file_state(&state, input_file_name, output_file_name, bump_level, MAX_LINE_LENGTH);
+  if (lockstep) {
+    // Every version is bumped to the same target, which needs all of them to be read first.
+    char target[TARGET_LENGTH + 1];
+    bool found;
+    error = find_lockstep_target(input_paths,
+                                 input_count,
+                                 directory_paths,
+                                 directory_count,
+                                 patterns,
+                                 pattern_includes,
+                                 pattern_count,
+                                 jobs,
+                                 active_cache,
+                                 use_io_uring,
+                                 bump_level,
+                                 target,
+                                 &found);
+    if (!error && found) {
+      error = configure_target(target);
+    }
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+      success = false;
+      input_count = 0;
+      directory_count = 0;
+    } else if (!found) {
+      printf("No version was found in any file.\n");
+      input_count = 0;
+      directory_count = 0;
+    } else {
+      if (!dry_run) {
+        printf("Every version is bumped to %s.\n", target);
+      }
+      strcpy(bump_level, BUMP_TARGET_LEVEL);
+    }
+  }
 
-  error = process_file(&state);
-  if (error) {
-    fprintf(stderr, "Error occurred while trying to process file: %s\n", error);
+  if (use_stdin) {
+    if (output_path) {
+      error = process_stream_to_path(stdin, AT_FDCWD, output_path, bump_level, BUMP_BLOCK_SIZE, NULL);
+    } else {
+      // Without an output file, the result goes to standard output in large writes.
+      setvbuf(stdout, NULL, _IOFBF, BUMP_BLOCK_SIZE);
+      error = process_streams(stdin, stdout, bump_level, BUMP_BLOCK_SIZE, NULL);
+    }
+    if (error) {
+      fprintf(stderr, "Error occurred while trying to process standard input: %s\n", error);
+      success = false;
+    }
   }
 
-  if (inplace) {
-    int c;
-    FILE *temp = fopen(INTERMEDIATE_FILE, "r");
-    if (!temp) {
-      fprintf(stderr, "Could not open temporary file for reading.\n");
-      return EXIT_FAILURE;
+  if (input_count > 0) {
+    BatchState batch = {0};
+    error = initialize_batch_state(&batch, input_paths, input_count, output_path, bump_level, jobs, BUMP_BLOCK_SIZE);
+    if (!error) {
+      batch.dry_run = dry_run;
+      batch.cache = active_cache;
+      batch.io_uring = use_io_uring;
+      error = process_batch(&batch);
     }
-    FILE *dump = fopen(input_file_name, "w");
-    if (!dump) {
-      fprintf(stderr, "Could not open final output file for writing.\n");
-      return EXIT_FAILURE;
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+      success = false;
+    }
+
+    // Failures are reported together once every file has been attempted.
+    for (size_t index = 0; index < batch.count; index++) {
+      BatchResult *result = &batch.results[index];
+      if (dry_run) {
+        success = report_scan(report_format, result->path, result->error, &result->scan, bump_level) && success;
+      } else if (result->error) {
+        fprintf(stderr, "Error occurred while trying to process file \"%s\": %s\n", result->path, result->error);
+        success = false;
+      } else if (result->binary) {
+        printf("File \"%s\" is unchanged: it looks binary. Use --binary to bump it anyway.\n", result->path);
+      } else if (!result->changed) {
+        printf("File \"%s\" is unchanged: it has no version to bump.\n", result->path);
+      }
     }
+    free_batch_state(&batch);
+  }
 
-    while ((c = fgetc(temp)) != EOF) {
-      fputc(c, dump);
+  if (directory_count > 0) {
+    WalkState walk = {0};
+    error = initialize_walk_state(&walk, directory_paths, directory_count, bump_level, jobs, BUMP_BLOCK_SIZE);
+    for (size_t index = 0; index < pattern_count && !error; index++) {
+      PatternSet *set = pattern_includes[index] ? &walk.includes : &walk.excludes;
+      error = add_pattern(set, patterns[index], strlen(patterns[index]));
     }
-    if (ferror(temp)) {
-      fprintf(stderr, "I/O error occurred while trying to read from temporary file.\n");
-      return EXIT_FAILURE;
+    if (!error) {
+      walk.dry_run = dry_run;
+      walk.cache = active_cache;
+      error = process_walk(&walk);
     }
-    if (ferror(dump)) {
-      fprintf(stderr, "I/O error occurred while trying to write to output file.\n");
-      return EXIT_FAILURE;
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+      success = false;
     }
 
-    int e;
-    e = fclose(temp);
-    if (e) {
-      fprintf(stderr, "Unable to close temporary file.\n");
-      return EXIT_FAILURE;
+    for (size_t index = 0; index < walk.result_count; index++) {
+      WalkResult *result = &walk.results[index];
+      if (dry_run) {
+        success = report_scan(report_format, result->path, result->error, &result->scan, bump_level) && success;
+      } else {
+        fprintf(stderr, "Error occurred while trying to process \"%s\": %s\n", result->path, result->error);
+        success = false;
+      }
     }
-    e = fclose(dump);
-    if (e) {
-      fprintf(stderr, "Unable to close output file.\n");
-      return EXIT_FAILURE;
+    free_walk_state(&walk);
+  }
+
+  if (active_cache) {
+    error = save_scan_cache(active_cache);
+    if (error) {
+      fprintf(stderr, "%s\n", error);
     }
-    e = remove(INTERMEDIATE_FILE);
-    if (e) {
-      fprintf(stderr, "Unable to delete temporary file.\n");
-      return EXIT_FAILURE;
+    free_scan_cache(active_cache);
+  }
+
+  if (we_have_stats_value) {
+    // Statistics go to the standard error stream, so that they never mix with a report.
+    BumpStats stats;
+    collect_stats(&stats);
+    error = write_stats(stderr, stats_format, &stats, (double) (read_stats_clock() - started) / 1e9);
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+    }
+  }
+
+  if (trace_file) {
+    error = write_trace(trace_file);
+    if (fclose(trace_file) && !error) {
+      error = "Could not write the trace.";
+    }
+    if (error) {
+      fprintf(stderr, "%s\n", error);
+      success = false;
     }
+    free_trace();
   }
 
-  return EXIT_SUCCESS;
+  free(input_paths);
+  free(directory_paths);
+  free(patterns);
+  free(pattern_includes);
+  free_file_list(&list);
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -1,12 +1,57 @@
+// memmem() is a GNU extension, used to check the substring search.
+#define _GNU_SOURCE
+
 #include <stdio.h>
 
+#include <bump/batch.h>
 #include <bump/bump.h>
+#include <bump/cache.h>
+#include <bump/fileutil.h>
+#include <bump/lockstep.h>
+#include <bump/matcher.h>
+#include <bump/report.h>
+#include <bump/scan.h>
+#include <bump/stats.h>
+#include <bump/trace.h>
 #include <bump/version.h>
+#include <bump/walker.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <munit.h>
 
 #define MAX_LINE_WIDTH 256
 
+/*
+ * FILE HELPERS
+ * ============
+ *
+ * Some tests need real files. These are created in the temporary
+ * directory and removed by the test that created them.
+ */
+
+static void write_temporary_file(char *path_template, const char *contents) {
+  int descriptor = mkstemp(path_template);
+  munit_assert_int(descriptor, !=, -1);
+  size_t length = strlen(contents);
+  munit_assert_true(write(descriptor, contents, length) == (ssize_t) length);
+  munit_assert_int(close(descriptor), ==, 0);
+}
+
+static void assert_file_contents(const char *path, const char *expected) {
+  char buffer[MAX_LINE_WIDTH] = {0};
+  FILE *file = fopen(path, "r");
+  munit_assert_not_null(file);
+  size_t length = fread(buffer, 1, MAX_LINE_WIDTH - 1, file);
+  munit_assert_int(fclose(file), ==, 0);
+  munit_assert_size(length, ==, strlen(expected));
+  munit_assert_string_equal(buffer, expected);
+}
+
 /*
  *
  * UNIT TEST FUNCTIONS
@@ -161,7 +206,7 @@ MunitResult process_test_cases() {
   // 1. the `count` variable - stores the number of test cases
   // 2. the `input_lines` array - stores the input lines
   // 3. the `expected_lines` array - stores 3 types of outputs for each input line. The order is patch, minor, major
-  const size_t count = 5;// <- update this
+  const size_t count = 6;// <- update this
   char line[MAX_LINE_WIDTH];
   char copy[MAX_LINE_WIDTH];
 
@@ -221,6 +266,1089 @@ MunitResult process_test_cases() {
   return MUNIT_OK;
 }
 
+MunitResult process_line_unterminated() {
+  // The input is not terminated, as is the case for memory-mapped files.
+  const char input_line[] = {'v', '1', '.', '2', '.', '3', ' ', '9', '.', '9', '.', '9', '9', '9'};
+  char line[32] = {0};
+
+  LineState state = {0};
+  munit_assert_null(initialize_line_state(&state, input_line, line, 12));
+  while (state.input_index < state.limit) {
+    munit_assert_null(process_line(&state, "patch"));
+  }
+  munit_assert_size(state.output_index, ==, 13);
+  munit_assert_string_equal(line, "v1.2.4 9.9.10");
+
+  return MUNIT_OK;
+}
+
+MunitResult process_path_mapped() {
+  char input_path[32] = "/tmp/bump-input-XXXXXX";
+  char output_path[32] = "/tmp/bump-output-XXXXXX";
+  write_temporary_file(input_path, "a 1.2.3\n\nend 9.\nx\n1.9.9");
+  write_temporary_file(output_path, "");
+
+  munit_assert_null(process_path(input_path, output_path, "minor", MAX_LINE_WIDTH, NULL));
+  assert_file_contents(output_path, "a 1.3.0\n\nend 9.\nx\n1.10.0");
+
+  remove(input_path);
+  remove(output_path);
+
+  return MUNIT_OK;
+}
+
+static char *read_whole_file(const char *path, size_t size) {
+  char *data = malloc(size + 1);
+  munit_assert_not_null(data);
+  FILE *file = fopen(path, "r");
+  munit_assert_not_null(file);
+  munit_assert_size(fread(data, 1, size + 1, file), ==, size);
+  fclose(file);
+  return data;
+}
+
+MunitResult process_path_split() {
+  // Large enough for three chunks, with versions and long numbers across the chunk boundaries.
+  const size_t size = 9 * 1024 * 1024;
+  const size_t chunk = 4 * 1024 * 1024;
+  char *input = malloc(size);
+  munit_assert_not_null(input);
+  const char *line = "version 1.2.9 is followed by 9. and by plain text.\n";
+  size_t line_length = strlen(line);
+  for (size_t index = 0; index < size; index++) {
+    input[index] = line[index % line_length];
+  }
+  memcpy(input + chunk - 3, "7.8.9", 5);
+  memset(input + 2 * chunk - 100, '9', 200);
+  memcpy(input + 2 * chunk + 100, ".9.9 ", 5);
+
+  char input_path[32] = "/tmp/bump-input-XXXXXX";
+  char split_path[32] = "/tmp/bump-output-XXXXXX";
+  char whole_path[32] = "/tmp/bump-output-XXXXXX";
+  write_temporary_file(input_path, "");
+  write_temporary_file(split_path, "");
+  write_temporary_file(whole_path, "");
+  FILE *file = fopen(input_path, "w");
+  munit_assert_not_null(file);
+  munit_assert_size(fwrite(input, 1, size, file), ==, size);
+  fclose(file);
+
+  bool changed = false;
+  configure_split(1, 3);
+  munit_assert_null(process_path(input_path, split_path, "minor", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  configure_split(0, 1);
+  munit_assert_null(process_path(input_path, whole_path, "minor", MAX_LINE_WIDTH, NULL));
+
+  struct stat status;
+  munit_assert_int(stat(whole_path, &status), ==, 0);
+  size_t length = (size_t) status.st_size;
+  munit_assert_int(stat(split_path, &status), ==, 0);
+  munit_assert_size((size_t) status.st_size, ==, length);
+  char *split = read_whole_file(split_path, length);
+  char *whole = read_whole_file(whole_path, length);
+  munit_assert_memory_equal(length, split, whole);
+
+  free(split);
+  free(whole);
+  free(input);
+  remove(input_path);
+  remove(split_path);
+  remove(whole_path);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_file_long_line() {
+  // Versions straddle the boundaries between blocks of 256 bytes.
+  char input[1024];
+  char expected[1025];
+  char output[1026] = {0};
+  memset(input, 'x', sizeof(input));
+  memcpy(input + 252, "1.2.3", 5);
+  memcpy(input + 509, "10.20.30", 8);
+  memcpy(input + 1019, "7.8.9", 5);
+  memcpy(expected, input, sizeof(input));
+  memcpy(expected + 252, "1.2.4", 5);
+  memcpy(expected + 509, "10.20.31", 8);
+  memcpy(expected + 1019, "7.8.10", 6);
+
+  // Without a file descriptor the input cannot be mapped, so the stream path is used.
+  FileState state = {0};
+  state.input = fmemopen(input, sizeof(input), "r");
+  state.output = fmemopen(output, sizeof(output), "w");
+  state.bump_level = "patch";
+  state.block_size = MAX_LINE_WIDTH;
+  munit_assert_not_null(state.input);
+  munit_assert_not_null(state.output);
+  munit_assert_null(process_file(&state));
+  munit_assert_memory_equal(sizeof(expected), output, expected);
+
+  return MUNIT_OK;
+}
+
+static size_t bump_in_memory(const char *input, size_t size, char *output, size_t capacity) {
+  FileState state = {0};
+  state.input = fmemopen((void *) input, size, "r");
+  state.output = fmemopen(output, capacity, "w");
+  state.bump_level = "minor";
+  state.block_size = MAX_LINE_WIDTH;
+  munit_assert_not_null(state.input);
+  munit_assert_not_null(state.output);
+  munit_assert_null(process_file(&state));
+  return strlen(output);
+}
+
+MunitResult process_file_pipelined() {
+  // Runs of digits longer than the room kept for carried bytes cross the blocks of 256 bytes.
+  char input[8192];
+  size_t size = 0;
+  for (size_t run = 1; size + run + 16 < sizeof(input); run += 37) {
+    size += (size_t) sprintf(input + size, "v 1.2.%zu x ", run);
+    memset(input + size, '9', run);
+    size += run;
+    size += (size_t) sprintf(input + size, ".1.%zu\n", run % 10);
+  }
+
+  static char expected[16384];
+  static char output[16384];
+  memset(expected, 0, sizeof(expected));
+  memset(output, 0, sizeof(output));
+  size_t expected_length = bump_in_memory(input, size, expected, sizeof(expected));
+  configure_pipeline(true);
+  size_t length = bump_in_memory(input, size, output, sizeof(output));
+  configure_pipeline(false);
+  munit_assert_size(length, ==, expected_length);
+  munit_assert_memory_equal(length, output, expected);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_batch_in_place() {
+  const size_t count = 4;
+  char paths[4][32];
+  const char *input_paths[4];
+
+  for (size_t index = 0; index < count; ++index) {
+    strcpy(paths[index], "/tmp/bump-batch-XXXXXX");
+    write_temporary_file(paths[index], "version 1.2.3\nfoo 9.9.9 bar");
+    input_paths[index] = paths[index];
+  }
+
+  BatchState batch = {0};
+  munit_assert_null(initialize_batch_state(&batch, input_paths, count, NULL, "minor", 3, MAX_LINE_WIDTH));
+  munit_assert_size(batch.jobs, ==, 3);
+  munit_assert_null(process_batch(&batch));
+  munit_assert_size(count_batch_failures(&batch), ==, 0);
+
+  for (size_t index = 0; index < count; ++index) {
+    munit_assert_string_equal(batch.results[index].path, paths[index]);
+    munit_assert_true(batch.results[index].changed);
+    assert_file_contents(paths[index], "version 1.3.0\nfoo 9.10.0 bar");
+    remove(paths[index]);
+  }
+  free_batch_state(&batch);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_batch_lockstep() {
+  Version low = {1, 9, 99};
+  Version high = {1, 10, 0};
+  VersionKey low_key;
+  VersionKey high_key;
+  munit_assert_null(pack_version_key(&low, &low_key));
+  munit_assert_null(pack_version_key(&high, &high_key));
+  munit_assert_true(version_key_less(low_key, high_key));
+  munit_assert_false(version_key_less(high_key, low_key));
+  Version unpacked;
+  unpack_version_key(high_key, &unpacked);
+  munit_assert_size(unpacked.minor, ==, 10);
+  Version wide = {0, 0, (size_t) 1 << 32};
+  munit_assert_not_null(pack_version_key(&wide, &low_key));
+
+  const char *contents[3] = {"a 1.2.3 b 0.9.10\n", "x 1.10.0 y 1.9.99\n", "none\n"};
+  char paths[3][32];
+  const char *input_paths[3];
+  for (size_t index = 0; index < 3; ++index) {
+    strcpy(paths[index], "/tmp/bump-lockstep-XXXXXX");
+    write_temporary_file(paths[index], contents[index]);
+    input_paths[index] = paths[index];
+  }
+
+  HighestVersion highest;
+  munit_assert_null(initialize_highest_version(&highest));
+  BatchState batch = {0};
+  munit_assert_null(initialize_batch_state(&batch, input_paths, 3, NULL, "patch", 2, MAX_LINE_WIDTH));
+  batch.dry_run = true;
+  batch.highest = &highest;
+  munit_assert_null(process_batch(&batch));
+  munit_assert_size(count_batch_failures(&batch), ==, 0);
+  free_batch_state(&batch);
+  char target[64];
+  bool found;
+  munit_assert_null(bump_highest_version(&highest, BUMP_PATCH, target, sizeof(target), &found));
+  free_highest_version(&highest);
+  munit_assert_true(found);
+  munit_assert_string_equal(target, "1.10.1");
+
+  munit_assert_not_null(configure_target("1.10"));
+  munit_assert_null(configure_target("1.10.1"));
+  munit_assert_null(initialize_batch_state(&batch, input_paths, 3, NULL, BUMP_TARGET_LEVEL, 2, MAX_LINE_WIDTH));
+  munit_assert_null(process_batch(&batch));
+  munit_assert_size(count_batch_failures(&batch), ==, 0);
+  free_batch_state(&batch);
+  assert_file_contents(paths[0], "a 1.10.1 b 1.10.1\n");
+  assert_file_contents(paths[1], "x 1.10.1 y 1.10.1\n");
+  assert_file_contents(paths[2], "none\n");
+
+  // A minor component too large for the key is compared by its digits.
+  const char *wide_contents[3] = {"a 1.2.3\n", "b 1.099999999999.0 and 1.99999999998.7\n", "none\n"};
+  for (size_t index = 0; index < 3; ++index) {
+    remove(paths[index]);
+    strcpy(paths[index], "/tmp/bump-lockstep-XXXXXX");
+    write_temporary_file(paths[index], wide_contents[index]);
+  }
+  munit_assert_null(initialize_highest_version(&highest));
+  munit_assert_null(initialize_batch_state(&batch, input_paths, 3, NULL, "patch", 2, MAX_LINE_WIDTH));
+  batch.dry_run = true;
+  batch.highest = &highest;
+  munit_assert_null(process_batch(&batch));
+  munit_assert_size(count_batch_failures(&batch), ==, 0);
+  free_batch_state(&batch);
+  munit_assert_null(bump_highest_version(&highest, BUMP_PATCH, target, sizeof(target), &found));
+  munit_assert_true(found);
+  munit_assert_string_equal(target, "1.99999999999.1");
+  munit_assert_null(bump_highest_version(&highest, BUMP_MINOR, target, sizeof(target), &found));
+  munit_assert_string_equal(target, "1.100000000000.0");
+  munit_assert_not_null(bump_highest_version(&highest, BUMP_MINOR, target, 16, &found));
+  free_highest_version(&highest);
+  for (size_t index = 0; index < 3; ++index) {
+    remove(paths[index]);
+  }
+
+  return MUNIT_OK;
+}
+
+MunitResult process_path_in_place_replaces() {
+  char directory[32] = "/tmp/bump-replace-XXXXXX";
+  munit_assert_not_null(mkdtemp(directory));
+  char path[64];
+  char link_path[64];
+  snprintf(path, sizeof(path), "%s/version.txt", directory);
+  snprintf(link_path, sizeof(link_path), "%s/link.txt", directory);
+  FILE *file = fopen(path, "w");
+  munit_assert_not_null(file);
+  fputs("v9.2.3\n", file);
+  fclose(file);
+  munit_assert_int(chmod(path, 0640), ==, 0);
+  struct stat before;
+  munit_assert_int(stat(path, &before), ==, 0);
+
+  munit_assert_null(process_path(path, path, "major", MAX_LINE_WIDTH, NULL));
+  assert_file_contents(path, "v10.0.0\n");
+  struct stat after;
+  munit_assert_int(stat(path, &after), ==, 0);
+  munit_assert_int(after.st_mode & 07777, ==, 0640);
+  // The version grew, so the original was replaced rather than patched.
+  munit_assert_true(after.st_ino != before.st_ino);
+
+  // A link is followed, and the file it points to is patched or replaced while the link stays.
+  munit_assert_int(symlink("version.txt", link_path), ==, 0);
+  munit_assert_null(process_path(link_path, link_path, "patch", MAX_LINE_WIDTH, NULL));
+  assert_file_contents(path, "v10.0.1\n");
+  munit_assert_null(process_path(link_path, link_path, "major", MAX_LINE_WIDTH, NULL));
+  assert_file_contents(path, "v11.0.0\n");
+  munit_assert_int(lstat(link_path, &after), ==, 0);
+  munit_assert_true(S_ISLNK(after.st_mode));
+  munit_assert_int(stat(path, &after), ==, 0);
+  munit_assert_int(after.st_mode & 07777, ==, 0640);
+
+  // Nothing is left behind besides the file and the link.
+  DIR *listing = opendir(directory);
+  munit_assert_not_null(listing);
+  size_t entries = 0;
+  struct dirent *entry;
+  while ((entry = readdir(listing))) {
+    entries++;
+  }
+  closedir(listing);
+  munit_assert_size(entries, ==, 4);
+
+  remove(link_path);
+  remove(path);
+  rmdir(directory);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_path_skips_unchanged() {
+  munit_assert_false(contains_version("1.2 and 1.2.3.4", 15));
+  munit_assert_true(contains_version("1.2 and 1.2.3", 13));
+
+  char path[32] = "/tmp/bump-unchanged-XXXXXX";
+  write_temporary_file(path, "only 1.2 and 3.4.5.6 here\n");
+  struct stat before;
+  munit_assert_int(stat(path, &before), ==, 0);
+
+  bool changed = true;
+  munit_assert_null(process_path(path, path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_false(changed);
+  struct stat after;
+  munit_assert_int(stat(path, &after), ==, 0);
+  munit_assert_true(after.st_ino == before.st_ino);
+  munit_assert_true(after.st_mtim.tv_sec == before.st_mtim.tv_sec && after.st_mtim.tv_nsec == before.st_mtim.tv_nsec);
+  assert_file_contents(path, "only 1.2 and 3.4.5.6 here\n");
+
+  FILE *file = fopen(path, "w");
+  munit_assert_not_null(file);
+  fputs("now 3.4.5\n", file);
+  fclose(file);
+  munit_assert_null(process_path(path, path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "now 3.4.6\n");
+  remove(path);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_path_replaces_output() {
+  char input_path[32] = "/tmp/bump-input-XXXXXX";
+  char output_path[32] = "/tmp/bump-output-XXXXXX";
+  write_temporary_file(input_path, "v 1.2.3\n");
+  write_temporary_file(output_path, "previous\n");
+  munit_assert_int(chmod(output_path, 0640), ==, 0);
+
+  // Failed bumps leave the existing output as it was.
+  munit_assert_not_null(process_path("/tmp", output_path, "patch", MAX_LINE_WIDTH, NULL));
+  munit_assert_not_null(process_path("/tmp/bump-missing-input", output_path, "patch", MAX_LINE_WIDTH, NULL));
+  assert_file_contents(output_path, "previous\n");
+
+  bool changed = false;
+  munit_assert_null(process_path(input_path, output_path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(output_path, "v 1.2.4\n");
+  struct stat status;
+  munit_assert_int(stat(output_path, &status), ==, 0);
+  munit_assert_int(status.st_mode & 07777, ==, 0640);
+
+  // A file state opened by path does not truncate its output either, even when it is the input.
+  FileState state = {0};
+  munit_assert_not_null(initialize_file_state(&state, input_path, output_path, "patch", 1));
+  assert_file_contents(output_path, "v 1.2.4\n");
+  munit_assert_null(initialize_file_state(&state, output_path, output_path, "minor", MAX_LINE_WIDTH));
+  assert_file_contents(output_path, "v 1.2.4\n");
+  munit_assert_null(process_file(&state));
+  assert_file_contents(output_path, "v 1.3.0\n");
+  remove(input_path);
+  remove(output_path);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_path_follows_output_links() {
+  char directory[32] = "/tmp/bump-output-XXXXXX";
+  munit_assert_not_null(mkdtemp(directory));
+  char path[64];
+  char link_path[64];
+  snprintf(path, sizeof(path), "%s/real.txt", directory);
+  snprintf(link_path, sizeof(link_path), "%s/link.txt", directory);
+  FILE *file = fopen(path, "w");
+  munit_assert_not_null(file);
+  fputs("v 1.2.3\n", file);
+  fclose(file);
+  munit_assert_int(symlink("real.txt", link_path), ==, 0);
+
+  // A failed bump into a link leaves the file it points to as it was.
+  munit_assert_not_null(process_path(directory, link_path, "patch", MAX_LINE_WIDTH, NULL));
+  assert_file_contents(path, "v 1.2.3\n");
+
+  // A link to the input is the input, so it is bumped in place rather than emptied.
+  bool changed = false;
+  munit_assert_null(process_path(path, link_path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "v 1.2.4\n");
+  munit_assert_null(process_path(path, link_path, "major", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "v 2.0.0\n");
+  struct stat status;
+  munit_assert_int(lstat(link_path, &status), ==, 0);
+  munit_assert_true(S_ISLNK(status.st_mode));
+
+  remove(link_path);
+  remove(path);
+  rmdir(directory);
+
+  return MUNIT_OK;
+}
+
+MunitResult read_file_lists() {
+  char lines[] = "first.txt\r\n\nsecond one.txt\nlast.txt";
+  FILE *input = fmemopen(lines, sizeof(lines) - 1, "r");
+  munit_assert_not_null(input);
+  FileList list;
+  munit_assert_null(read_file_list(input, '\n', &list));
+  fclose(input);
+  munit_assert_size(list.count, ==, 3);
+  munit_assert_string_equal(list.paths[0], "first.txt");
+  munit_assert_string_equal(list.paths[1], "second one.txt");
+  munit_assert_string_equal(list.paths[2], "last.txt");
+  free_file_list(&list);
+
+  char separated[] = "new\nline.txt\0\0plain.txt\0";
+  input = fmemopen(separated, sizeof(separated) - 1, "r");
+  munit_assert_not_null(input);
+  munit_assert_null(read_file_list(input, '\0', &list));
+  fclose(input);
+  munit_assert_size(list.count, ==, 2);
+  munit_assert_string_equal(list.paths[0], "new\nline.txt");
+  munit_assert_string_equal(list.paths[1], "plain.txt");
+  free_file_list(&list);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_path_patches_in_place() {
+  char path[32] = "/tmp/bump-patch-XXXXXX";
+  write_temporary_file(path, "a 1.2.3 b 1.2.9 c 1.2 d 0.0.19.\n");
+
+  bool changed = false;
+  munit_assert_null(process_path(path, path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "a 1.2.4 b 1.2.10 c 1.2 d 0.0.19.\n");
+  munit_assert_null(process_path(path, path, "minor", MAX_LINE_WIDTH, &changed));
+  assert_file_contents(path, "a 1.3.0 b 1.3.0 c 1.2 d 0.0.19.\n");
+  struct stat replaced;
+  munit_assert_int(stat(path, &replaced), ==, 0);
+
+  // Every version keeps its length, so the same file is written to.
+  munit_assert_null(process_path(path, path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "a 1.3.1 b 1.3.1 c 1.2 d 0.0.19.\n");
+  struct stat patched;
+  munit_assert_int(stat(path, &patched), ==, 0);
+  munit_assert_true(patched.st_ino == replaced.st_ino);
+  remove(path);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_streams_filter() {
+  int descriptors[2];
+  munit_assert_int(pipe(descriptors), ==, 0);
+  const char *input = "name 1.2.3\nversion 4.5\n";
+  munit_assert_true(write(descriptors[1], input, strlen(input)) == (ssize_t) strlen(input));
+  munit_assert_int(close(descriptors[1]), ==, 0);
+
+  char path[32] = "/tmp/bump-filter-XXXXXX";
+  write_temporary_file(path, "");
+  FILE *output = fopen(path, "w");
+  munit_assert_not_null(output);
+  bool changed = false;
+  munit_assert_null(process_streams(fdopen(descriptors[0], "r"), output, "major", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "name 2.0.0\nversion 4.5\n");
+  remove(path);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_batch_io_uring() {
+  // Patches go through the ring, a growing version needs a rewrite, and a link is followed.
+  const char *contents[] = {"version 1.2.3\n", "two 1.2.3, 4.5.6\n", "grows 9.9.9\n", "no version\n", ""};
+  const char *expected[] = {"version 1.2.4\n", "two 1.2.4, 4.5.7\n", "grows 9.9.10\n", "no version\n", ""};
+  char paths[5][32];
+  const char *input_paths[7];
+  for (size_t index = 0; index < 5; ++index) {
+    strcpy(paths[index], "/tmp/bump-uring-XXXXXX");
+    write_temporary_file(paths[index], contents[index]);
+    input_paths[index] = paths[index];
+  }
+  input_paths[5] = "/tmp/bump-uring-missing/file.txt";
+  char linked_path[32] = "/tmp/bump-uring-XXXXXX";
+  write_temporary_file(linked_path, "linked 3.4.5\n");
+  char link_path[40];
+  snprintf(link_path, sizeof(link_path), "%s-link", linked_path);
+  munit_assert_int(symlink(linked_path, link_path), ==, 0);
+  input_paths[6] = link_path;
+
+  // Without io_uring the same results come from plain reads.
+  BatchState batch = {0};
+  munit_assert_null(initialize_batch_state(&batch, input_paths, 7, NULL, "patch", 2, MAX_LINE_WIDTH));
+  batch.io_uring = true;
+  munit_assert_null(process_batch(&batch));
+  munit_assert_size(count_batch_failures(&batch), ==, 1);
+  munit_assert_not_null(batch.results[5].error);
+  munit_assert_null(batch.results[6].error);
+  munit_assert_true(batch.results[6].changed);
+  assert_file_contents(linked_path, "linked 3.4.6\n");
+  for (size_t index = 0; index < 5; ++index) {
+    munit_assert_string_equal(batch.results[index].path, paths[index]);
+    munit_assert_null(batch.results[index].error);
+    munit_assert(batch.results[index].changed == (index < 3));
+    assert_file_contents(paths[index], expected[index]);
+    remove(paths[index]);
+  }
+  remove(link_path);
+  remove(linked_path);
+  free_batch_state(&batch);
+
+  // With more workers than files in flight, the workers without a share read as usual.
+  char many_paths[80][32];
+  const char *many_inputs[80];
+  for (size_t index = 0; index < 80; ++index) {
+    strcpy(many_paths[index], "/tmp/bump-uring-XXXXXX");
+    write_temporary_file(many_paths[index], "version 1.2.3\n");
+    many_inputs[index] = many_paths[index];
+  }
+  munit_assert_null(initialize_batch_state(&batch, many_inputs, 80, NULL, "patch", 80, MAX_LINE_WIDTH));
+  batch.io_uring = true;
+  munit_assert_null(process_batch(&batch));
+  munit_assert_size(count_batch_failures(&batch), ==, 0);
+  for (size_t index = 0; index < 80; ++index) {
+    munit_assert_true(batch.results[index].changed);
+    assert_file_contents(many_paths[index], "version 1.2.4\n");
+    remove(many_paths[index]);
+  }
+  free_batch_state(&batch);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_batch_reports_failures() {
+  char path[32] = "/tmp/bump-batch-XXXXXX";
+  write_temporary_file(path, "1.0.0");
+  const char *input_paths[] = {path, "/tmp/bump-batch-missing/file.txt"};
+
+  BatchState batch = {0};
+  munit_assert_null(initialize_batch_state(&batch, input_paths, 2, NULL, "patch", 0, MAX_LINE_WIDTH));
+  munit_assert_null(process_batch(&batch));
+  munit_assert_size(count_batch_failures(&batch), ==, 1);
+  munit_assert_null(batch.results[0].error);
+  munit_assert_not_null(batch.results[1].error);
+  assert_file_contents(path, "1.0.1");
+
+  remove(path);
+  free_batch_state(&batch);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_walk_recursive() {
+  char root[32] = "/tmp/bump-walk-XXXXXX";
+  munit_assert_not_null(mkdtemp(root));
+
+  char path[64];
+  const char *directories[] = {"", "/a", "/a/b", "/c", "/.git"};
+  for (size_t index = 0; index < 5; ++index) {
+    sprintf(path, "%s%s", root, directories[index]);
+    if (index > 0) {
+      munit_assert_int(mkdir(path, 0700), ==, 0);
+    }
+    sprintf(path, "%s%s/file.txt", root, directories[index]);
+    FILE *file = fopen(path, "w");
+    munit_assert_not_null(file);
+    fputs("release 2.7.1", file);
+    munit_assert_int(fclose(file), ==, 0);
+  }
+
+  // The ignore file prunes a/b without it ever being opened.
+  sprintf(path, "%s/.bumpignore", root);
+  FILE *ignore_file = fopen(path, "w");
+  munit_assert_not_null(ignore_file);
+  fputs("b/\n", ignore_file);
+  munit_assert_int(fclose(ignore_file), ==, 0);
+
+  const char *roots[] = {root};
+  WalkState walk = {0};
+  munit_assert_null(initialize_walk_state(&walk, roots, 1, "major", 3, MAX_LINE_WIDTH));
+  munit_assert_null(process_walk(&walk));
+  munit_assert_size(walk.result_count, ==, 0);
+  munit_assert_size(walk.file_count, ==, 4);
+
+  for (size_t index = 5; index-- > 0;) {
+    sprintf(path, "%s%s/file.txt", root, directories[index]);
+    assert_file_contents(path, index == 2 || index == 4 ? "release 2.7.1" : "release 3.0.0");
+    remove(path);
+    if (index == 0) {
+      sprintf(path, "%s/.bumpignore", root);
+      remove(path);
+    }
+    sprintf(path, "%s%s", root, directories[index]);
+    munit_assert_int(rmdir(path), ==, 0);
+  }
+  free_walk_state(&walk);
+
+  return MUNIT_OK;
+}
+
+MunitResult glob_patterns() {
+  munit_assert_true(glob_matches("*.o", 3, "main.o", 6));
+  munit_assert_false(glob_matches("*.o", 3, "src/main.o", 10));
+  munit_assert_true(glob_matches("**/main.o", 9, "src/main.o", 10));
+  munit_assert_true(glob_matches("**/main.o", 9, "main.o", 6));
+  munit_assert_true(glob_matches("a/**/b", 6, "a/x/y/b", 7));
+  munit_assert_true(glob_matches("a/**/b", 6, "a/b", 3));
+  munit_assert_true(glob_matches("build/**", 8, "build/x/y", 9));
+  munit_assert_true(glob_matches("v?.[0-9]", 8, "v1.7", 4));
+  munit_assert_false(glob_matches("v?.[!0-9]", 9, "v1.7", 4));
+
+  return MUNIT_OK;
+}
+
+MunitResult pattern_set_precedence() {
+  const char *lines[] = {"# comment", "", "node_modules/", "*.log", "!important.log", "/build", "docs/*.md", "important.log  "};
+  PatternSet set;
+  munit_assert_null(initialize_pattern_set(&set));
+  for (size_t index = 0; index < 8; ++index) {
+    munit_assert_null(add_pattern(&set, lines[index], strlen(lines[index])));
+  }
+  munit_assert_size(set.count, ==, 6);
+  munit_assert_null(compile_pattern_set(&set));
+
+  munit_assert_int(match_pattern_set(&set, "a/node_modules", "node_modules", true), ==, PATTERN_MATCHED);
+  munit_assert_int(match_pattern_set(&set, "a/node_modules", "node_modules", false), ==, PATTERN_UNMATCHED);
+  munit_assert_int(match_pattern_set(&set, "x/debug.log", "debug.log", false), ==, PATTERN_MATCHED);
+  munit_assert_int(match_pattern_set(&set, "important.log", "important.log", false), ==, PATTERN_MATCHED);
+  munit_assert_int(match_pattern_set(&set, "build", "build", true), ==, PATTERN_MATCHED);
+  munit_assert_int(match_pattern_set(&set, "src/build", "build", true), ==, PATTERN_UNMATCHED);
+  munit_assert_int(match_pattern_set(&set, "docs/notes.md", "notes.md", false), ==, PATTERN_MATCHED);
+  munit_assert_int(match_pattern_set(&set, "docs/a/notes.md", "notes.md", false), ==, PATTERN_UNMATCHED);
+  free_pattern_set(&set);
+
+  PatternSet negated;
+  munit_assert_null(initialize_pattern_set(&negated));
+  munit_assert_null(add_pattern(&negated, "*.log", 5));
+  munit_assert_null(add_pattern(&negated, "!keep.log", 9));
+  munit_assert_null(compile_pattern_set(&negated));
+  munit_assert_int(match_pattern_set(&negated, "keep.log", "keep.log", false), ==, PATTERN_REINCLUDED);
+  munit_assert_int(match_pattern_set(&negated, "drop.log", "drop.log", false), ==, PATTERN_MATCHED);
+  free_pattern_set(&negated);
+
+  return MUNIT_OK;
+}
+
+MunitResult binary_files_skipped() {
+  munit_assert_false(looks_binary("", 0));
+  munit_assert_false(looks_binary("version 1.2.3\r\n\tand \x1b[1mbold\x1b[0m text\n", 36));
+  munit_assert_true(looks_binary("version 1.2.3\0", 14));
+  munit_assert_true(looks_binary("\x7f" "ELF\x02\x01\x01\x03\x04\x05", 10));
+
+  // Multibyte characters across the sixteen-byte steps, and one cut off by the end of the sniffed part.
+  char text[BINARY_SNIFF_SIZE + 16];
+  for (size_t index = 0; index + 3 <= sizeof(text); index += 3) {
+    memcpy(text + index, index % 2 ? "\xe6\x97\xa5" : "a\xc3\xa9", 3);
+  }
+  munit_assert_false(looks_binary(text, sizeof(text) - 1));
+  memset(text, 'x', 66);
+  for (size_t index = 0; index < 8; index++) {
+    text[index * 7] = (char) 0xff;
+  }
+  munit_assert_false(looks_binary(text, 100));
+  munit_assert_true(looks_binary(text, 66));
+
+  char path[32] = "/tmp/bump-binary-XXXXXX";
+  int descriptor = mkstemp(path);
+  munit_assert_int(descriptor, !=, -1);
+  munit_assert_int(write(descriptor, "v 1.2.3\0\1 9.9.9\n", 16), ==, 16);
+  munit_assert_int(close(descriptor), ==, 0);
+  bool changed = true;
+  munit_assert_ptr_equal(process_path(path, path, "patch", MAX_LINE_WIDTH, &changed), binary_file_skipped);
+  munit_assert_false(changed);
+  configure_binary_detection(false);
+  munit_assert_null(process_path(path, path, "patch", MAX_LINE_WIDTH, &changed));
+  configure_binary_detection(true);
+  munit_assert_true(changed);
+  remove(path);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_path_from_version() {
+  const char *text = "1.4.2 11.4.2 2.1.4.2 x.1.4.2 1.4.20 1.2.3 1.4.2.\n(1.4.2)";
+  // The search agrees with memmem() from every offset, across the sixteen-byte steps.
+  for (size_t begin = 0; begin < 56; ++begin) {
+    const char *found = memmem(text + begin, 56 - begin, "1.4.2", 5);
+    munit_assert_ptr_equal(find_substring(text + begin, text + 56, "1.4.2", 5), found ? found : text + 56);
+  }
+
+  char path[32] = "/tmp/bump-from-XXXXXX";
+  int descriptor = mkstemp(path);
+  munit_assert_int(descriptor, !=, -1);
+  munit_assert_int(write(descriptor, text, strlen(text)), ==, (ssize_t) strlen(text));
+  munit_assert_int(close(descriptor), ==, 0);
+  bool changed = false;
+  munit_assert_not_null(configure_source("1.4"));
+  munit_assert_null(configure_source("1.4.2"));
+  munit_assert_null(process_path(path, path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "1.4.3 11.4.2 2.1.4.2 x.1.4.3 1.4.20 1.2.3 1.4.2.\n(1.4.3)");
+
+  // A longer target rewrites the file instead of patching it.
+  munit_assert_null(configure_source("1.4.3"));
+  munit_assert_null(configure_target("2.0.10"));
+  munit_assert_null(process_path(path, path, BUMP_TARGET_LEVEL, MAX_LINE_WIDTH, &changed));
+  assert_file_contents(path, "2.0.10 11.4.2 2.1.4.2 x.2.0.10 1.4.20 1.2.3 1.4.2.\n(2.0.10)");
+  munit_assert_null(configure_source(NULL));
+  remove(path);
+
+  return MUNIT_OK;
+}
+
+MunitResult scan_kernels_agree() {
+  const char alphabet[] = "0123456789.. ab";
+  char buffer[256];
+  for (size_t index = 0; index < sizeof(buffer); ++index) {
+    // Mostly letters, so that candidates are sparse enough to cross whole vectors.
+    buffer[index] = munit_rand_int_range(0, 7) ? 'x' : alphabet[munit_rand_int_range(0, 14)];
+  }
+
+  const ScanKernel kernels[] = {SCAN_KERNEL_SSE2, SCAN_KERNEL_AVX2, SCAN_KERNEL_AVX512};
+  for (size_t kernel = 0; kernel < 3; ++kernel) {
+    if (!select_scan_kernel(kernels[kernel])) {
+      continue;
+    }
+    for (size_t begin = 0; begin < 80; ++begin) {
+      for (size_t end = begin; end <= sizeof(buffer); end += 7) {
+        munit_assert_true(select_scan_kernel(SCAN_KERNEL_SCALAR));
+        const char *expected = find_version_candidate(buffer + begin, buffer + end);
+        munit_assert_true(select_scan_kernel(kernels[kernel]));
+        munit_assert_ptr_equal(find_version_candidate(buffer + begin, buffer + end), expected);
+      }
+    }
+  }
+  munit_assert_true(select_scan_kernel(detect_scan_kernel()));
+
+  // A digit right at the end has no period after it.
+  munit_assert_ptr_equal(find_version_candidate(buffer, buffer), buffer);
+  const char *text = "ab 12 x3.y";
+  munit_assert_ptr_equal(find_version_candidate(text, text + 10), text + 7);
+  munit_assert_ptr_equal(find_version_candidate(text, text + 8), text + 8);
+
+  return MUNIT_OK;
+}
+
+MunitResult process_line_keeps_other_numbers() {
+  const char *input_line = "007 items, 12 of 0040 in v1.2.3!";
+  char line[64] = {0};
+
+  LineState state = {0};
+  munit_assert_null(initialize_line_state(&state, input_line, line, strlen(input_line)));
+  munit_assert_null(process_line(&state, "minor"));
+  munit_assert_string_equal(line, "007 items, 12 of 0040 in v1.3.0!");
+
+  return MUNIT_OK;
+}
+
+MunitResult process_versions_dense() {
+  char input_line[8192];
+  char expected[8192];
+  char line[8192 + 8192 / 5 + 2];
+  size_t length = 0;
+  size_t expected_length = 0;
+  for (size_t index = 0; index < 300; ++index) {
+    length += (size_t) sprintf(input_line + length, "\"d%zu\":\"%zu.0.9\",", index, index);
+    expected_length += (size_t) sprintf(expected + expected_length, "\"d%zu\":\"%zu.0.10\",", index, index);
+  }
+  length += (size_t) sprintf(input_line + length, "01.2 and 1.2.3.");
+  expected_length += (size_t) sprintf(expected + expected_length, "01.2 and 1.2.3.");
+
+  LineState state = {0};
+  munit_assert_null(initialize_line_state(&state, input_line, line, length));
+  munit_assert_null(process_versions(&state, "patch"));
+  munit_assert_size(state.input_index, ==, length);
+  munit_assert_size(state.output_index, ==, expected_length);
+  munit_assert_memory_equal(expected_length, line, expected);
+
+  munit_assert_null(initialize_line_state(&state, input_line, line, length));
+  munit_assert_string_equal(process_versions(&state, "micro"), "Invalid bump level");
+
+  return MUNIT_OK;
+}
+
+MunitResult process_file_long_components() {
+  // The patch component spans several blocks and carries into a new digit.
+  char input[1024];
+  char expected[1025];
+  char output[1026] = {0};
+  memcpy(input, "v007.1.", 7);
+  memset(input + 7, '9', 1012);
+  memcpy(input + 1019, " 0.9!", 5);
+  memcpy(expected, "v007.1.1", 8);
+  memset(expected + 8, '0', 1012);
+  memcpy(expected + 1020, " 0.9!", 5);
+
+  FileState state = {0};
+  state.input = fmemopen(input, sizeof(input), "r");
+  state.output = fmemopen(output, sizeof(output), "w");
+  state.bump_level = "patch";
+  state.block_size = MAX_LINE_WIDTH;
+  munit_assert_not_null(state.input);
+  munit_assert_not_null(state.output);
+  munit_assert_null(process_file(&state));
+  munit_assert_memory_equal(sizeof(expected), output, expected);
+
+  const char *input_line = "099.123456789012345678901234567890.5 09.9.9";
+  char line[64] = {0};
+  LineState line_state = {0};
+  munit_assert_null(initialize_line_state(&line_state, input_line, line, strlen(input_line)));
+  munit_assert_null(process_versions(&line_state, "minor"));
+  munit_assert_size(line_state.output_index, ==, strlen(input_line) + 1);
+  munit_assert_string_equal(line, "099.123456789012345678901234567891.0 09.10.0");
+
+  return MUNIT_OK;
+}
+
+MunitResult scan_reports_versions() {
+  const char *data = "v1.2.3\nno 1.2 here\n  \"a\": \"09.9.99\", 4.5.6.7";
+  FileScan scan;
+  munit_assert_null(scan_buffer(data, strlen(data), &scan));
+  munit_assert_size(scan.count, ==, 2);
+  munit_assert_size(scan.matches[0].offset, ==, 1);
+  munit_assert_size(scan.matches[0].line, ==, 1);
+  munit_assert_size(scan.matches[0].column, ==, 2);
+  munit_assert_size(scan.matches[1].offset, ==, 27);
+  munit_assert_size(scan.matches[1].line, ==, 3);
+  munit_assert_size(scan.matches[1].column, ==, 9);
+
+  char *report = NULL;
+  size_t length = 0;
+  FILE *output = open_memstream(&report, &length);
+  munit_assert_not_null(output);
+  munit_assert_null(write_scan_report(output, REPORT_JSON, "dir/\"a\".txt", NULL, &scan, BUMP_PATCH));
+  munit_assert_null(write_scan_report(output, REPORT_TEXT, "a.txt", NULL, &scan, BUMP_MINOR));
+  munit_assert_null(write_scan_report(output, REPORT_JSON, "b.txt", "Could open input stream", NULL, BUMP_PATCH));
+  fclose(output);
+  munit_assert_string_equal(report,
+                            "{\"path\":\"dir/\\\"a\\\".txt\",\"versions\":["
+                            "{\"offset\":1,\"line\":1,\"column\":2,\"text\":\"1.2.3\","
+                            "\"major\":\"2.0.0\",\"minor\":\"1.3.0\",\"patch\":\"1.2.4\"},"
+                            "{\"offset\":27,\"line\":3,\"column\":9,\"text\":\"09.9.99\","
+                            "\"major\":\"10.0.0\",\"minor\":\"09.10.0\",\"patch\":\"09.9.100\"}]}\n"
+                            "a.txt:1:2: 1.2.3 -> 1.3.0\n"
+                            "a.txt:3:9: 09.9.99 -> 09.10.0\n"
+                            "{\"path\":\"b.txt\",\"error\":\"Could open input stream\"}\n");
+  free(report);
+
+  // A target, as set by --to or a lockstep bump, is listed as well.
+  munit_assert_null(configure_target("3.0.0"));
+  output = open_memstream(&report, &length);
+  munit_assert_not_null(output);
+  scan.count = 1;
+  munit_assert_null(write_scan_report(output, REPORT_JSON, "c.txt", NULL, &scan, BUMP_TARGET));
+  fclose(output);
+  munit_assert_string_equal(report,
+                            "{\"path\":\"c.txt\",\"versions\":["
+                            "{\"offset\":1,\"line\":1,\"column\":2,\"text\":\"1.2.3\","
+                            "\"major\":\"2.0.0\",\"minor\":\"1.3.0\",\"patch\":\"1.2.4\",\"target\":\"3.0.0\"}]}\n");
+  free(report);
+  scan.count = 2;
+  free_file_scan(&scan);
+
+  // A dry run leaves the input as it is.
+  char path[32] = "/tmp/bump-scan-XXXXXX";
+  write_temporary_file(path, "1.0.0");
+  const char *input_paths[] = {path};
+  BatchState batch = {0};
+  munit_assert_null(initialize_batch_state(&batch, input_paths, 1, NULL, "patch", 1, MAX_LINE_WIDTH));
+  batch.dry_run = true;
+  munit_assert_null(process_batch(&batch));
+  munit_assert_null(batch.results[0].error);
+  munit_assert_size(batch.results[0].scan.count, ==, 1);
+  assert_file_contents(path, "1.0.0");
+  free_batch_state(&batch);
+  remove(path);
+
+  return MUNIT_OK;
+}
+
+static void set_old_timestamp(const char *path) {
+  // Files modified just before they are scanned are never trusted blindly.
+  struct timespec times[2] = {{1000000000, 0}, {1000000000, 0}};
+  munit_assert_int(utimensat(AT_FDCWD, path, times, 0), ==, 0);
+}
+
+MunitResult scan_cache_skips_known_files() {
+  char directory[32] = "/tmp/bump-cache-XXXXXX";
+  munit_assert_not_null(mkdtemp(directory));
+  char cache_path[64];
+  snprintf(cache_path, sizeof(cache_path), "%s/" BUMP_CACHE_DIRECTORY, directory);
+  char path[32] = "/tmp/bump-cached-XXXXXX";
+  write_temporary_file(path, "only 1.2 here\n");
+  set_old_timestamp(path);
+
+  ScanCache cache;
+  FileScan scan;
+  munit_assert_null(open_scan_cache(&cache, cache_path));
+  munit_assert_null(scan_with_cache(&cache, AT_FDCWD, path, path, &scan));
+  munit_assert_size(scan.count, ==, 0);
+  free_file_scan(&scan);
+  munit_assert_null(save_scan_cache(&cache));
+  free_scan_cache(&cache);
+
+  // Same size and timestamp: the cache is trusted and the file is not read.
+  FILE *file = fopen(path, "w");
+  munit_assert_not_null(file);
+  fputs("only 1.2.3 he\n", file);
+  fclose(file);
+  set_old_timestamp(path);
+  struct stat status;
+  munit_assert_int(stat(path, &status), ==, 0);
+  struct timespec times[2] = {status.st_atim, status.st_mtim};
+
+  bool changed = true;
+  munit_assert_null(open_scan_cache(&cache, cache_path));
+  munit_assert_size(cache.count, ==, 1);
+  munit_assert_null(bump_with_cache(&cache, AT_FDCWD, path, path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_false(changed);
+  assert_file_contents(path, "only 1.2.3 he\n");
+  free_scan_cache(&cache);
+
+  // Any change to the timestamp invalidates the entry.
+  times[1].tv_sec += 1;
+  munit_assert_int(utimensat(AT_FDCWD, path, times, 0), ==, 0);
+  munit_assert_null(open_scan_cache(&cache, cache_path));
+  munit_assert_null(scan_with_cache(&cache, AT_FDCWD, path, path, &scan));
+  munit_assert_size(scan.count, ==, 1);
+  free_file_scan(&scan);
+  munit_assert_null(bump_with_cache(&cache, AT_FDCWD, path, path, "patch", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "only 1.2.4 he\n");
+  munit_assert_null(save_scan_cache(&cache));
+  free_scan_cache(&cache);
+
+  // The bumped file is forgotten rather than cached with its old contents.
+  munit_assert_null(open_scan_cache(&cache, cache_path));
+  munit_assert_size(cache.count, ==, 0);
+  free_scan_cache(&cache);
+
+  // A rewrite takes the versions from the cached scan, and the contents from the one read of the file.
+  file = fopen(path, "w");
+  munit_assert_not_null(file);
+  fputs("x 9.9.9 and 9.9\n", file);
+  fclose(file);
+  set_old_timestamp(path);
+  munit_assert_null(open_scan_cache(&cache, cache_path));
+  munit_assert_null(scan_with_cache(&cache, AT_FDCWD, path, path, &scan));
+  munit_assert_size(scan.count, ==, 1);
+  free_file_scan(&scan);
+  munit_assert_null(save_scan_cache(&cache));
+  free_scan_cache(&cache);
+  munit_assert_null(open_scan_cache(&cache, cache_path));
+  munit_assert_size(cache.count, ==, 1);
+  munit_assert_null(bump_with_cache(&cache, AT_FDCWD, path, path, "minor", MAX_LINE_WIDTH, &changed));
+  munit_assert_true(changed);
+  assert_file_contents(path, "x 9.10.0 and 9.9\n");
+  munit_assert_null(save_scan_cache(&cache));
+  free_scan_cache(&cache);
+
+  // A binary file cached while detection was off is still skipped once it is back on.
+  static const char binary[] = "bin\0 1.2.3\n";
+  file = fopen(path, "wb");
+  munit_assert_not_null(file);
+  munit_assert_size(fwrite(binary, 1, sizeof(binary) - 1, file), ==, sizeof(binary) - 1);
+  fclose(file);
+  set_old_timestamp(path);
+  configure_binary_detection(false);
+  munit_assert_null(open_scan_cache(&cache, cache_path));
+  munit_assert_null(scan_with_cache(&cache, AT_FDCWD, path, path, &scan));
+  munit_assert_size(scan.count, ==, 1);
+  free_file_scan(&scan);
+  munit_assert_null(save_scan_cache(&cache));
+  free_scan_cache(&cache);
+  configure_binary_detection(true);
+  munit_assert_null(open_scan_cache(&cache, cache_path));
+  munit_assert_size(cache.count, ==, 1);
+  munit_assert_ptr_equal(scan_with_cache(&cache, AT_FDCWD, path, path, &scan), binary_file_skipped);
+  munit_assert_size(scan.count, ==, 0);
+  munit_assert_ptr_equal(bump_with_cache(&cache, AT_FDCWD, path, path, "patch", MAX_LINE_WIDTH, &changed),
+                         binary_file_skipped);
+  munit_assert_false(changed);
+  free_scan_cache(&cache);
+  char contents[sizeof(binary)];
+  file = fopen(path, "rb");
+  munit_assert_not_null(file);
+  munit_assert_size(fread(contents, 1, sizeof(contents), file), ==, sizeof(binary) - 1);
+  fclose(file);
+  munit_assert_memory_equal(sizeof(binary) - 1, contents, binary);
+
+  remove(path);
+  char index_path[80];
+  snprintf(index_path, sizeof(index_path), "%s/" BUMP_CACHE_INDEX, cache_path);
+  remove(index_path);
+  snprintf(index_path, sizeof(index_path), "%s/" BUMP_CACHE_LOCK, cache_path);
+  remove(index_path);
+  rmdir(cache_path);
+  rmdir(directory);
+  return MUNIT_OK;
+}
+
+MunitResult stats_count_work() {
+  char path[32] = "/tmp/bump-stats-XXXXXX";
+  write_temporary_file(path, "a 1.2.3\nb 1.2\nc 9.9.9\n");
+  char output_path[32] = "/tmp/bump-stats-out-XXXXXX";
+  write_temporary_file(output_path, "");
+
+  BumpStats before;
+  collect_stats(&before);
+  munit_assert_null(process_path(path, output_path, "patch", MAX_LINE_WIDTH, NULL));
+  munit_assert_null(process_path(output_path, output_path, "minor", MAX_LINE_WIDTH, NULL));
+  BumpStats after;
+  collect_stats(&after);
+  assert_file_contents(output_path, "a 1.3.0\nb 1.2\nc 9.10.0\n");
+
+  munit_assert_uint64(after.files - before.files, ==, 2);
+  munit_assert_uint64(after.files_unchanged - before.files_unchanged, ==, 0);
+  munit_assert_uint64(after.versions - before.versions, ==, 4);
+  munit_assert_uint64(after.bytes_written - before.bytes_written, >=, 22);
+  munit_assert_uint64(after.bytes_read - before.bytes_read, >=, 22);
+  munit_assert_uint64(after.candidates - before.candidates, >=, 4);
+  munit_assert_uint64(after.system_calls - before.system_calls, >, 0);
+
+  char *report = NULL;
+  size_t length = 0;
+  FILE *output = open_memstream(&report, &length);
+  munit_assert_not_null(output);
+  munit_assert_null(write_stats(output, REPORT_JSON, &after, 0.5));
+  fclose(output);
+  munit_assert_true(strncmp(report, "{\"bytes_read\":", 14) == 0);
+  munit_assert_not_null(strstr(report, "\"wall_seconds\":{\"total\":0.500000,"));
+  free(report);
+  remove(path);
+  remove(output_path);
+
+  return MUNIT_OK;
+}
+
+MunitResult trace_records_spans() {
+  enable_tracing();
+  char path[32] = "/tmp/bump-trace-XXXXXX";
+  write_temporary_file(path, "a 1.2.3\n");
+  munit_assert_null(process_path(path, path, "patch", MAX_LINE_WIDTH, NULL));
+  trace_span(TRACE_FILE, "dir/\"quoted\".txt", 0, 1);
+  trace_span(TRACE_FILE, "a/very/long/path/that/does/not/fit/into/the/event/at/all.txt", 0, 1);
+  remove(path);
+
+  char *trace = NULL;
+  size_t length = 0;
+  FILE *output = open_memstream(&trace, &length);
+  munit_assert_not_null(output);
+  munit_assert_null(write_trace(output));
+  fclose(output);
+  free_trace();
+  tracing_enabled = false;
+
+  munit_assert_ptr_equal(strstr(trace, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":["), trace);
+  munit_assert_not_null(strstr(trace, "{\"name\":\"open\",\"cat\":\"open\",\"ph\":\"X\""));
+  munit_assert_not_null(strstr(trace, "{\"name\":\"write\",\"cat\":\"write\",\"ph\":\"X\""));
+  munit_assert_not_null(strstr(trace, "{\"name\":\"dir/\\\"quoted\\\".txt\",\"cat\":\"file\""));
+  munit_assert_not_null(strstr(trace, "{\"name\":\".../that/does/not/fit/into/the/event/at/all.txt\""));
+  munit_assert_not_null(strstr(trace, "\"otherData\":{\"dropped_events\":0}}"));
+  free(trace);
+
+  return MUNIT_OK;
+}
+
 /*
  * MUNIT TEST CONFIGURATION
  * ========================
@@ -250,6 +1378,64 @@ MunitTest tests[] = {
          NULL, MUNIT_TEST_OPTION_NONE, NULL},
         {"/process_test_cases", process_test_cases, NULL,
          NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_line_unterminated", process_line_unterminated, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_path_mapped", process_path_mapped, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_path_split", process_path_split, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_file_long_line", process_file_long_line, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_file_pipelined", process_file_pipelined, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_batch_in_place", process_batch_in_place, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_batch_lockstep", process_batch_lockstep, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_path_in_place_replaces", process_path_in_place_replaces, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_path_skips_unchanged", process_path_skips_unchanged, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_path_replaces_output", process_path_replaces_output, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_path_follows_output_links", process_path_follows_output_links, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/read_file_lists", read_file_lists, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_path_patches_in_place", process_path_patches_in_place, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_streams_filter", process_streams_filter, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_batch_reports_failures", process_batch_reports_failures, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_batch_io_uring", process_batch_io_uring, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_walk_recursive", process_walk_recursive, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/glob_patterns", glob_patterns, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/pattern_set_precedence", pattern_set_precedence, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/binary_files_skipped", binary_files_skipped, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_path_from_version", process_path_from_version, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/scan_kernels_agree", scan_kernels_agree, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_line_keeps_other_numbers", process_line_keeps_other_numbers, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_versions_dense", process_versions_dense, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/process_file_long_components", process_file_long_components, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/scan_reports_versions", scan_reports_versions, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/scan_cache_skips_known_files", scan_cache_skips_known_files, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/stats_count_work", stats_count_work, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
+        {"/trace_records_spans", trace_records_spans, NULL,
+         NULL, MUNIT_TEST_OPTION_NONE, NULL},
         {NULL, NULL, NULL, NULL, MUNIT_TEST_OPTION_NONE, NULL}};
 
 static const MunitSuite suite = {"/bump-test-suite", tests, NULL, 1,